@@ -39,6 +39,25 @@ extern "C" {
 #define BT_UUID_NUS_RX        BT_UUID_DECLARE_128(BT_UUID_NUS_RX_VAL)
 #define BT_UUID_NUS_TX        BT_UUID_DECLARE_128(BT_UUID_NUS_TX_VAL)
 
+/** @brief Notifications kept in flight by @ref bt_nus_send_queued, per connection.
+ *
+ * Should not exceed the controller's ACL TX buffer count, so that every
+ * connection event can carry several packets without
+ * @ref bt_gatt_notify_cb blocking for a buffer.
+ */
+#ifndef BT_NUS_TX_MAX_IN_FLIGHT
+#if defined(CONFIG_BT_CONN_TX_MAX)
+#define BT_NUS_TX_MAX_IN_FLIGHT CONFIG_BT_CONN_TX_MAX
+#else
+#define BT_NUS_TX_MAX_IN_FLIGHT 4
+#endif
+#endif
+
+/** @brief In-flight count at or below which the low-water callback runs. */
+#ifndef BT_NUS_TX_LOW_WATER
+#define BT_NUS_TX_LOW_WATER (BT_NUS_TX_MAX_IN_FLIGHT / 2)
+#endif
+
 /** @brief NUS send status. */
 enum bt_nus_send_status {
 	/** Send notification enabled. */
@@ -47,6 +66,22 @@ enum bt_nus_send_status {
 	BT_NUS_SEND_STATUS_DISABLED,
 };
 
+/** @brief Transmit statistics, see @ref bt_nus_get_stats. */
+struct bt_nus_stats {
+	/** Notifications queued to the stack. */
+	uint32_t notifications;
+	/** Payload bytes in those notifications. */
+	uint32_t bytes;
+	/** Notifications the stack refused. */
+	uint32_t errors;
+	/** Longest @ref bt_nus_send or @ref bt_nus_send_queued call in
+	 *  microseconds.
+	 */
+	uint32_t send_max_us;
+	/** Highest number of notifications in flight. */
+	uint32_t in_flight_peak;
+};
+
 /** @brief Pointers to the callback functions for service events. */
 struct bt_nus_cb {
 	/** @brief Data received callback.
@@ -79,6 +114,26 @@ struct bt_nus_cb {
 	 */
 	void (*send_enabled)(enum bt_nus_send_status status);
 
+	/** @brief TX high-water callback.
+	 *
+	 * @ref BT_NUS_TX_MAX_IN_FLIGHT notifications are outstanding, so
+	 * @ref bt_nus_send_queued accepts no more data until the low-water
+	 * callback.
+	 *
+	 * @param[in] conn Pointer to connection object.
+	 */
+	void (*tx_high_water)(struct bt_conn *conn);
+
+	/** @brief TX low-water callback.
+	 *
+	 * After a high-water callback, enough notifications have completed
+	 * that the in-flight count is back at @ref BT_NUS_TX_LOW_WATER.
+	 * Called from the Bluetooth stack; refill with
+	 * @ref bt_nus_send_queued from here or signal a sender thread.
+	 *
+	 * @param[in] conn Pointer to connection object.
+	 */
+	void (*tx_low_water)(struct bt_conn *conn);
 };
 
 /**@brief Initialize the service.
@@ -101,7 +156,10 @@ int bt_nus_init(struct bt_nus_cb *callbacks);
 /**@brief Send data.
  *
  * @details This function sends data to a connected peer, or all connected
- *          peers.
+ *          peers. Data for a single peer longer than
+ *          @ref bt_nus_get_chunk_size is split into several notifications
+ *          and the sent callback runs once, after the last one. Data for
+ *          all peers is sent as a single notification.
  *
  * @param[in] conn Pointer to connection object, or NULL to send to all
  *                 connected peers.
@@ -113,6 +171,45 @@ int bt_nus_init(struct bt_nus_cb *callbacks);
  */
 int bt_nus_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
 
+/**@brief Queue data without waiting for notifications to complete.
+ *
+ * @details Sends as many @ref bt_nus_get_chunk_size notifications as
+ *          fit below @ref BT_NUS_TX_MAX_IN_FLIGHT, back to back, so each
+ *          connection event can carry several packets. Never blocks. The
+ *          sent callback runs once all of @p len has been sent, and the
+ *          high/low-water callbacks report when to pause and resume.
+ *
+ * @param[in] conn Pointer to connection object, must not be NULL.
+ * @param[in] data Pointer to a data buffer.
+ * @param[in] len  Length of the data in the buffer.
+ *
+ * @return Number of bytes queued, possibly less than @p len,
+ *         -EAGAIN if nothing could be queued because the window is full,
+ *         other negative value on error.
+ */
+int bt_nus_send_queued(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+/**@brief Get the number of notifications not yet completed.
+ *
+ * @param[in] conn Pointer to connection object, or NULL for the sum
+ *                 over all connections.
+ *
+ * @return Notifications in flight, sent by @ref bt_nus_send or
+ *         @ref bt_nus_send_queued to a single peer.
+ */
+uint32_t bt_nus_get_in_flight(struct bt_conn *conn);
+
+/**@brief Get transmit statistics.
+ *
+ * @details Counters are updated with atomic operations from the send
+ *          path and the notification callbacks.
+ *
+ * @param[out] stats Filled with the counters since boot or the last
+ *                   reset, can be NULL to only reset.
+ * @param[in]  reset Clear the counters after reading them.
+ */
+void bt_nus_get_stats(struct bt_nus_stats *stats, bool reset);
+
 /**@brief Get maximum data length that can be used for @ref bt_nus_send.
  *
  * @param[in] conn Pointer to connection Object.
@@ -126,6 +223,38 @@ static inline uint32_t bt_nus_get_mtu(struct bt_conn *conn)
 	return bt_gatt_get_mtu(conn) - 3;
 }
 
+/**@brief Get the data length that fills whole Link Layer packets.
+ *
+ * @details Returns the largest length up to @ref bt_nus_get_mtu for which
+ *          the notification, including its 4 byte L2CAP and 3 byte ATT
+ *          headers, is an exact multiple of the negotiated LL data length.
+ *          With an ATT MTU of 247 and 251 byte packets (data length
+ *          extension, e.g. on 2M PHY) this is 244. Without
+ *          CONFIG_BT_USER_DATA_LEN_UPDATE it equals @ref bt_nus_get_mtu.
+ *
+ * @param[in] conn Pointer to connection Object.
+ *
+ * @return Chunk length used by @ref bt_nus_send.
+ */
+static inline uint32_t bt_nus_get_chunk_size(struct bt_conn *conn)
+{
+	uint32_t max = bt_nus_get_mtu(conn);
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info) == 0 && info.le.data_len) {
+		uint32_t octets = info.le.data_len->tx_max_len;
+
+		if (max + 7 >= octets) {
+			return ((max + 7) / octets) * octets - 7;
+		}
+	}
+#endif
+
+	return max;
+}
+
 #ifdef __cplusplus
 }
 #endif
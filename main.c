@@ -1,13 +1,24 @@
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/byteorder.h>
 #include <string.h>
+#include <stdio.h>
 
 #include "modules/ble_common/ble_init.h"
+#include "modules/ble_common/ble_ipc_proto.h"
 #include "modules/nrf_utils/nrf_utils.h"
 #include "modules/cmd_parser/cmd_parser.h"
+#include "modules/telemetry/telemetry.h"
+#include "modules/scheduler/scheduler.h"
+#include "modules/trace/trace.h"
+#include "modules/app_config/app_config.h"
+#include "modules/boot/boot.h"
+#include "modules/bulk/bulk.h"
+#include "modules/supervisor/supervisor.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
@@ -15,8 +26,20 @@ LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 #define LED0_NODE DT_ALIAS(led0)
 const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
 
+/* Longest silence when auto status only reports changes */
+#define AUTO_STATUS_MAX_SILENCE_S 300
+
 /* Application state */
-static bool auto_status_enabled = true;
+enum auto_status_mode {
+    AUTO_STATUS_OFF = 0,
+    AUTO_STATUS_TEXT,
+    AUTO_STATUS_COMPACT,
+};
+
+static const char *const auto_status_names[] = { "off", "text", "compact" };
+
+/* Mode and changes-only flag live in app_config, so they survive a reset */
+static atomic_t auto_status_resync = ATOMIC_INIT(1);
 
 /* BLE event callbacks */
 static void on_ble_ready(void)
@@ -31,38 +54,209 @@ static void on_ble_ready(void)
     }
 }
 
-static void on_connected(void)
+/* Connections still waiting for their welcome message, one bit per connection ID */
+static ATOMIC_DEFINE(welcome_pending, BLE_MAX_CONNECTIONS);
+
+static void welcome_work_handler(struct k_work *work)
+{
+    static const char welcome[] = "\n=== nRF5340 Utils Device Connected ===\n"
+                                  "Application Core + Network Core BLE\n"
+                                  "Type 'help' for available commands\n\n";
+    
+    for (uint8_t id = 0; id < BLE_MAX_CONNECTIONS; id++) {
+        if (atomic_test_and_clear_bit(welcome_pending, id)) {
+            ble_send_data_to(id, (const uint8_t *)welcome, strlen(welcome));
+        }
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(welcome_work, welcome_work_handler);
+
+static void on_connected(uint8_t conn_id)
 {
-    LOG_INF("BLE device connected via network core");
+    LOG_INF("BLE device connected via network core (conn %u)", conn_id);
     gpio_pin_toggle_dt(&led);
     
-    /* Send welcome message */
-    k_sleep(K_MSEC(1000)); /* Give time for connection setup */
-    char welcome[] = "\n=== nRF5340 Utils Device Connected ===\n"
-                    "Application Core + Network Core BLE\n"
-                    "Type 'help' for available commands\n\n";
-    ble_send_data((uint8_t *)welcome, strlen(welcome));
+    /* Send welcome message once the connection has settled, without blocking IPC */
+    atomic_set_bit(welcome_pending, conn_id);
+    k_work_schedule(&welcome_work, K_MSEC(1000));
+    
+    /* New client, start the compact stream with a key frame */
+    atomic_set(&auto_status_resync, 1);
 }
 
-static void on_disconnected(uint8_t reason)
+static void on_disconnected(uint8_t conn_id, uint8_t reason)
 {
-    LOG_INF("BLE device disconnected (reason %u)", reason);
+    LOG_INF("BLE device disconnected (conn %u, reason %u)", conn_id, reason);
+    atomic_clear_bit(welcome_pending, conn_id);
+    cmd_parser_reset(conn_id);
+    bulk_reset(conn_id);
     gpio_pin_set_dt(&led, 1);
 }
 
-static void on_data_received(const uint8_t *data, uint16_t len)
+static void on_data_received(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    trace_event(TRACE_MOD_APP, TRACE_EV_APP_RX, conn_id, len);
+    
+    /* Incoming data ends a timed sleep early */
+    nrf_sleep_wake();
+    
+    /* Each connection has its own command session, replies go back to it only */
+    cmd_parser_process(conn_id, data, len);
+}
+
+static void on_bulk_received(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    nrf_sleep_wake();
+    bulk_process(conn_id, data, len);
+}
+
+/* Format the periodic status line, returns its length */
+static int format_auto_status(char *buf, size_t size)
+{
+    struct nrf_battery_status battery;
+    int temp = nrf_get_temperature_celsius();
+    uint32_t uptime = nrf_get_uptime_ms();
+    
+    int pos = 0;
+    pos += snprintf(buf + pos, size - pos,
+                   "[AUTO] Uptime: %u.%03us", uptime / 1000, uptime % 1000);
+    
+    if (nrf_get_battery_status(&battery) == 0) {
+        pos += snprintf(buf + pos, size - pos,
+                       " | Battery: %u%% (%umV)", battery.percentage, battery.voltage_mv);
+    }
+    
+    if (temp >= -100) {
+        pos += snprintf(buf + pos, size - pos,
+                       " | Temp: %d°C", temp);
+    }
+    
+    pos += snprintf(buf + pos, size - pos, "\n");
+    
+    return MIN(pos, (int)size - 1);
+}
+
+static void send_auto_status(void)
+{
+    static struct telemetry_delta_enc enc;
+    static uint32_t last_sent_s;
+    static char status_msg[128];
+    struct telemetry_record rec;
+    uint8_t frame[TELEMETRY_DELTA_MAX_LEN];
+    int ret;
+    
+    if (atomic_cas(&auto_status_resync, 1, 0)) {
+        telemetry_delta_reset(&enc);
+    }
+    
+    telemetry_read_current(&rec);
+    uint32_t now_s = sys_le32_to_cpu(rec.uptime_s);
+    
+    /* Skip readings that barely moved, but still send a heartbeat now and then */
+    if (app_config_get()->auto_status_changes && !telemetry_delta_changed(&enc, &rec) &&
+        now_s - last_sent_s < AUTO_STATUS_MAX_SILENCE_S) {
+        return;
+    }
+    
+    /* Encoding also records what was sent, for the change check */
+    size_t frame_len = telemetry_delta_encode(&enc, &rec, frame);
+    
+    if (app_config_get()->auto_status == AUTO_STATUS_COMPACT) {
+        ret = ble_send_data(frame, frame_len);
+    } else {
+        uint16_t tx_size = sizeof(status_msg);
+        uint8_t *tx_buf;
+        
+        /* Format directly into an IPC TX buffer, falling back to a local copy */
+        if (ble_tx_buf_get(BLE_CONN_ID_ALL, &tx_buf, &tx_size) == 0) {
+            int len = format_auto_status((char *)tx_buf, tx_size);
+            ret = ble_tx_buf_send(tx_buf, len);
+        } else {
+            int len = format_auto_status(status_msg, sizeof(status_msg));
+            ret = ble_send_data((uint8_t *)status_msg, len);
+        }
+    }
+    
+    if (ret == 0) {
+        last_sent_s = now_s;
+        LOG_DBG("Sent auto status update via IPC");
+    } else {
+        LOG_WRN("Failed to send auto status via IPC (err %d)", ret);
+    }
+}
+
+static void status_task_run(void)
+{
+    /* Send periodic status if connected and auto status enabled */
+    if (app_config_get()->auto_status != AUTO_STATUS_OFF &&
+        ble_get_connection_state() == BLE_CONNECTED) {
+        send_auto_status();
+    }
+}
+
+/* Status update period from app_config, also see the 'period' command */
+static SCHED_TASK_DEFINE(status, status_task_run, APP_CONFIG_DEFAULT_STATUS_PERIOD_MS);
+
+static int cmd_auto(struct cmd_ctx *ctx, const char *args)
 {
-    LOG_INF("Received %u bytes via BLE IPC", len);
-    LOG_HEXDUMP_DBG(data, len, "RX Data:");
+    if (args && strlen(args) > 0) {
+        int mode = -1;
+        
+        for (size_t i = 0; i < ARRAY_SIZE(auto_status_names); i++) {
+            if (strncmp(args, auto_status_names[i], strlen(auto_status_names[i])) == 0) {
+                mode = i;
+                break;
+            }
+        }
+        
+        if (mode < 0) {
+            cmd_printf(ctx, "Usage: auto <off|text|compact> [changes]\n");
+            return -EINVAL;
+        }
+        
+        app_config_set_uint("auto_status", mode);
+        app_config_set_uint("auto_changes", strstr(args, "changes") != NULL);
+    }
     
-    /* Process as commands - conn parameter not needed for nRF5340 */
-    cmd_parser_process(NULL, data, len);
+    const struct app_config *cfg = app_config_get();
+    
+    cmd_printf(ctx, "Auto status: %s%s\n", auto_status_names[cfg->auto_status],
+               cfg->auto_status_changes ? ", changes only" : "");
+    return 0;
 }
 
-/* BLE configuration */
-static const struct ble_init_config ble_config = {
-    .device_name = "nRF5340_Utils",
-    .adv_interval_ms = 100,
+CMD_DEFINE(auto, "Periodic status (off|text|compact) [changes]", cmd_auto);
+
+/* Apply configuration changes that do not need a reset */
+static void on_config_changed(const char *key)
+{
+    if (strcmp(key, "status_period") == 0) {
+        sched_task_set_period(&sched_task_status, app_config_get()->status_period_ms);
+    } else if (strncmp(key, "auto_", 5) == 0) {
+        atomic_set(&auto_status_resync, 1);
+    }
+}
+
+/* Keep the network core in step with application core sleep */
+static int sleep_prepare(enum nrf_sleep_mode mode, uint32_t duration_ms)
+{
+    return ble_request_netcore_sleep(mode == NRF_SLEEP_OFF ? BLE_IPC_SLEEP_OFF : BLE_IPC_SLEEP_IDLE,
+                                     duration_ms);
+}
+
+static void sleep_resume(void)
+{
+    ble_request_netcore_sleep(BLE_IPC_SLEEP_WAKE, 0);
+}
+
+static const struct nrf_sleep_hooks sleep_hooks = {
+    .prepare = sleep_prepare,
+    .resume = sleep_resume,
+};
+
+/* BLE configuration, name and advertising intervals are filled in from app_config */
+static struct ble_init_config ble_config = {
     .connectable = true,
     .enable_uart_service = true,
 };
@@ -72,16 +266,90 @@ static const struct ble_event_callbacks ble_callbacks = {
     .connected = on_connected,
     .disconnected = on_disconnected,
     .data_received = on_data_received,
+    .bulk_received = on_bulk_received,
 };
 
+/*
+ * Boot stages that run before main(), after the IPC endpoint was registered
+ * at BLE_IPC_INIT_PRIORITY, so the network core binds while they run
+ */
+#define INIT_PRIORITY_CONFIG 20
+#define INIT_PRIORITY_SERVICES 30
+
+static int early_init_err;      /* First stage failure, reported by main() */
+
+/* Load persistent configuration, defaults are used if that fails */
+static int config_stage_init(void)
+{
+    int err = app_config_init();
+    if (err) {
+        LOG_WRN("Configuration not loaded (err %d), using defaults", err);
+    }
+
+    const struct app_config *cfg = app_config_get();
+
+    ble_config.device_name = cfg->device_name;
+    ble_config.adv_interval_ms = cfg->adv_interval_ms;
+    ble_config.adv_fast_interval_ms = cfg->adv_fast_interval_ms;
+    ble_config.adv_fast_duration_s = cfg->adv_fast_duration_s;
+    app_config_set_changed_cb(on_config_changed);
+
+    boot_mark(BOOT_CONFIG_LOADED);
+    return 0;
+}
+
+SYS_INIT(config_stage_init, APPLICATION, INIT_PRIORITY_CONFIG);
+
+/* Scheduler and command parser, ready before the first peer can connect */
+static int services_stage_init(void)
+{
+    /* Before anything it supervises can run; without it nothing is time-boxed */
+    int err = supervisor_init();
+    if (err) {
+        LOG_WRN("Supervisor unavailable (err %d)", err);
+    }
+
+    err = sched_init();
+    if (err) {
+        LOG_ERR("Scheduler initialization failed (err %d)", err);
+        early_init_err = err;
+        return err;
+    }
+
+    sched_task_register(&sched_task_status);
+    sched_task_set_period(&sched_task_status, app_config_get()->status_period_ms);
+
+    err = cmd_parser_init();
+    if (err) {
+        LOG_ERR("Command parser initialization failed (err %d)", err);
+        early_init_err = err;
+        return err;
+    }
+
+    /* Transfers are refused if the partition is missing, everything else still works */
+    err = bulk_init();
+    if (err) {
+        LOG_WRN("Bulk transfer unavailable (err %d)", err);
+    }
+
+    boot_mark(BOOT_SERVICES_READY);
+    return 0;
+}
+
+SYS_INIT(services_stage_init, APPLICATION, INIT_PRIORITY_SERVICES);
+
 int main(void)
 {
     int err;
-    uint32_t counter = 0;
-    char status_msg[256];
+    struct k_poll_event state_event;
 
+    boot_mark(BOOT_MAIN);
     LOG_INF("Starting nRF5340 Utils Application Core");
 
+    if (early_init_err) {
+        return early_init_err;
+    }
+
     /* Initialize LED */
     if (!gpio_is_ready_dt(&led)) {
         LOG_ERR("LED device not ready");
@@ -94,65 +362,52 @@ int main(void)
         return err;
     }
 
-    /* Initialize utilities */
-    err = nrf_utils_init();
+    /* Initialize BLE first, advertising starts as soon as the network core binds */
+    err = ble_init(&ble_config, &ble_callbacks);
     if (err) {
-        LOG_ERR("nRF utilities initialization failed (err %d)", err);
+        LOG_ERR("BLE initialization failed (err %d)", err);
         return err;
     }
 
-    /* Initialize command parser */
-    err = cmd_parser_init();
+    boot_mark(BOOT_BLE_INIT);
+
+    /* Sensors and telemetry come up while the network core boots */
+    err = nrf_utils_init();
     if (err) {
-        LOG_ERR("Command parser initialization failed (err %d)", err);
+        LOG_ERR("nRF utilities initialization failed (err %d)", err);
         return err;
     }
 
-    /* Initialize BLE */
-    err = ble_init(&ble_config, &ble_callbacks);
+    nrf_sleep_set_hooks(&sleep_hooks);
+    boot_mark(BOOT_SENSORS_READY);
+
+    /* Start recording telemetry history */
+    err = telemetry_init();
     if (err) {
-        LOG_ERR("BLE initialization failed (err %d)", err);
+        LOG_ERR("Telemetry initialization failed (err %d)", err);
         return err;
     }
 
+    boot_mark(BOOT_MAIN_LOOP);
     LOG_INF("All systems initialized, entering main loop");
 
-    /* Main application loop */
+    k_poll_event_init(&state_event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+                      ble_get_state_signal());
+
+    /* Main application loop, sleeps until the BLE link changes */
     while (1) {
-        k_sleep(K_SECONDS(10)); /* Status update every 10 seconds */
+        k_poll(&state_event, 1, K_FOREVER);
         
-        /* Send periodic status if connected and auto status enabled */
-        if (auto_status_enabled && ble_get_connection_state() == BLE_CONNECTED) {
-            struct nrf_battery_status battery;
-            int temp = nrf_get_temperature_celsius();
-            uint32_t uptime = nrf_get_uptime_ms();
-            
-            int pos = 0;
-            pos += snprintf(status_msg + pos, sizeof(status_msg) - pos, 
-                           "[AUTO] Uptime: %u.%03us", uptime / 1000, uptime % 1000);
-            
-            if (nrf_get_battery_status(&battery) == 0) {
-                pos += snprintf(status_msg + pos, sizeof(status_msg) - pos,
-                               " | Battery: %u%% (%umV)", battery.percentage, battery.voltage_mv);
-            }
-            
-            if (temp >= -100) {
-                pos += snprintf(status_msg + pos, sizeof(status_msg) - pos,
-                               " | Temp: %d°C", temp);
-            }
-            
-            pos += snprintf(status_msg + pos, sizeof(status_msg) - pos, "\n");
-            
-            int ret = ble_send_data((uint8_t *)status_msg, strlen(status_msg));
-            if (ret == 0) {
-                LOG_DBG("Sent auto status update via IPC");
-            } else {
-                LOG_WRN("Failed to send auto status via IPC (err %d)", ret);
-            }
-        }
+        /* Reset first so a change arriving meanwhile wakes us again */
+        k_poll_signal_reset(ble_get_state_signal());
+        state_event.state = K_POLL_STATE_NOT_READY;
         
-        counter++;
-        LOG_DBG("Main loop heartbeat #%u", counter);
+        /* Periodic status only runs while someone is listening */
+        if (ble_get_connection_state() == BLE_CONNECTED) {
+            sched_task_start(&sched_task_status);
+        } else {
+            sched_task_stop(&sched_task_status);
+        }
     }
 
     return 0;
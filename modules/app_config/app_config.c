@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "app_config.h"
+#include "../cmd_parser/cmd_parser.h"
+#include "../scheduler/scheduler.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+
+LOG_MODULE_REGISTER(app_config, LOG_LEVEL_INF);
+
+/* Settings subtree, keys are stored as "cfg/<name>" */
+#define SETTINGS_TREE "cfg"
+
+enum key_type {
+    KEY_UINT,
+    KEY_STR,
+};
+
+static const struct config_key {
+    const char *name;
+    uint8_t type;
+    bool needs_reset;           /* Only read at boot */
+    uint16_t offset;
+    uint16_t size;
+    uint32_t min;
+    uint32_t max;
+    bool zero_off;              /* 0 is also valid and turns it off */
+} keys[] = {
+    { "name", KEY_STR, true, offsetof(struct app_config, device_name),
+      sizeof(((struct app_config *)0)->device_name), 1, APP_CONFIG_NAME_MAX },
+    { "adv_interval", KEY_UINT, true, offsetof(struct app_config, adv_interval_ms),
+      sizeof(uint16_t), 20, 10240 },
+    { "adv_fast_interval", KEY_UINT, true, offsetof(struct app_config, adv_fast_interval_ms),
+      sizeof(uint16_t), 20, 10240 },
+    { "adv_fast_duration", KEY_UINT, true, offsetof(struct app_config, adv_fast_duration_s),
+      sizeof(uint16_t), 1, 3600 },
+    { "auto_status", KEY_UINT, false, offsetof(struct app_config, auto_status),
+      sizeof(uint8_t), 0, 2 },
+    { "auto_changes", KEY_UINT, false, offsetof(struct app_config, auto_status_changes),
+      sizeof(uint8_t), 0, 1 },
+    { "status_period", KEY_UINT, false, offsetof(struct app_config, status_period_ms),
+      sizeof(uint32_t), SCHED_MIN_PERIOD_MS, 86400000, true },
+};
+
+#define KEY_COUNT ARRAY_SIZE(keys)
+
+static const struct app_config defaults = {
+    .device_name = APP_CONFIG_DEFAULT_NAME,
+    .adv_interval_ms = APP_CONFIG_DEFAULT_ADV_INTERVAL_MS,
+    .adv_fast_interval_ms = BLE_ADV_FAST_INTERVAL_MS,
+    .adv_fast_duration_s = BLE_ADV_FAST_DURATION_S,
+    .auto_status = APP_CONFIG_DEFAULT_AUTO_STATUS,
+    .auto_status_changes = 0,
+    .status_period_ms = APP_CONFIG_DEFAULT_STATUS_PERIOD_MS,
+};
+
+static struct app_config config = defaults;
+static struct app_config stored = defaults;     /* What the backend holds */
+static K_MUTEX_DEFINE(config_lock);
+static ATOMIC_DEFINE(dirty, KEY_COUNT);
+static app_config_changed_cb_t changed_cb;
+
+static uint32_t save_count;
+static uint32_t coalesced_count;
+
+static void save_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(save_work, save_work_handler);
+
+static const struct config_key *find_key(const char *name)
+{
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (strcmp(keys[i].name, name) == 0) {
+            return &keys[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool uint_valid(const struct config_key *key, uint32_t value)
+{
+    return (value >= key->min && value <= key->max) || (value == 0 && key->zero_off);
+}
+
+static void *field(const struct app_config *cfg, const struct config_key *key)
+{
+    return (uint8_t *)cfg + key->offset;
+}
+
+static uint32_t get_uint(const struct app_config *cfg, const struct config_key *key)
+{
+    const uint8_t *p = (const uint8_t *)cfg + key->offset;
+
+    switch (key->size) {
+    case sizeof(uint8_t):
+        return *p;
+    case sizeof(uint16_t):
+        return *(const uint16_t *)p;
+    default:
+        return *(const uint32_t *)p;
+    }
+}
+
+static void put_uint(struct app_config *cfg, const struct config_key *key, uint32_t value)
+{
+    void *p = field(cfg, key);
+
+    switch (key->size) {
+    case sizeof(uint8_t):
+        *(uint8_t *)p = value;
+        break;
+    case sizeof(uint16_t):
+        *(uint16_t *)p = value;
+        break;
+    default:
+        *(uint32_t *)p = value;
+        break;
+    }
+}
+
+/* Mark a key for the next save, the first change starts the save timer */
+static void mark_dirty(const struct config_key *key)
+{
+    if (atomic_test_and_set_bit(dirty, key - keys)) {
+        coalesced_count++;
+    }
+
+    k_work_schedule(&save_work, K_MSEC(APP_CONFIG_SAVE_DELAY_MS));
+}
+
+static void notify(const struct config_key *key)
+{
+    if (changed_cb) {
+        changed_cb(key->name);
+    }
+}
+
+int app_config_set_uint(const char *name, uint32_t value)
+{
+    const struct config_key *key = find_key(name);
+
+    if (!key) {
+        return -ENOENT;
+    }
+
+    if (key->type != KEY_UINT || !uint_valid(key, value)) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&config_lock, K_FOREVER);
+    put_uint(&config, key, value);
+    mark_dirty(key);
+    k_mutex_unlock(&config_lock);
+
+    notify(key);
+    return 0;
+}
+
+int app_config_set_str(const char *name, const char *value)
+{
+    const struct config_key *key = find_key(name);
+    size_t len = value ? strlen(value) : 0;
+
+    if (!key) {
+        return -ENOENT;
+    }
+
+    if (key->type != KEY_STR || len < key->min || len > key->max) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&config_lock, K_FOREVER);
+    memset(field(&config, key), 0, key->size);
+    memcpy(field(&config, key), value, len);
+    mark_dirty(key);
+    k_mutex_unlock(&config_lock);
+
+    notify(key);
+    return 0;
+}
+
+const struct app_config *app_config_get(void)
+{
+    return &config;
+}
+
+void app_config_set_changed_cb(app_config_changed_cb_t cb)
+{
+    changed_cb = cb;
+}
+
+void app_config_reset(void)
+{
+    k_mutex_lock(&config_lock, K_FOREVER);
+
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (memcmp(field(&config, &keys[i]), field(&defaults, &keys[i]), keys[i].size) != 0) {
+            memcpy(field(&config, &keys[i]), field(&defaults, &keys[i]), keys[i].size);
+            mark_dirty(&keys[i]);
+        }
+    }
+
+    k_mutex_unlock(&config_lock);
+
+    for (int i = 0; i < KEY_COUNT; i++) {
+        notify(&keys[i]);
+    }
+}
+
+int app_config_flush(void)
+{
+    int ret = 0;
+
+    k_work_cancel_delayable(&save_work);
+    k_mutex_lock(&config_lock, K_FOREVER);
+
+    for (int i = 0; i < KEY_COUNT; i++) {
+        const struct config_key *key = &keys[i];
+
+        if (!atomic_test_and_clear_bit(dirty, i)) {
+            continue;
+        }
+
+        /* Changed and changed back, or reset to what is stored already */
+        if (memcmp(field(&config, key), field(&stored, key), key->size) == 0) {
+            continue;
+        }
+
+#if defined(CONFIG_SETTINGS)
+        char path[sizeof(SETTINGS_TREE) + 24];
+
+        snprintf(path, sizeof(path), SETTINGS_TREE "/%s", key->name);
+
+        int err = settings_save_one(path, field(&config, key),
+                                    key->type == KEY_STR ? strlen(field(&config, key)) : key->size);
+        if (err) {
+            LOG_ERR("Failed to save %s (err %d)", key->name, err);
+            atomic_set_bit(dirty, i);
+            ret = err;
+            continue;
+        }
+#endif
+
+        memcpy(field(&stored, key), field(&config, key), key->size);
+        save_count++;
+    }
+
+    k_mutex_unlock(&config_lock);
+
+    /* Keep retrying failed keys, but not in a tight loop */
+    if (ret) {
+        k_work_schedule(&save_work, K_MSEC(APP_CONFIG_SAVE_DELAY_MS));
+    }
+
+    return ret;
+}
+
+static void save_work_handler(struct k_work *work)
+{
+    app_config_flush();
+}
+
+#if defined(CONFIG_SETTINGS)
+static int settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    const struct config_key *key = find_key(name);
+    uint8_t buf[sizeof(struct app_config)];
+
+    if (!key) {
+        LOG_WRN("Ignoring unknown setting %s", name);
+        return 0;
+    }
+
+    if (len > key->size || (key->type == KEY_UINT && len != key->size)) {
+        LOG_WRN("Ignoring %s with bad length %u", name, (unsigned int)len);
+        return 0;
+    }
+
+    ssize_t n = read_cb(cb_arg, buf, len);
+    if (n < 0) {
+        return n;
+    }
+
+    if (key->type == KEY_STR) {
+        if ((size_t)n < key->min || (size_t)n > key->max) {
+            return 0;
+        }
+        memset(field(&config, key), 0, key->size);
+        memcpy(field(&config, key), buf, n);
+    } else {
+        struct app_config probe;
+
+        memcpy(field(&probe, key), buf, key->size);
+
+        uint32_t value = get_uint(&probe, key);
+        if (!uint_valid(key, value)) {
+            LOG_WRN("Ignoring out of range %s = %u", name, value);
+            return 0;
+        }
+        put_uint(&config, key, value);
+    }
+
+    memcpy(field(&stored, key), field(&config, key), key->size);
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app_config, SETTINGS_TREE, NULL, settings_set, NULL, NULL);
+#endif
+
+int app_config_init(void)
+{
+#if defined(CONFIG_SETTINGS)
+    int err = settings_subsys_init();
+    if (err) {
+        LOG_ERR("Settings init failed (err %d), using defaults", err);
+        return err;
+    }
+
+    err = settings_load_subtree(SETTINGS_TREE);
+    if (err) {
+        LOG_ERR("Failed to load configuration (err %d)", err);
+        return err;
+    }
+
+    LOG_INF("Configuration loaded");
+#else
+    LOG_WRN("CONFIG_SETTINGS disabled, configuration is not persisted");
+#endif
+    return 0;
+}
+
+static void print_key(struct cmd_ctx *ctx, const struct config_key *key)
+{
+    if (key->type == KEY_STR) {
+        cmd_printf(ctx, "%s = %s", key->name, (const char *)field(&config, key));
+    } else {
+        cmd_printf(ctx, "%s = %u", key->name, get_uint(&config, key));
+    }
+
+    cmd_printf(ctx, "%s%s\n", atomic_test_bit(dirty, key - keys) ? " (unsaved)" : "",
+               key->needs_reset ? " (after reset)" : "");
+}
+
+static int cmd_config(struct cmd_ctx *ctx, const char *args)
+{
+    if (!args || strlen(args) == 0) {
+        for (int i = 0; i < KEY_COUNT; i++) {
+            print_key(ctx, &keys[i]);
+        }
+
+        cmd_printf(ctx, "%u writes, %u coalesced\n"
+                   "Usage: config <get <key>|set <key> <value>|save|reset>\n",
+                   save_count, coalesced_count);
+        return 0;
+    }
+
+    if (strcmp(args, "save") == 0) {
+        int ret = app_config_flush();
+
+        if (ret) {
+            cmd_printf(ctx, "Save failed (err %d)\n", ret);
+        } else {
+            cmd_printf(ctx, "Saved\n");
+        }
+        return ret;
+    }
+
+    if (strcmp(args, "reset") == 0) {
+        app_config_reset();
+        cmd_printf(ctx, "Defaults restored\n");
+        return 0;
+    }
+
+    bool set = strncmp(args, "set ", 4) == 0;
+
+    if (!set && strncmp(args, "get ", 4) != 0) {
+        cmd_printf(ctx, "Usage: config <get <key>|set <key> <value>|save|reset>\n");
+        return -EINVAL;
+    }
+
+    char name[24];
+    const char *value = strchr(args + 4, ' ');
+    size_t name_len = value ? (size_t)(value - args - 4) : strlen(args + 4);
+
+    if (name_len >= sizeof(name) || (set && !value)) {
+        cmd_printf(ctx, "Usage: config set <key> <value>\n");
+        return -EINVAL;
+    }
+
+    memcpy(name, args + 4, name_len);
+    name[name_len] = '\0';
+
+    const struct config_key *key = find_key(name);
+    if (!key) {
+        cmd_printf(ctx, "Unknown key: %s\n", name);
+        return -ENOENT;
+    }
+
+    if (set) {
+        int ret;
+
+        value++;
+        if (key->type == KEY_STR) {
+            ret = app_config_set_str(name, value);
+        } else {
+            /* unsigned long is 64 bits on native_sim, check the range before narrowing */
+            char *end;
+            unsigned long long n = strtoull(value, &end, 0);
+
+            ret = (end == value || *end || n > UINT32_MAX) ? -EINVAL :
+                  app_config_set_uint(name, (uint32_t)n);
+        }
+
+        if (ret) {
+            cmd_printf(ctx, "Invalid value for %s (%s%u-%u%s)\n", name,
+                       key->zero_off ? "0 or " : "", key->min, key->max,
+                       key->type == KEY_STR ? " characters" : "");
+            return ret;
+        }
+    }
+
+    print_key(ctx, key);
+    return 0;
+}
+
+CMD_DEFINE(config, "Device configuration (get|set|save|reset)", cmd_config);
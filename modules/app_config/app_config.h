@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_CONFIG_H_
+#define APP_CONFIG_H_
+
+/**
+ * @file
+ * @brief Persistent device configuration
+ *
+ * Settings are loaded once at boot into a RAM struct, so reading them is a
+ * plain memory access. Changes update RAM right away and are written to
+ * the settings backend (NVS in storage_partition) in batches: all changes
+ * within APP_CONFIG_SAVE_DELAY_MS share one save, and values equal to
+ * what is already stored are not written again. The 'config' command
+ * reads and changes them without a reflash.
+ */
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include "../ble_common/ble_init.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Time from the first unsaved change to the flash write */
+#ifndef APP_CONFIG_SAVE_DELAY_MS
+#define APP_CONFIG_SAVE_DELAY_MS 5000
+#endif
+
+/** @brief Default advertised name */
+#ifndef APP_CONFIG_DEFAULT_NAME
+#define APP_CONFIG_DEFAULT_NAME "nRF5340_Utils"
+#endif
+
+/** @brief Default slow advertising interval */
+#ifndef APP_CONFIG_DEFAULT_ADV_INTERVAL_MS
+#define APP_CONFIG_DEFAULT_ADV_INTERVAL_MS 1000
+#endif
+
+/** @brief Default auto status mode, 0 off, 1 text, 2 compact */
+#ifndef APP_CONFIG_DEFAULT_AUTO_STATUS
+#define APP_CONFIG_DEFAULT_AUTO_STATUS 1
+#endif
+
+/** @brief Default auto status period */
+#ifndef APP_CONFIG_DEFAULT_STATUS_PERIOD_MS
+#define APP_CONFIG_DEFAULT_STATUS_PERIOD_MS 10000
+#endif
+
+/** @brief Longest device name, as limited by the advertising data */
+#define APP_CONFIG_NAME_MAX 29
+
+/** @brief Device configuration, see the key names in app_config.c */
+struct app_config {
+    char device_name[APP_CONFIG_NAME_MAX + 1];  /* "name" */
+    uint16_t adv_interval_ms;                   /* "adv_interval" */
+    uint16_t adv_fast_interval_ms;              /* "adv_fast_interval" */
+    uint16_t adv_fast_duration_s;               /* "adv_fast_duration" */
+    uint8_t auto_status;                        /* "auto_status" */
+    uint8_t auto_status_changes;                /* "auto_changes" */
+    uint32_t status_period_ms;                  /* "status_period" */
+};
+
+/**
+ * @brief Called after a value changed, from the thread that changed it
+ *
+ * @param key Name of the changed key
+ */
+typedef void (*app_config_changed_cb_t)(const char *key);
+
+/**
+ * @brief Load the configuration from settings
+ *
+ * Keys missing from storage keep their defaults. Without CONFIG_SETTINGS
+ * the configuration lives in RAM only.
+ *
+ * @return 0 on success, negative error code if loading failed (the
+ *         defaults are used then)
+ */
+int app_config_init(void);
+
+/**
+ * @brief Get the current configuration
+ *
+ * Cheap enough for hot paths. Fields may change at any time from the
+ * 'config' command, so copy multi-byte strings before relying on them
+ * staying the same.
+ *
+ * @return Configuration in RAM
+ */
+const struct app_config *app_config_get(void);
+
+/**
+ * @brief Change an integer key
+ *
+ * @param key Key name
+ * @param value New value
+ *
+ * @return 0 on success, -ENOENT for unknown keys, -EINVAL if the key is
+ *         not an integer or @p value is out of range
+ */
+int app_config_set_uint(const char *key, uint32_t value);
+
+/**
+ * @brief Change a string key
+ *
+ * @param key Key name
+ * @param value New value
+ *
+ * @return 0 on success, -ENOENT for unknown keys, -EINVAL if the key is
+ *         not a string or @p value is empty or too long
+ */
+int app_config_set_str(const char *key, const char *value);
+
+/**
+ * @brief Set the change callback
+ *
+ * @param cb Called after every change, NULL to remove
+ */
+void app_config_set_changed_cb(app_config_changed_cb_t cb);
+
+/**
+ * @brief Write pending changes now instead of after the save delay
+ *
+ * Blocks on flash access, so must not be called from ISRs.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int app_config_flush(void);
+
+/**
+ * @brief Return every key to its default
+ *
+ * Stored values are replaced with the next save.
+ */
+void app_config_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_CONFIG_H_ */
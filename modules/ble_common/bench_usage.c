@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file bench_usage.c
+ * @brief Throughput and latency benchmark for ble_init and cmd_parser
+ *
+ * Replaces main.c in a build with BLE_IPC_LOOPBACK=1, e.g. for native_sim,
+ * so no network core is needed. A simulated peer connects, a script of
+ * tagged commands is fed through the IPC receive path into
+ * cmd_parser_process() one at a time, then bulk data is pushed through
+ * ble_send_data(). Reports commands/s, TX bytes/s, p50/p99 command
+ * latency and the heap high-water mark, so parser and TX path
+ * regressions show up before they reach hardware. It fails if the heap
+ * peak grew while the commands ran, since the command path must not
+ * allocate. Finally a second peer
+ * with a used-up protection session checks that its dropped frames do
+ * not stall TX for the first one. main() returns an error if a check
+ * fails.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ble_init.h"
+#include "ble_ipc_proto.h"
+#include "ble_prot.h"
+#include "../cmd_parser/cmd_parser.h"
+#include "../nrf_utils/nrf_utils.h"
+#include "../perf/perf.h"
+
+LOG_MODULE_REGISTER(bench, LOG_LEVEL_INF);
+
+#if !BLE_IPC_LOOPBACK
+#error "bench_usage.c needs BLE_IPC_LOOPBACK=1"
+#endif
+
+/** @brief Passes over the command script */
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 50
+#endif
+
+/** @brief Bytes pushed through ble_send_data() */
+#ifndef BENCH_TX_BYTES
+#define BENCH_TX_BYTES (64 * 1024)
+#endif
+
+/** @brief Give up on a reply or transfer after this long */
+#define BENCH_TIMEOUT_MS 2000
+
+/* Commands that run without hardware attached */
+static const char *const script[] = {
+    "echo benchmark",
+    "uptime",
+    "status",
+    "info",
+    "help",
+    "profile",
+    "perf",
+};
+
+#define BENCH_SAMPLES (BENCH_ROUNDS * ARRAY_SIZE(script))
+
+static uint32_t latency_us[BENCH_SAMPLES];
+static uint8_t tx_pattern[CMD_RESPONSE_MAX_LEN];
+
+static atomic_t sink_bytes;
+static atomic_t expect_tag;
+static K_SEM_DEFINE(reply_sem, 0, 1);
+
+/* Tail of the output line being received, enough to spot "@<tag> <ret>" */
+static char sink_line[32];
+static size_t sink_line_len;
+
+static void bench_sink(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    atomic_add(&sink_bytes, len);
+
+    for (uint16_t i = 0; i < len; i++) {
+        if (data[i] != '\n') {
+            if (sink_line_len < sizeof(sink_line) - 1) {
+                sink_line[sink_line_len++] = data[i];
+            }
+            continue;
+        }
+
+        sink_line[sink_line_len] = '\0';
+        sink_line_len = 0;
+
+        if (sink_line[0] == '@' &&
+            strtoul(sink_line + 1, NULL, 10) == (unsigned long)atomic_get(&expect_tag)) {
+            k_sem_give(&reply_sem);
+        }
+    }
+}
+
+static void on_connected(uint8_t conn_id)
+{
+    cmd_parser_reset(conn_id);
+}
+
+static void on_data_received(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    cmd_parser_process(conn_id, data, len);
+}
+
+static const struct ble_event_callbacks bench_callbacks = {
+    .connected = on_connected,
+    .data_received = on_data_received,
+};
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t elapsed_ms(uint64_t start_cycles)
+{
+    return (uint32_t)(k_cyc_to_ns_floor64(k_cycle_get_64() - start_cycles) / 1000000U);
+}
+
+/* Bring up a simulated peer on a 2M PHY link with DLE, like a phone would */
+static void connect_peer(uint8_t conn_id)
+{
+    uint8_t state = BLE_CONNECTED;
+    struct ipc_link_info link = {
+        .mtu = sys_cpu_to_le16(247),
+        .tx_octets = sys_cpu_to_le16(251),
+        .phy = BLE_IPC_PHY_2M,
+    };
+
+    ble_loopback_inject(conn_id, IPC_MSG_CONNECTION_STATE, &state, sizeof(state));
+    ble_loopback_inject(conn_id, IPC_MSG_LINK_INFO, (const uint8_t *)&link, sizeof(link));
+}
+
+static void disconnect_peer(uint8_t conn_id)
+{
+    uint8_t state = BLE_DISCONNECTED;
+
+    ble_loopback_inject(conn_id, IPC_MSG_CONNECTION_STATE, &state, sizeof(state));
+}
+
+/*
+ * A peer whose session counter is used up has every frame dropped. Those
+ * frames never reach the network core, so they must not take TX credits,
+ * or a few of them stall TX for everyone else.
+ */
+static int check_exhausted_session(void)
+{
+    struct ble_prot_session session;
+    uint32_t dropped = perf_get_counter(PERF_PROT_DROPPED);
+    int frames = 2 * BLE_IPC_TX_INITIAL_CREDITS;
+    int err;
+
+    if (BLE_MAX_CONNECTIONS < 2) {
+        return 0;
+    }
+
+    connect_peer(1);
+
+    err = ble_prot_session_init(&session, BLE_PROT_CRC);
+    if (err == 0) {
+        session.counter = UINT32_MAX;
+        err = ble_link_protect(1, &session);
+    }
+    if (err) {
+        LOG_ERR("Failed to protect connection 1 (err %d)", err);
+        return err;
+    }
+
+    for (int i = 0; i < frames; i++) {
+        ble_send_data_to(1, tx_pattern, 32);
+    }
+
+    uint64_t start = k_cycle_get_64();
+
+    while (perf_get_counter(PERF_PROT_DROPPED) - dropped < frames) {
+        if (elapsed_ms(start) > BENCH_TIMEOUT_MS) {
+            LOG_ERR("Frames of the exhausted session were not dropped");
+            return -ETIMEDOUT;
+        }
+        k_sleep(K_MSEC(1));
+    }
+
+    atomic_clear(&sink_bytes);
+    ble_send_data_to(0, tx_pattern, 32);
+    start = k_cycle_get_64();
+
+    while (atomic_get(&sink_bytes) < 32) {
+        if (elapsed_ms(start) > BENCH_TIMEOUT_MS) {
+            LOG_ERR("Exhausted session on connection 1 starved connection 0");
+            return -ETIMEDOUT;
+        }
+        k_sleep(K_MSEC(1));
+    }
+
+    disconnect_peer(1);
+    LOG_INF("Exhausted session: %d frames dropped, other connections unaffected", frames);
+    return 0;
+}
+
+static int bench_commands(void)
+{
+    char line[CMD_MAX_LEN];
+    uint32_t tag = 0;
+    uint64_t start = k_cycle_get_64();
+
+    atomic_clear(&sink_bytes);
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int i = 0; i < ARRAY_SIZE(script); i++) {
+            int len = snprintf(line, sizeof(line), "@%u %s\n", tag, script[i]);
+
+            k_sem_reset(&reply_sem);
+            atomic_set(&expect_tag, tag);
+
+            uint32_t t0 = k_cycle_get_32();
+
+            ble_loopback_inject(0, IPC_MSG_DATA_RECEIVED, (const uint8_t *)line, len);
+
+            if (k_sem_take(&reply_sem, K_MSEC(BENCH_TIMEOUT_MS)) != 0) {
+                LOG_ERR("No reply to '%s'", script[i]);
+                return -ETIMEDOUT;
+            }
+
+            latency_us[tag++] = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+        }
+    }
+
+    uint32_t ms = MAX(elapsed_ms(start), 1);
+
+    qsort(latency_us, BENCH_SAMPLES, sizeof(latency_us[0]), compare_u32);
+
+    LOG_INF("Commands: %u in %u ms, %u cmd/s, %u output bytes", (uint32_t)BENCH_SAMPLES, ms,
+            (uint32_t)(BENCH_SAMPLES * 1000U / ms), (uint32_t)atomic_get(&sink_bytes));
+    LOG_INF("Latency: p50 %u us, p99 %u us, max %u us", latency_us[BENCH_SAMPLES / 2],
+            latency_us[MIN(BENCH_SAMPLES * 99 / 100, BENCH_SAMPLES - 1)],
+            latency_us[BENCH_SAMPLES - 1]);
+    return 0;
+}
+
+static int bench_tx(void)
+{
+    uint32_t sent = 0;
+    uint64_t start;
+
+    for (int i = 0; i < sizeof(tx_pattern); i++) {
+        tx_pattern[i] = 'a' + i % 26;
+    }
+
+    atomic_clear(&sink_bytes);
+    start = k_cycle_get_64();
+
+    while (sent < BENCH_TX_BYTES) {
+        uint16_t len = MIN(sizeof(tx_pattern), BENCH_TX_BYTES - sent);
+        int err = ble_send_data(tx_pattern, len);
+
+        if (err) {
+            LOG_ERR("ble_send_data failed (err %d)", err);
+            return err;
+        }
+
+        sent += len;
+    }
+
+    /* The last ring full is still draining */
+    uint64_t drain_start = k_cycle_get_64();
+
+    while (atomic_get(&sink_bytes) < BENCH_TX_BYTES) {
+        if (elapsed_ms(drain_start) > BENCH_TIMEOUT_MS) {
+            LOG_ERR("TX stalled at %u bytes", (uint32_t)atomic_get(&sink_bytes));
+            return -ETIMEDOUT;
+        }
+        k_sleep(K_MSEC(1));
+    }
+
+    uint32_t ms = MAX(elapsed_ms(start), 1);
+
+    LOG_INF("TX: %u bytes in %u ms, %u bytes/s", (uint32_t)BENCH_TX_BYTES, ms,
+            (uint32_t)((uint64_t)BENCH_TX_BYTES * 1000U / ms));
+    return 0;
+}
+
+int main(void)
+{
+    struct ble_init_config config = {
+        .device_name = "nRF_Bench",
+        .adv_interval_ms = 1000,
+        .connectable = true,
+    };
+    int err;
+
+    LOG_INF("Starting loopback benchmark");
+
+    err = nrf_utils_init();
+    if (err) {
+        LOG_WRN("nRF utilities unavailable (err %d)", err);
+    }
+
+    err = cmd_parser_init();
+    if (err) {
+        LOG_ERR("Command parser initialization failed (err %d)", err);
+        return err;
+    }
+
+    ble_loopback_set_sink(bench_sink);
+
+    err = ble_init(&config, &bench_callbacks);
+    if (err) {
+        LOG_ERR("BLE initialization failed (err %d)", err);
+        return err;
+    }
+
+    connect_peer(0);
+    perf_reset();
+
+    /* The heap tracks its own peak, so allocations between samples are not missed */
+    nrf_reset_heap_max_used();
+
+    uint32_t heap_start = nrf_get_free_heap_bytes();
+    uint32_t heap_used = nrf_get_heap_max_used_bytes();   /* In use right now */
+
+    err = bench_commands();
+    if (err) {
+        return err;
+    }
+
+    /* The command path must not allocate: parsing, dispatch and output */
+    uint32_t cmd_peak = nrf_get_heap_max_used_bytes();
+
+    if (cmd_peak > heap_used) {
+        LOG_ERR("Command path allocated up to %u heap bytes", cmd_peak - heap_used);
+        return -EFAULT;
+    }
+
+    err = bench_tx();
+    if (err) {
+        return err;
+    }
+
+    err = check_exhausted_session();
+    if (err) {
+        return err;
+    }
+
+    LOG_INF("Heap: %u bytes free at start, high-water %u bytes used", heap_start,
+            nrf_get_heap_max_used_bytes() - heap_used);
+
+    for (int i = 0; i < PERF_TIMER_COUNT; i++) {
+        struct perf_timer_stats stats;
+
+        perf_get_timer(i, &stats);
+        LOG_INF("%s: %u calls, avg %u us, max %u us", perf_timer_name(i), stats.count,
+                stats.count ? stats.total_us / stats.count : 0, stats.max_us);
+    }
+
+    LOG_INF("Benchmark complete");
+    return 0;
+}
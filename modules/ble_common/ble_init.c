@@ -5,12 +5,23 @@
  */
 
 #include "ble_init.h"
+#include "ble_ipc_proto.h"
+#include "ble_prot.h"
+#include "../perf/perf.h"
+#include "../trace/trace.h"
+#include "../boot/boot.h"
+#include "../supervisor/supervisor.h"
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/ipc/ipc_service.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/barrier.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(ble_init, LOG_LEVEL_DBG);
 
@@ -19,37 +30,241 @@ LOG_MODULE_REGISTER(ble_init, LOG_LEVEL_DBG);
 
 /* IPC communication setup */
 #define IPC_SERVICE_NAME "nrf5340_ble_ipc"
+#if !BLE_IPC_LOOPBACK
 static const struct device *ipc_instance;
+#endif
 static struct ipc_ept ble_endpoint;
 
 /* Module state */
 static bool ble_initialized = false;
-static enum ble_connection_state current_state = BLE_DISCONNECTED;
+static atomic_t current_state = ATOMIC_INIT(BLE_DISCONNECTED);
+static struct k_poll_signal state_signal = K_POLL_SIGNAL_INITIALIZER(state_signal);
 static struct ble_init_config stored_config;
 static const struct ble_event_callbacks *event_callbacks = NULL;
 static bool ipc_ready = false;
+static bool tx_started = false;
+static bool ept_registered = false;
+static atomic_t init_sent;
 
-/* Message types for IPC communication */
-enum ipc_msg_type {
-    IPC_MSG_INIT = 1,
-    IPC_MSG_SEND_DATA = 2,
-    IPC_MSG_CONNECTION_STATE = 3,
-    IPC_MSG_DATA_RECEIVED = 4,
-    IPC_MSG_TEST = 5,
-};
+/* Link status block published by the network core, see ble_ipc_proto.h */
+#define LINK_STATUS_SHM (DT_NODE_EXISTS(DT_NODELABEL(link_status_shm)) && !BLE_IPC_LOOPBACK)
+#define LINK_STATUS_READ_TRIES 8
+
+#if LINK_STATUS_SHM
+BUILD_ASSERT(DT_REG_SIZE(DT_NODELABEL(link_status_shm)) >= sizeof(struct ipc_link_status),
+             "link_status_shm too small");
+BUILD_ASSERT(BLE_MAX_CONNECTIONS <= BLE_IPC_LINK_STATUS_CONNS, "Link status block too small");
+
+static volatile struct ipc_link_status *const link_status =
+    (volatile struct ipc_link_status *)DT_REG_ADDR(DT_NODELABEL(link_status_shm));
+#endif
+
+/* Queued TX pipeline, drained by a dedicated work queue */
+K_THREAD_STACK_DEFINE(ble_tx_stack, BLE_TX_STACK_SIZE);
+static struct k_work_q ble_tx_workq;
+static struct k_work tx_work;
+static struct k_work_delayable tx_pacing_work;
+static struct k_spinlock tx_lock;
+static K_SEM_DEFINE(tx_space_sem, 0, 1);
+static atomic_t tx_credits;
+static bool tx_credits_supported = false;
+
+/* One TX ring per connection, the last one for data sent to all */
+#define TX_QUEUE_ALL BLE_MAX_CONNECTIONS
+
+static struct tx_queue {
+    struct ring_buf ring;
+    uint8_t data[BLE_TX_RING_SIZE];
+} tx_queues[BLE_MAX_CONNECTIONS + 1];
+
+static uint8_t tx_next_queue;   /* Round robin position, TX work queue only */
+static int tx_claimed = -1;     /* Queue being sent from, -1 for none, under tx_lock */
+
+/* Disconnected while the TX work queue was using their ring or session */
+static ATOMIC_DEFINE(tx_reset_pending, BLE_MAX_CONNECTIONS);
 
-/* IPC message structure */
-struct ipc_message {
-    uint8_t type;
-    uint8_t data_len;
-    uint8_t data[128];  /* Adjust size as needed */
-} __packed;
+/* Per-connection state, indexed by the network core's connection ID */
+static struct ble_conn {
+    bool connected;
+    struct ipc_link_info link;  /* Negotiated link parameters */
+    atomic_t chunk_size;        /* Derived from link */
+    atomic_t profile_sent;      /* Last profile requested, -1 for none */
+    struct ble_prot_session tx_prot;    /* TX work queue only */
+    struct ble_prot_session tx_next;    /* Applied once tx_pending_bytes have gone out */
+    bool tx_next_pending;               /* tx_next and tx_pending_bytes under tx_lock */
+    uint32_t tx_pending_bytes;
+    struct ble_prot_session rx_prot;    /* IPC receive context only */
+    struct ble_prot_session rx_next;    /* Applied with the next received data */
+} conns[BLE_MAX_CONNECTIONS];
+
+/* Connections whose TX data is sealed, and those with an RX session waiting */
+static atomic_t prot_conns;
+static ATOMIC_DEFINE(rx_next_pending, BLE_MAX_CONNECTIONS);
+
+/* Advertising and connection parameter policy, applied from the TX work queue */
+static const struct ipc_conn_params conn_profiles[BLE_PROFILE_COUNT] = {
+    [BLE_PROFILE_LOW_LATENCY] = { .interval_min = 6, .interval_max = 12, .latency = 0,
+                                  .timeout = 400, .phy = BLE_IPC_PHY_2M },
+    [BLE_PROFILE_BALANCED] = { .interval_min = 24, .interval_max = 40, .latency = 0,
+                               .timeout = 400, .phy = BLE_IPC_PHY_1M | BLE_IPC_PHY_2M },
+    [BLE_PROFILE_LOW_POWER] = { .interval_min = 80, .interval_max = 160, .latency = 4,
+                                .timeout = 600, .phy = BLE_IPC_PHY_1M },
+};
+static const char *const profile_names[BLE_PROFILE_COUNT] = { "fast", "balanced", "lowpower" };
+static atomic_t link_profile = ATOMIC_INIT(BLE_PROFILE_LOW_LATENCY);
+static atomic_t link_profile_auto = ATOMIC_INIT(1);
+static atomic_t adv_fast = ATOMIC_INIT(1);
+static struct k_work profile_work;
+static struct k_work_delayable idle_work;
+static struct k_work_delayable adv_work;
 
 /* Forward declarations */
 static void ipc_endpoint_bound(void *priv);
 static void ipc_endpoint_received(const void *data, size_t len, void *priv);
-static int send_ipc_message(enum ipc_msg_type type, const uint8_t *data, uint8_t len);
+static int send_ipc_message(uint8_t conn_id, enum ipc_msg_type type, const uint8_t *data,
+                            uint16_t len);
+
+static uint8_t connection_count(void)
+{
+    uint8_t count = 0;
+    
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        count += conns[i].connected;
+    }
+    
+    return count;
+}
+
+static struct tx_queue *tx_queue_for(uint8_t conn_id)
+{
+    return conn_id == BLE_CONN_ID_ALL ? &tx_queues[TX_QUEUE_ALL] : &tx_queues[conn_id];
+}
+
+static void set_state(enum ble_connection_state state)
+{
+    atomic_set(&current_state, state);
+    k_poll_signal_raise(&state_signal, state);
+}
+
+static void start_fast_advertising(void)
+{
+    atomic_set(&adv_fast, 1);
+    k_work_reschedule_for_queue(&ble_tx_workq, &adv_work, K_NO_WAIT);
+}
+
+static void adv_work_handler(struct k_work *work)
+{
+    bool fast = atomic_set(&adv_fast, 0);
+    struct ipc_adv_params params = {
+        .connectable = stored_config.connectable,
+    };
+    
+    /* The network core only advertises while it has free connection slots */
+    if (!ipc_ready || connection_count() >= BLE_MAX_CONNECTIONS) {
+        return;
+    }
+    
+    if (fast) {
+        params.interval_ms = stored_config.adv_fast_interval_ms ?
+                             stored_config.adv_fast_interval_ms : BLE_ADV_FAST_INTERVAL_MS;
+    } else {
+        params.interval_ms = stored_config.adv_interval_ms;
+    }
+    
+    LOG_INF("Advertising %s (%u ms)", fast ? "fast" : "slow", params.interval_ms);
+    params.interval_ms = sys_cpu_to_le16(params.interval_ms);
+    send_ipc_message(0, IPC_MSG_ADV_PARAMS, (const uint8_t *)&params, sizeof(params));
+    
+    /* Back off to the slow interval if nobody connects */
+    if (fast) {
+        uint16_t duration_s = stored_config.adv_fast_duration_s ?
+                              stored_config.adv_fast_duration_s : BLE_ADV_FAST_DURATION_S;
+        k_work_reschedule_for_queue(&ble_tx_workq, &adv_work, K_SECONDS(duration_s));
+    }
+}
+
+static void profile_work_handler(struct k_work *work)
+{
+    atomic_val_t profile = atomic_get(&link_profile);
+    const struct ipc_conn_params *p = &conn_profiles[profile];
+    struct ipc_conn_params params = {
+        .interval_min = sys_cpu_to_le16(p->interval_min),
+        .interval_max = sys_cpu_to_le16(p->interval_max),
+        .latency = sys_cpu_to_le16(p->latency),
+        .timeout = sys_cpu_to_le16(p->timeout),
+        .phy = p->phy,
+    };
+    
+    for (uint8_t id = 0; id < BLE_MAX_CONNECTIONS; id++) {
+        if (!conns[id].connected || atomic_get(&conns[id].profile_sent) == profile) {
+            continue;
+        }
+        
+        if (send_ipc_message(id, IPC_MSG_CONN_PARAMS, (const uint8_t *)&params,
+                             sizeof(params)) == 0) {
+            atomic_set(&conns[id].profile_sent, profile);
+            LOG_INF("Link profile %s requested for connection %u", profile_names[profile], id);
+        }
+    }
+}
+
+static void select_profile(enum ble_link_profile profile)
+{
+    atomic_set(&link_profile, profile);
+    k_work_submit_to_queue(&ble_tx_workq, &profile_work);
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+    if (atomic_get(&link_profile_auto)) {
+        select_profile(BLE_PROFILE_LOW_POWER);
+    }
+}
+
+/* Automatic policy: short intervals while data flows, low power once quiet */
+static void link_activity(void)
+{
+    if (!atomic_get(&link_profile_auto)) {
+        return;
+    }
+    
+    if (atomic_get(&link_profile) != BLE_PROFILE_LOW_LATENCY) {
+        select_profile(BLE_PROFILE_LOW_LATENCY);
+    }
+    
+    k_work_reschedule_for_queue(&ble_tx_workq, &idle_work, K_MSEC(BLE_PROFILE_IDLE_TIMEOUT_MS));
+}
 
+#if BLE_IPC_LOOPBACK
+static ble_loopback_sink_t loopback_sink;
+
+/* Stands in for the network core: consume the frame and return its credit */
+static int loopback_send(const void *frame, size_t len)
+{
+    const struct ipc_msg_hdr *hdr = (const struct ipc_msg_hdr *)frame;
+    const uint8_t *payload = (const uint8_t *)frame + sizeof(*hdr);
+    uint16_t data_len = sys_le16_to_cpu(hdr->len);
+    uint8_t credit = 1;
+    
+    switch (hdr->type & ~IPC_MSG_FLAG_PROTECTED) {
+    case IPC_MSG_SEND_DATA:
+        if (loopback_sink) {
+            loopback_sink(hdr->conn_id, payload, data_len);
+        }
+        ble_loopback_inject(0, IPC_MSG_TX_CREDITS, &credit, sizeof(credit));
+        break;
+        
+    case IPC_MSG_TEST:
+        ble_loopback_inject(0, IPC_MSG_TEST, payload, data_len);
+        break;
+        
+    default:
+        break;
+    }
+    
+    return len;
+}
+#else
 /* IPC endpoint configuration */
 static struct ipc_ept_cfg ble_ept_cfg = {
     .name = "ble_endpoint",
@@ -58,131 +273,634 @@ static struct ipc_ept_cfg ble_ept_cfg = {
         .received = ipc_endpoint_received,
     },
 };
+#endif
+
+/* Send the init message once both ble_init() ran and the endpoint is bound */
+static void send_init_message(void)
+{
+    if (!ble_initialized || !ipc_ready || !atomic_cas(&init_sent, 0, 1)) {
+        return;
+    }
+    
+    /* Add device name to init message */
+    const char *name = stored_config.device_name ? stored_config.device_name : DEFAULT_DEVICE_NAME;
+    size_t name_len = strlen(name);
+    if (name_len > BLE_IPC_MAX_PAYLOAD) {
+        name_len = 0;
+    }
+    
+    int ret = send_ipc_message(0, IPC_MSG_INIT, (const uint8_t *)name, name_len);
+    if (ret < 0) {
+        LOG_ERR("Failed to send init message (err %d)", ret);
+    } else {
+        LOG_INF("Sent BLE init message to network core");
+        boot_mark(BOOT_ADVERTISING);
+        set_state(BLE_ADVERTISING);
+        start_fast_advertising();
+        
+        /* Call ready callback */
+        if (event_callbacks && event_callbacks->ready) {
+            event_callbacks->ready();
+        }
+    }
+    
+    /* Flush anything queued before the endpoint was bound */
+    k_work_submit_to_queue(&ble_tx_workq, &tx_work);
+}
 
 static void ipc_endpoint_bound(void *priv)
 {
     LOG_INF("BLE IPC endpoint bound");
+    boot_mark(BOOT_IPC_BOUND);
+    atomic_set(&tx_credits, BLE_IPC_TX_INITIAL_CREDITS);
     ipc_ready = true;
+    send_init_message();
+}
+
+/* Drop the TX state of a connection, under tx_lock and not while it is claimed */
+static void tx_reset_locked(uint8_t conn_id)
+{
+    struct ble_conn *conn = &conns[conn_id];
     
-    /* Send initialization message to network core */
-    if (ble_initialized) {
-        struct ipc_message init_msg = {
-            .type = IPC_MSG_INIT,
-            .data_len = 0,
-        };
+    ring_buf_reset(&tx_queues[conn_id].ring);
+    memset(&conn->tx_prot, 0, sizeof(conn->tx_prot));
+    conn->tx_next_pending = false;
+    conn->tx_pending_bytes = 0;
+    atomic_clear_bit(&prot_conns, conn_id);
+    atomic_clear_bit(tx_reset_pending, conn_id);
+}
+
+static void reset_connection(struct ble_conn *conn, uint8_t conn_id)
+{
+    memset(&conn->link, 0, sizeof(conn->link));
+    atomic_set(&conn->chunk_size, BLE_TX_CHUNK_SIZE);
+    atomic_set(&conn->profile_sent, -1);
+    
+    /* Queued data was meant for the old peer, not whoever gets this ID next */
+    k_spinlock_key_t key = k_spin_lock(&tx_lock);
+    if (tx_claimed == conn_id || tx_claimed == TX_QUEUE_ALL) {
+        /* Being sent or sealed right now, the TX work queue resets it when done */
+        atomic_set_bit(tx_reset_pending, conn_id);
+    } else {
+        tx_reset_locked(conn_id);
+    }
+    k_spin_unlock(&tx_lock, key);
+    
+    atomic_clear_bit(rx_next_pending, conn_id);
+    memset(&conn->rx_prot, 0, sizeof(conn->rx_prot));
+    k_sem_give(&tx_space_sem);
+}
+
+static void handle_connection_state(uint8_t conn_id, enum ble_connection_state new_state)
+{
+    if (conn_id >= BLE_MAX_CONNECTIONS) {
+        LOG_WRN("Ignoring state of unknown connection %u", conn_id);
+        return;
+    }
+    
+    struct ble_conn *conn = &conns[conn_id];
+    bool was_connected = conn->connected;
+    bool now_connected = (new_state == BLE_CONNECTED);
+    enum ble_connection_state old_state = atomic_get(&current_state);
+    
+    if (was_connected != now_connected) {
+        conn->connected = now_connected;
+        reset_connection(conn, conn_id);
+    }
+    
+    /* Overall state stays connected while any peer is */
+    uint8_t count = connection_count();
+    if (count > 0) {
+        new_state = BLE_CONNECTED;
+    }
+    
+    if (new_state != old_state) {
+        set_state(new_state);
+        LOG_INF("BLE state changed: %d -> %d", old_state, new_state);
+    }
+    
+    if (now_connected && !was_connected) {
+        LOG_INF("Connection %u up (%u connected)", conn_id, count);
+        boot_mark(BOOT_FIRST_CONNECTION);
         
-        /* Add device name to init message */
-        const char *name = stored_config.device_name ? stored_config.device_name : DEFAULT_DEVICE_NAME;
-        size_t name_len = strlen(name);
-        if (name_len < sizeof(init_msg.data)) {
-            init_msg.data_len = name_len;
-            memcpy(init_msg.data, name, name_len);
+        if (count >= BLE_MAX_CONNECTIONS) {
+            k_work_cancel_delayable(&adv_work);
         }
         
-        int ret = ipc_service_send(&ble_endpoint, &init_msg, sizeof(init_msg));
-        if (ret < 0) {
-            LOG_ERR("Failed to send init message (err %d)", ret);
+        /* New connections need their parameters requested again */
+        if (atomic_get(&link_profile_auto)) {
+            link_activity();
         } else {
-            LOG_INF("Sent BLE init message to network core");
-            current_state = BLE_ADVERTISING;
-            
-            /* Call ready callback */
-            if (event_callbacks && event_callbacks->ready) {
-                event_callbacks->ready();
-            }
+            k_work_submit_to_queue(&ble_tx_workq, &profile_work);
+        }
+        
+        if (event_callbacks && event_callbacks->connected) {
+            event_callbacks->connected(conn_id);
+        }
+    } else if (was_connected && !now_connected) {
+        LOG_INF("Connection %u down (%u connected)", conn_id, count);
+        
+        if (count == 0) {
+            k_work_cancel_delayable(&idle_work);
+        }
+        start_fast_advertising();
+        
+        if (event_callbacks && event_callbacks->disconnected) {
+            event_callbacks->disconnected(conn_id, 0); /* Reason unknown via IPC */
         }
     }
 }
 
 static void ipc_endpoint_received(const void *data, size_t len, void *priv)
 {
-    const struct ipc_message *msg = (const struct ipc_message *)data;
+    static uint8_t rx_plain[BLE_IPC_MAX_PAYLOAD];
+    const struct ipc_msg_hdr *hdr = (const struct ipc_msg_hdr *)data;
+    uint32_t start = perf_start();
+    
+    if (len < sizeof(*hdr)) {
+        LOG_WRN("Dropping runt IPC frame (%u bytes)", (unsigned int)len);
+        perf_inc(PERF_IPC_RX_DROPS);
+        return;
+    }
+    
+    uint16_t data_len = sys_le16_to_cpu(hdr->len);
+    const uint8_t *payload = (const uint8_t *)data + sizeof(*hdr);
     
-    LOG_DBG("Received IPC message type %d, len %d", msg->type, msg->data_len);
+    /* Declared payload must fit inside what the backend actually delivered */
+    if (data_len > len - sizeof(*hdr)) {
+        LOG_WRN("Dropping IPC message type %d: len %u exceeds frame (%u bytes)",
+                hdr->type, data_len, (unsigned int)len);
+        perf_inc(PERF_IPC_RX_DROPS);
+        return;
+    }
+    
+    perf_inc(PERF_IPC_RX_FRAMES);
+    perf_add(PERF_IPC_RX_BYTES, data_len);
+    
+    /* Data frames are traced with their connection below */
+    if (hdr->type != IPC_MSG_DATA_RECEIVED) {
+        trace_event(TRACE_MOD_IPC, TRACE_EV_IPC_RX, hdr->type, data_len);
+    }
     
-    switch (msg->type) {
+    switch (hdr->type) {
     case IPC_MSG_CONNECTION_STATE:
-        if (msg->data_len >= 1) {
-            enum ble_connection_state new_state = (enum ble_connection_state)msg->data[0];
-            
-            if (new_state != current_state) {
-                enum ble_connection_state old_state = current_state;
-                current_state = new_state;
-                
-                LOG_INF("BLE state changed: %d -> %d", old_state, new_state);
-                
-                /* Trigger appropriate callbacks */
-                if (event_callbacks) {
-                    if (new_state == BLE_CONNECTED && old_state != BLE_CONNECTED) {
-                        if (event_callbacks->connected) {
-                            event_callbacks->connected();
-                        }
-                    } else if (new_state != BLE_CONNECTED && old_state == BLE_CONNECTED) {
-                        if (event_callbacks->disconnected) {
-                            event_callbacks->disconnected(0); /* Reason unknown via IPC */
-                        }
-                    }
-                }
-            }
+        if (data_len >= 1) {
+            handle_connection_state(hdr->conn_id, (enum ble_connection_state)payload[0]);
         }
         break;
         
     case IPC_MSG_DATA_RECEIVED:
-        LOG_INF("Received BLE data via IPC: %d bytes", msg->data_len);
-        LOG_HEXDUMP_DBG(msg->data, msg->data_len, "BLE Data:");
+        if (hdr->conn_id >= BLE_MAX_CONNECTIONS) {
+            LOG_WRN("Dropping data for unknown connection %u", hdr->conn_id);
+            break;
+        }
+        
+        trace_event(TRACE_MOD_IPC, TRACE_EV_DATA_RX, hdr->conn_id, data_len);
+        link_activity();
+        
+        struct ble_conn *rx_conn = &conns[hdr->conn_id];
+        
+        if (atomic_test_and_clear_bit(rx_next_pending, hdr->conn_id)) {
+            rx_conn->rx_prot = rx_conn->rx_next;
+        }
+        
+        if (rx_conn->rx_prot.mode != BLE_PROT_OFF) {
+            int ret = ble_prot_open(&rx_conn->rx_prot, payload, data_len, rx_plain,
+                                    sizeof(rx_plain));
+            if (ret < 0) {
+                LOG_WRN("Dropping unverified data from connection %u (err %d)",
+                        hdr->conn_id, ret);
+                break;
+            }
+            
+            payload = rx_plain;
+            data_len = ret;
+        }
         
         if (event_callbacks && event_callbacks->data_received) {
-            event_callbacks->data_received(msg->data, msg->data_len);
+            event_callbacks->data_received(hdr->conn_id, payload, data_len);
+        }
+        break;
+    
+    case IPC_MSG_BULK:
+        if (hdr->conn_id >= BLE_MAX_CONNECTIONS) {
+            LOG_WRN("Dropping bulk frame for unknown connection %u", hdr->conn_id);
+            break;
+        }
+        
+        /* Bulk data flowing keeps the fast connection profile too */
+        link_activity();
+        
+        if (event_callbacks && event_callbacks->bulk_received) {
+            event_callbacks->bulk_received(hdr->conn_id, payload, data_len);
         }
         break;
         
     case IPC_MSG_TEST:
-        LOG_INF("Received IPC test response: %.*s", msg->data_len, msg->data);
+        LOG_INF("Received IPC test response: %.*s", data_len, payload);
+        break;
+    
+    case IPC_MSG_LINK_INFO:
+        if (hdr->conn_id < BLE_MAX_CONNECTIONS && data_len >= sizeof(struct ipc_link_info)) {
+            const struct ipc_link_info *info = (const struct ipc_link_info *)payload;
+            struct ble_conn *conn = &conns[hdr->conn_id];
+            
+            conn->link.mtu = sys_le16_to_cpu(info->mtu);
+            conn->link.tx_octets = sys_le16_to_cpu(info->tx_octets);
+            conn->link.phy = info->phy;
+            
+            if (conn->link.mtu > 3) {
+                atomic_set(&conn->chunk_size, ble_ipc_fill_chunk(conn->link.mtu,
+                                                                 conn->link.tx_octets,
+                                                                 BLE_IPC_MAX_PAYLOAD));
+            }
+            
+            LOG_INF("Connection %u: MTU %u, data length %u, PHY 0x%02x, chunk %u",
+                    hdr->conn_id, conn->link.mtu, conn->link.tx_octets, conn->link.phy,
+                    (unsigned int)atomic_get(&conn->chunk_size));
+        }
         break;
         
+    case IPC_MSG_TX_CREDITS:
+        if (data_len >= 1) {
+            tx_credits_supported = true;
+            atomic_add(&tx_credits, payload[0]);
+            k_work_submit_to_queue(&ble_tx_workq, &tx_work);
+        }
+        break;
+    
     default:
-        LOG_WRN("Unknown IPC message type: %d", msg->type);
+        LOG_WRN("Unknown IPC message type: %d", hdr->type);
         break;
     }
+    
+    perf_stop(PERF_T_IPC_RX, start);
 }
 
-static int send_ipc_message(enum ipc_msg_type type, const uint8_t *data, uint8_t len)
+static int send_ipc_message(uint8_t conn_id, enum ipc_msg_type type, const uint8_t *data,
+                            uint16_t len)
 {
+    uint8_t frame[BLE_IPC_MAX_FRAME];
+    struct ipc_msg_hdr *hdr = (struct ipc_msg_hdr *)frame;
+    
     if (!ipc_ready) {
         LOG_ERR("IPC not ready");
         return -ENOTCONN;
     }
     
-    if (len > sizeof(((struct ipc_message *)0)->data)) {
+    if (len > BLE_IPC_MAX_PAYLOAD) {
         LOG_ERR("Data too large for IPC message");
         return -EINVAL;
     }
     
-    struct ipc_message msg = {
-        .type = type,
-        .data_len = len,
-    };
+    hdr->type = type;
+    hdr->conn_id = conn_id;
+    hdr->len = sys_cpu_to_le16(len);
     
     if (data && len > 0) {
-        memcpy(msg.data, data, len);
+        memcpy(frame + sizeof(*hdr), data, len);
     }
     
-    int ret = ipc_service_send(&ble_endpoint, &msg, sizeof(msg));
+    /* Only the header and the used part of the payload cross shared memory */
+    uint32_t start = perf_start();
+#if BLE_IPC_LOOPBACK
+    int ret = loopback_send(frame, sizeof(*hdr) + len);
+#else
+    int ret = ipc_service_send(&ble_endpoint, frame, sizeof(*hdr) + len);
+#endif
+    
+    perf_stop(PERF_T_IPC_SEND, start);
+    
     if (ret < 0) {
         LOG_ERR("Failed to send IPC message (err %d)", ret);
+        perf_inc(PERF_IPC_TX_ERRORS);
         return ret;
     }
     
-    LOG_DBG("Sent IPC message type %d, len %d", type, len);
+    perf_inc(PERF_IPC_TX_FRAMES);
+    perf_add(PERF_IPC_TX_BYTES, len);
+    
+    trace_event(TRACE_MOD_IPC, TRACE_EV_IPC_TX, type, len);
     return 0;
 }
 
+static uint8_t queue_conn_id(uint8_t queue)
+{
+    return queue == TX_QUEUE_ALL ? BLE_CONN_ID_ALL : queue;
+}
+
+static bool tx_queues_empty(void)
+{
+    for (int i = 0; i < ARRAY_SIZE(tx_queues); i++) {
+        if (!ring_buf_is_empty(&tx_queues[i].ring)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/* Switch to a session set by ble_link_protect() once the data queued before it is out */
+static void tx_apply_pending(uint8_t queue)
+{
+    struct ble_conn *conn = &conns[queue];
+    
+    if (queue == TX_QUEUE_ALL || !conn->tx_next_pending || conn->tx_pending_bytes > 0) {
+        return;
+    }
+    
+    conn->tx_prot = conn->tx_next;
+    conn->tx_next_pending = false;
+    
+    if (conn->tx_prot.mode != BLE_PROT_OFF) {
+        atomic_set_bit(&prot_conns, queue);
+    } else {
+        atomic_clear_bit(&prot_conns, queue);
+    }
+}
+
+BUILD_ASSERT(BLE_MAX_CONNECTIONS <= BLE_IPC_TX_INITIAL_CREDITS,
+             "Data sent to all protected peers needs a credit per connection");
+
+/* Frames needed to send one chunk of a queue */
+static int tx_frames_for(uint8_t queue)
+{
+    if (queue != TX_QUEUE_ALL || !atomic_get(&prot_conns)) {
+        return 1;
+    }
+    
+    /* Sealing is per connection, so data for everyone goes out once per peer */
+    return MAX(connection_count(), 1);
+}
+
+/* Returns 1 if the frame was handed to IPC, 0 if it was dropped, or negative error code */
+static int send_data_frame(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    static uint8_t sealed[BLE_IPC_MAX_PAYLOAD];     /* TX work queue only */
+    int ret;
+    
+    if (conn_id == BLE_CONN_ID_ALL || conns[conn_id].tx_prot.mode == BLE_PROT_OFF) {
+        ret = send_ipc_message(conn_id, IPC_MSG_SEND_DATA, data, len);
+        return ret < 0 ? ret : 1;
+    }
+    
+    ret = ble_prot_seal(&conns[conn_id].tx_prot, data, len, sealed, sizeof(sealed));
+    if (ret < 0) {
+        /* Never fall back to sending the data in the clear, and never retry it */
+        if (ret == -EOVERFLOW) {
+            /* Only a new session from the host's 'secure' command fixes this */
+            LOG_ERR("Connection %u used up its session counter, dropped", conn_id);
+        } else {
+            LOG_ERR("Failed to seal data for connection %u (err %d), dropped", conn_id, ret);
+        }
+        perf_inc(PERF_PROT_DROPPED);
+        return 0;
+    }
+    
+    ret = send_ipc_message(conn_id, IPC_MSG_SEND_DATA | IPC_MSG_FLAG_PROTECTED, sealed, ret);
+    return ret < 0 ? ret : 1;
+}
+
+/*
+ * Returns the number of frames handed to IPC, each of which takes a credit,
+ * or negative error code if none were and the chunk should be retried
+ */
+static int send_chunk(uint8_t queue, const uint8_t *data, uint16_t len)
+{
+    if (queue != TX_QUEUE_ALL || !atomic_get(&prot_conns)) {
+        return send_data_frame(queue_conn_id(queue), data, len);
+    }
+    
+    int frames = 0;
+    
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (!conns[i].connected) {
+            continue;
+        }
+        
+        int ret = send_data_frame(i, data, len);
+        
+        if (ret < 0) {
+            if (frames == 0) {
+                return ret;
+            }
+            
+            /* The others already have it, resending would duplicate their data */
+            LOG_WRN("Connection %u missed %u bytes sent to all", i, len);
+            continue;
+        }
+        
+        frames += ret;
+    }
+    
+    return frames;
+}
+
+/* Run the resets deferred by reset_connection(), under tx_lock */
+static bool tx_apply_resets(void)
+{
+    bool reset = false;
+    
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (atomic_test_bit(tx_reset_pending, i)) {
+            tx_reset_locked(i);
+            reset = true;
+        }
+    }
+    
+    return reset;
+}
+
+static void tx_work_handler(struct k_work *work)
+{
+    bool sent = false;
+    
+    while (ipc_ready && atomic_get(&tx_credits) > 0) {
+        uint8_t *chunk;
+        uint32_t chunk_size = 0;
+        uint8_t queue = tx_next_queue;
+        k_spinlock_key_t key = k_spin_lock(&tx_lock);
+        
+        /* Round robin, one frame per connection at a time */
+        for (int i = 0; i < ARRAY_SIZE(tx_queues) && chunk_size == 0; i++) {
+            queue = (tx_next_queue + i) % ARRAY_SIZE(tx_queues);
+            tx_apply_pending(queue);
+            
+            /* Fan-out needs a credit per peer, wait for them rather than split the chunk */
+            if (tx_credits_supported && atomic_get(&tx_credits) < tx_frames_for(queue)) {
+                continue;
+            }
+            
+            uint32_t limit = ble_get_tx_chunk_size(queue_conn_id(queue));
+            
+            /* Data queued before a session switch goes out under the old session */
+            if (queue != TX_QUEUE_ALL && conns[queue].tx_next_pending) {
+                limit = MIN(limit, conns[queue].tx_pending_bytes);
+            }
+            
+            chunk_size = ring_buf_get_claim(&tx_queues[queue].ring, &chunk, limit);
+        }
+        if (chunk_size > 0) {
+            tx_claimed = queue;
+        }
+        k_spin_unlock(&tx_lock, key);
+        
+        if (chunk_size == 0) {
+            break;
+        }
+        
+        /* ipc_service_send() can block on a stuck network core */
+        supervisor_begin(SUPERVISOR_IPC_TX, queue_conn_id(queue),
+                         SUPERVISOR_IPC_TX_DEADLINE_MS * tx_frames_for(queue));
+        int ret = send_chunk(queue, chunk, chunk_size);
+        
+        supervisor_end(SUPERVISOR_IPC_TX);
+        
+        key = k_spin_lock(&tx_lock);
+        ring_buf_get_finish(&tx_queues[queue].ring, ret < 0 ? 0 : chunk_size);
+        if (ret >= 0 && queue != TX_QUEUE_ALL && conns[queue].tx_next_pending) {
+            conns[queue].tx_pending_bytes -= MIN(conns[queue].tx_pending_bytes, chunk_size);
+        }
+        tx_claimed = -1;
+        bool reset = tx_apply_resets();
+        k_spin_unlock(&tx_lock, key);
+        
+        if (reset) {
+            k_sem_give(&tx_space_sem);
+        }
+        
+        if (ret < 0) {
+            /* Backend is out of buffers, keep the data and try again shortly */
+            k_work_reschedule_for_queue(&ble_tx_workq, &tx_pacing_work,
+                                        K_MSEC(BLE_TX_LEGACY_PACING_MS));
+            return;
+        }
+        
+        tx_next_queue = (queue + 1) % ARRAY_SIZE(tx_queues);
+        perf_inc(PERF_TX_CHUNKS);
+        
+        /* Dropped frames never reach the network core, so they take no credit */
+        if (tx_credits_supported) {
+            atomic_sub(&tx_credits, ret);
+        } else if (ret > 0) {
+            /* One frame per pacing interval until the network core sends credits */
+            atomic_set(&tx_credits, 0);
+        }
+        
+        k_sem_give(&tx_space_sem);
+        sent = true;
+    }
+    
+    if (!tx_queues_empty()) {
+        if (!tx_credits_supported) {
+            /* Network core does not return credits, fall back to fixed pacing */
+            k_work_reschedule_for_queue(&ble_tx_workq, &tx_pacing_work,
+                                        K_MSEC(BLE_TX_LEGACY_PACING_MS));
+        }
+        return;
+    }
+    
+    /* Call data sent callback once everything queued has gone out */
+    if (sent && event_callbacks && event_callbacks->data_sent) {
+        event_callbacks->data_sent();
+    }
+}
+
+static void tx_pacing_work_handler(struct k_work *work)
+{
+    if (!tx_credits_supported && atomic_get(&tx_credits) <= 0) {
+        atomic_set(&tx_credits, 1);
+    }
+    
+    tx_work_handler(work);
+}
+
+static uint32_t tx_ring_put(struct tx_queue *q, const uint8_t *data, uint32_t len,
+                            bool all_or_nothing)
+{
+    uint32_t written = 0;
+    k_spinlock_key_t key = k_spin_lock(&tx_lock);
+    int queue = q - tx_queues;
+    bool resetting = queue != TX_QUEUE_ALL && atomic_test_bit(tx_reset_pending, queue);
+    
+    /* A ring waiting for its reset would throw new data away with the old */
+    if (!resetting && (!all_or_nothing || ring_buf_space_get(&q->ring) >= len)) {
+        written = ring_buf_put(&q->ring, data, len);
+    }
+    
+    uint32_t fill = ring_buf_size_get(&q->ring);
+    
+    k_spin_unlock(&tx_lock, key);
+    
+    perf_peak(PERF_TX_QUEUE_PEAK, fill);
+    if (written < len) {
+        perf_inc(PERF_TX_QUEUE_FULL);
+    }
+    
+    return written;
+}
+
 /* Public API Implementation */
 
-int ble_init(const struct ble_init_config *config, const struct ble_event_callbacks *callbacks)
+int ble_ipc_register(void)
+{
+    if (ept_registered) {
+        return BLE_INIT_STATUS_SUCCESS;
+    }
+    
+    /* Start TX pipeline */
+    if (!tx_started) {
+        for (int i = 0; i < ARRAY_SIZE(tx_queues); i++) {
+            ring_buf_init(&tx_queues[i].ring, sizeof(tx_queues[i].data), tx_queues[i].data);
+        }
+        for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+            reset_connection(&conns[i], i);
+        }
+        k_work_init(&tx_work, tx_work_handler);
+        k_work_init_delayable(&tx_pacing_work, tx_pacing_work_handler);
+        k_work_init(&profile_work, profile_work_handler);
+        k_work_init_delayable(&idle_work, idle_work_handler);
+        k_work_init_delayable(&adv_work, adv_work_handler);
+        k_work_queue_init(&ble_tx_workq);
+        k_work_queue_start(&ble_tx_workq, ble_tx_stack, K_THREAD_STACK_SIZEOF(ble_tx_stack),
+                           BLE_TX_PRIORITY, &(struct k_work_queue_config){ .name = "ble_tx" });
+        tx_started = true;
+    }
+
+#if !BLE_IPC_LOOPBACK
+    /* Get IPC service instance */
+    ipc_instance = DEVICE_DT_GET(DT_NODELABEL(ipc0));
+    if (!ipc_instance) {
+        LOG_ERR("Failed to get IPC service instance");
+        return BLE_INIT_STATUS_IPC_FAILED;
+    }
+    
+    /* Register IPC endpoint, the network core can bind from now on */
+    int err = ipc_service_register_endpoint(ipc_instance, &ble_endpoint, &ble_ept_cfg);
+    if (err) {
+        LOG_ERR("Failed to register IPC endpoint (err %d)", err);
+        return BLE_INIT_STATUS_IPC_FAILED;
+    }
+#endif
+    
+    ept_registered = true;
+    boot_mark(BOOT_IPC_REGISTERED);
+    return BLE_INIT_STATUS_SUCCESS;
+}
+
+#if BLE_IPC_EARLY_REGISTER
+static int ble_ipc_sys_init(void)
 {
-    int err;
+    /* A failure is retried and reported by ble_init() */
+    ble_ipc_register();
+    return 0;
+}
+
+SYS_INIT(ble_ipc_sys_init, APPLICATION, BLE_IPC_INIT_PRIORITY);
+#endif
 
+int ble_init(const struct ble_init_config *config, const struct ble_event_callbacks *callbacks)
+{
     if (ble_initialized) {
         LOG_WRN("BLE already initialized");
         return BLE_INIT_STATUS_ALREADY_INITIALIZED;
@@ -198,29 +916,35 @@ int ble_init(const struct ble_init_config *config, const struct ble_event_callba
     /* Store configuration and callbacks */
     stored_config = *config;
     event_callbacks = callbacks;
-
-    /* Get IPC service instance */
-    ipc_instance = DEVICE_DT_GET(DT_NODELABEL(ipc0));
-    if (!ipc_instance) {
-        LOG_ERR("Failed to get IPC service instance");
-        return BLE_INIT_STATUS_IPC_FAILED;
-    }
-
-    /* Register IPC endpoint */
-    err = ipc_service_register_endpoint(ipc_instance, &ble_endpoint, &ble_ept_cfg);
+    
+    int err = ble_ipc_register();
     if (err) {
-        LOG_ERR("Failed to register IPC endpoint (err %d)", err);
-        return BLE_INIT_STATUS_IPC_FAILED;
+        return err;
     }
-
+    
     ble_initialized = true;
-    current_state = BLE_DISCONNECTED;
 
-    LOG_INF("BLE IPC initialization complete, waiting for network core");
+#if BLE_IPC_LOOPBACK
+    /* No network core to wait for */
+    LOG_INF("BLE IPC loopback, no network core");
+    ipc_endpoint_bound(NULL);
+#else
+    /* Starts advertising now if the network core bound during boot */
+    if (ipc_ready) {
+        send_init_message();
+    } else {
+        LOG_INF("BLE IPC initialization complete, waiting for network core");
+    }
+#endif
     return BLE_INIT_STATUS_SUCCESS;
 }
 
 int ble_send_data(const uint8_t *data, uint16_t len)
+{
+    return ble_send_data_to(BLE_CONN_ID_ALL, data, len);
+}
+
+int ble_send_data_to(uint8_t conn_id, const uint8_t *data, uint16_t len)
 {
     if (!ble_initialized) {
         LOG_ERR("BLE not initialized");
@@ -231,34 +955,192 @@ int ble_send_data(const uint8_t *data, uint16_t len)
         LOG_ERR("Invalid data parameters");
         return -EINVAL;
     }
+    
+    if (conn_id != BLE_CONN_ID_ALL && !ble_is_connected(conn_id)) {
+        return -ENOTCONN;
+    }
 
-    /* Split large messages if needed */
+    /* Queue as much as fits, waiting for the TX work queue to free space */
+    struct tx_queue *q = tx_queue_for(conn_id);
     uint16_t remaining = len;
     uint16_t offset = 0;
     
     while (remaining > 0) {
-        uint8_t chunk_size = (remaining > 120) ? 120 : remaining; /* Leave room for header */
+        uint32_t written = tx_ring_put(q, data + offset, remaining, false);
         
-        int ret = send_ipc_message(IPC_MSG_SEND_DATA, data + offset, chunk_size);
-        if (ret < 0) {
-            return ret;
-        }
+        offset += written;
+        remaining -= written;
         
-        offset += chunk_size;
-        remaining -= chunk_size;
+        k_work_submit_to_queue(&ble_tx_workq, &tx_work);
         
-        /* Small delay between chunks to avoid overwhelming the network core */
-        if (remaining > 0) {
-            k_sleep(K_MSEC(10));
+        if (remaining > 0 && k_sem_take(&tx_space_sem, K_MSEC(BLE_TX_TIMEOUT_MS)) != 0) {
+            LOG_WRN("TX queue stalled, dropped %u bytes", remaining);
+            return -ETIMEDOUT;
+        }
+        
+        /* Connection dropped while waiting, its ring was discarded */
+        if (conn_id != BLE_CONN_ID_ALL && !ble_is_connected(conn_id)) {
+            return -ENOTCONN;
+        }
+    }
+
+    return 0;
+}
+
+int ble_send_data_async(const uint8_t *data, uint16_t len)
+{
+    if (!ble_initialized) {
+        return -EACCES;
+    }
+
+    if (!data || len == 0) {
+        return -EINVAL;
+    }
+    
+    if (tx_ring_put(&tx_queues[TX_QUEUE_ALL], data, len, true) == 0) {
+        return -ENOMEM;
+    }
+    
+    k_work_submit_to_queue(&ble_tx_workq, &tx_work);
+    return 0;
+}
+
+#if !BLE_IPC_LOOPBACK
+/* Take one TX credit if there is one, never going below zero */
+static bool tx_credit_take(void)
+{
+    atomic_val_t credits = atomic_get(&tx_credits);
+    
+    while (credits > 0) {
+        if (atomic_cas(&tx_credits, credits, credits - 1)) {
+            return true;
         }
+        credits = atomic_get(&tx_credits);
+    }
+    
+    return false;
+}
+
+/* Return a credit taken for a frame that was never sent */
+static void tx_credit_give(void)
+{
+    atomic_inc(&tx_credits);
+    k_work_submit_to_queue(&ble_tx_workq, &tx_work);
+}
+#endif
+
+int ble_tx_buf_get(uint8_t conn_id, uint8_t **buf, uint16_t *size)
+{
+    if (!ble_initialized || !ipc_ready) {
+        return -ENOTCONN;
+    }
+    
+    if (!buf || !size || *size > BLE_IPC_MAX_PAYLOAD ||
+        (conn_id != BLE_CONN_ID_ALL && conn_id >= BLE_MAX_CONNECTIONS)) {
+        return -EINVAL;
+    }
+    
+    /* Sealing happens on the TX work queue, protected data must take the rings */
+    if (conn_id == BLE_CONN_ID_ALL ? atomic_get(&prot_conns) != 0 :
+        atomic_test_bit(&prot_conns, conn_id) || conns[conn_id].tx_next_pending) {
+        return -ENOTSUP;
+    }
+
+#if BLE_IPC_LOOPBACK
+    /* No shared memory to borrow, callers fall back to copying */
+    return -ENOTSUP;
+#else
+    /* Queued data must go out first */
+    if (!ring_buf_is_empty(&tx_queue_for(conn_id)->ring)) {
+        return -EBUSY;
+    }
+    
+    /* The buffer may stay borrowed for a while, so hold its credit until it is sent */
+    if (!tx_credit_take()) {
+        return -EBUSY;
+    }
+    
+    void *frame;
+    uint32_t frame_size = sizeof(struct ipc_msg_hdr) + *size;
+
+    int ret = ipc_service_get_tx_buffer(&ble_endpoint, &frame, &frame_size, K_NO_WAIT);
+    if (ret < 0) {
+        LOG_DBG("No-copy TX buffer unavailable (err %d)", ret);
+        tx_credit_give();
+        return ret;
+    }
+    
+    /* Hide the frame header from the caller */
+    frame_size = MIN(frame_size - sizeof(struct ipc_msg_hdr), BLE_IPC_MAX_PAYLOAD);
+    
+    /* Address the frame now and note its size, ble_tx_buf_send() only sees the payload */
+    ((struct ipc_msg_hdr *)frame)->conn_id = conn_id;
+    ((struct ipc_msg_hdr *)frame)->len = sys_cpu_to_le16(frame_size);
+    
+    *buf = (uint8_t *)frame + sizeof(struct ipc_msg_hdr);
+    *size = frame_size;
+    return 0;
+#endif
+}
+
+int ble_tx_buf_send(uint8_t *buf, uint16_t len)
+{
+#if BLE_IPC_LOOPBACK
+    return -ENOTSUP;
+#else
+    struct ipc_msg_hdr *hdr = (struct ipc_msg_hdr *)(buf - sizeof(struct ipc_msg_hdr));
+    
+    /* Writing past the borrowed size has already gone wrong, do not send it */
+    if (len > sys_le16_to_cpu(hdr->len)) {
+        LOG_ERR("No-copy frame of %u bytes exceeds its %u byte buffer", len,
+                sys_le16_to_cpu(hdr->len));
+        ble_tx_buf_release(buf);
+        return -EINVAL;
+    }
+    
+    hdr->type = IPC_MSG_SEND_DATA;
+    hdr->len = sys_cpu_to_le16(len);
+    
+    uint32_t start = perf_start();
+    int ret = ipc_service_send_nocopy(&ble_endpoint, hdr, sizeof(*hdr) + len);
+    
+    perf_stop(PERF_T_IPC_SEND, start);
+    
+    if (ret < 0) {
+        LOG_ERR("Failed to send no-copy IPC message (err %d)", ret);
+        perf_inc(PERF_IPC_TX_ERRORS);
+        ble_tx_buf_release(buf);
+        return ret;
+    }
+    
+    perf_inc(PERF_IPC_TX_FRAMES);
+    perf_add(PERF_IPC_TX_BYTES, len);
+    
+    /* The credit was taken by ble_tx_buf_get() */
+    trace_event(TRACE_MOD_IPC, TRACE_EV_IPC_TX, IPC_MSG_SEND_DATA, len);
+    
+    if (!tx_credits_supported) {
+        /* Keep legacy pacing for whatever gets queued behind this frame */
+        k_work_reschedule_for_queue(&ble_tx_workq, &tx_pacing_work,
+                                    K_MSEC(BLE_TX_LEGACY_PACING_MS));
     }
 
-    /* Call data sent callback */
     if (event_callbacks && event_callbacks->data_sent) {
         event_callbacks->data_sent();
     }
 
     return 0;
+#endif
+}
+
+void ble_tx_buf_release(uint8_t *buf)
+{
+#if !BLE_IPC_LOOPBACK
+    if (buf) {
+        ipc_service_drop_tx_buffer(&ble_endpoint, buf - sizeof(struct ipc_msg_hdr));
+        tx_credit_give();
+    }
+#endif
 }
 
 enum ble_connection_state ble_get_connection_state(void)
@@ -266,7 +1148,215 @@ enum ble_connection_state ble_get_connection_state(void)
     if (!ipc_ready) {
         return BLE_IPC_ERROR;
     }
-    return current_state;
+    return atomic_get(&current_state);
+}
+
+uint8_t ble_get_connection_count(void)
+{
+    return connection_count();
+}
+
+bool ble_is_connected(uint8_t conn_id)
+{
+    return conn_id < BLE_MAX_CONNECTIONS && conns[conn_id].connected;
+}
+
+struct k_poll_signal *ble_get_state_signal(void)
+{
+    return &state_signal;
+}
+
+int ble_get_link_info(uint8_t conn_id, struct ble_link_info *info)
+{
+    if (conn_id >= BLE_MAX_CONNECTIONS) {
+        return -EINVAL;
+    }
+    
+    info->mtu = conns[conn_id].link.mtu;
+    info->tx_octets = conns[conn_id].link.tx_octets;
+    info->phy = conns[conn_id].link.phy;
+    info->chunk_size = atomic_get(&conns[conn_id].chunk_size);
+    return 0;
+}
+
+int ble_get_peer_status(uint8_t conn_id, struct ble_peer_status *status)
+{
+    if (conn_id >= BLE_MAX_CONNECTIONS) {
+        return -EINVAL;
+    }
+
+#if LINK_STATUS_SHM
+    volatile struct ipc_link_status_conn *shared = &link_status->conn[conn_id];
+    struct ipc_link_status_conn conn;
+    
+    if (link_status->magic != BLE_IPC_LINK_STATUS_MAGIC) {
+        return -ENODATA;
+    }
+    
+    /* Seqlock read, the network core never waits for us */
+    for (int i = 0; i < LINK_STATUS_READ_TRIES; i++) {
+        uint32_t seq = link_status->seq;
+        
+        if (seq & 1) {
+            continue;
+        }
+        
+        barrier_dmem_fence_full();
+        conn = *shared;
+        barrier_dmem_fence_full();
+        
+        if (link_status->seq != seq) {
+            continue;
+        }
+        
+        status->state = conn.state;
+        status->rssi = conn.rssi;
+        status->phy = conn.phy;
+        status->mtu = conn.mtu;
+        status->tx_octets = conn.tx_octets;
+        status->interval_us = conn.interval * 1250U;
+        status->latency = conn.latency;
+        status->timeout_ms = conn.timeout * 10U;
+        status->tx_notifications = conn.tx_notifications;
+        status->rx_writes = conn.rx_writes;
+        return 0;
+    }
+    
+    return -EAGAIN;
+#else
+    return -ENODATA;
+#endif
+}
+
+uint16_t ble_get_tx_chunk_size(uint8_t conn_id)
+{
+    /* Sealed frames must still fit one notification */
+    if (conn_id < BLE_MAX_CONNECTIONS) {
+        return atomic_get(&conns[conn_id].chunk_size) -
+               (atomic_test_bit(&prot_conns, conn_id) ? BLE_PROT_OVERHEAD : 0);
+    }
+    
+    /* Data for everyone must fit the smallest connection */
+    uint16_t chunk = 0;
+    
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (conns[i].connected) {
+            uint16_t size = atomic_get(&conns[i].chunk_size);
+            chunk = chunk ? MIN(chunk, size) : size;
+        }
+    }
+    
+    chunk = chunk ? chunk : BLE_TX_CHUNK_SIZE;
+    return chunk - (atomic_get(&prot_conns) ? BLE_PROT_OVERHEAD : 0);
+}
+
+int ble_set_link_profile(enum ble_link_profile profile)
+{
+    if (profile >= BLE_PROFILE_COUNT) {
+        return -EINVAL;
+    }
+    
+    atomic_set(&link_profile_auto, 0);
+    k_work_cancel_delayable(&idle_work);
+    select_profile(profile);
+    return 0;
+}
+
+void ble_set_link_profile_auto(bool enable)
+{
+    atomic_set(&link_profile_auto, enable);
+    
+    if (enable && atomic_get(&current_state) == BLE_CONNECTED) {
+        link_activity();
+    }
+}
+
+bool ble_is_link_profile_auto(void)
+{
+    return atomic_get(&link_profile_auto);
+}
+
+enum ble_link_profile ble_get_link_profile(void)
+{
+    return (enum ble_link_profile)atomic_get(&link_profile);
+}
+
+const char *ble_link_profile_name(enum ble_link_profile profile)
+{
+    return profile < BLE_PROFILE_COUNT ? profile_names[profile] : "?";
+}
+
+int ble_request_netcore_sleep(uint8_t mode, uint32_t duration_ms)
+{
+    struct ipc_sleep_req req = {
+        .mode = mode,
+        .duration_ms = sys_cpu_to_le32(duration_ms),
+    };
+    
+    if (!ble_initialized) {
+        return -EACCES;
+    }
+    
+    return send_ipc_message(0, IPC_MSG_SLEEP, (const uint8_t *)&req, sizeof(req));
+}
+
+int ble_send_bulk(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    if (!ble_initialized) {
+        return -EACCES;
+    }
+    
+    if (conn_id >= BLE_MAX_CONNECTIONS) {
+        return -EINVAL;
+    }
+    
+    return send_ipc_message(conn_id, IPC_MSG_BULK, data, len);
+}
+
+int ble_link_protect(uint8_t conn_id, const struct ble_prot_session *session)
+{
+    if (!ble_initialized) {
+        return -EACCES;
+    }
+    
+    if (conn_id >= BLE_MAX_CONNECTIONS || !session) {
+        return -EINVAL;
+    }
+    
+    if (!conns[conn_id].connected) {
+        return -ENOTCONN;
+    }
+    
+    struct ble_conn *conn = &conns[conn_id];
+    
+    /* Everything already queued still goes out under the old session */
+    k_spinlock_key_t key = k_spin_lock(&tx_lock);
+    conn->tx_next = *session;
+    conn->tx_next_pending = true;
+    conn->tx_pending_bytes = ring_buf_size_get(&tx_queues[conn_id].ring);
+    k_spin_unlock(&tx_lock, key);
+    
+    conn->rx_next = *session;
+    atomic_set_bit(rx_next_pending, conn_id);
+    
+    LOG_INF("Connection %u protection: %s", conn_id, ble_prot_mode_name(session->mode));
+    
+    k_work_submit_to_queue(&ble_tx_workq, &tx_work);
+    return 0;
+}
+
+int ble_get_link_protection(uint8_t conn_id)
+{
+    if (conn_id >= BLE_MAX_CONNECTIONS) {
+        return -EINVAL;
+    }
+    
+    struct ble_conn *conn = &conns[conn_id];
+    k_spinlock_key_t key = k_spin_lock(&tx_lock);
+    int mode = conn->tx_next_pending ? conn->tx_next.mode : conn->tx_prot.mode;
+    k_spin_unlock(&tx_lock, key);
+    
+    return mode;
 }
 
 bool ble_is_ipc_ready(void)
@@ -282,5 +1372,33 @@ int ble_test_ipc_communication(void)
     }
 
     const char *test_msg = "IPC Test from App Core";
-    return send_ipc_message(IPC_MSG_TEST, (const uint8_t *)test_msg, strlen(test_msg));
-}
\ No newline at end of file
+    return send_ipc_message(0, IPC_MSG_TEST, (const uint8_t *)test_msg, strlen(test_msg));
+}
+
+#if BLE_IPC_LOOPBACK
+void ble_loopback_set_sink(ble_loopback_sink_t sink)
+{
+    loopback_sink = sink;
+}
+
+int ble_loopback_inject(uint8_t conn_id, uint8_t type, const uint8_t *data, uint16_t len)
+{
+    uint8_t frame[BLE_IPC_MAX_FRAME];
+    struct ipc_msg_hdr *hdr = (struct ipc_msg_hdr *)frame;
+    
+    if (len > BLE_IPC_MAX_PAYLOAD) {
+        return -EINVAL;
+    }
+    
+    hdr->type = type;
+    hdr->conn_id = conn_id;
+    hdr->len = sys_cpu_to_le16(len);
+    
+    if (data && len > 0) {
+        memcpy(frame + sizeof(*hdr), data, len);
+    }
+    
+    ipc_endpoint_received(frame, sizeof(*hdr) + len, NULL);
+    return 0;
+}
+#endif
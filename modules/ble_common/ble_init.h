@@ -20,10 +20,99 @@
 
 #include <zephyr/types.h>
 
+struct k_poll_signal;
+struct ble_prot_session;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** @brief Simultaneous connections supported, at most CONFIG_BT_MAX_CONN of the network core */
+#ifndef BLE_MAX_CONNECTIONS
+#define BLE_MAX_CONNECTIONS 2
+#endif
+
+/** @brief Connection ID that addresses every connected peer */
+#define BLE_CONN_ID_ALL 0xFF
+
+/** @brief Size of each queued TX ring buffer in bytes, one per connection plus one for all */
+#ifndef BLE_TX_RING_SIZE
+#define BLE_TX_RING_SIZE 1024
+#endif
+
+/**
+ * @brief Payload sent to the network core per IPC frame until link info arrives
+ *
+ * Once the network core reports the negotiated MTU and data length
+ * (IPC_MSG_LINK_INFO) frames are sized to fill whole LL packets instead.
+ */
+#ifndef BLE_TX_CHUNK_SIZE
+#define BLE_TX_CHUNK_SIZE 120
+#endif
+
+/** @brief Stack size of the TX work queue thread */
+#ifndef BLE_TX_STACK_SIZE
+#define BLE_TX_STACK_SIZE 1024
+#endif
+
+/** @brief Priority of the TX work queue thread */
+#ifndef BLE_TX_PRIORITY
+#define BLE_TX_PRIORITY K_PRIO_PREEMPT(4)
+#endif
+
+/** @brief How long ble_send_data() waits for TX ring space */
+#ifndef BLE_TX_TIMEOUT_MS
+#define BLE_TX_TIMEOUT_MS 1000
+#endif
+
+/** @brief Per-frame pacing used when the network core does not send credits */
+#ifndef BLE_TX_LEGACY_PACING_MS
+#define BLE_TX_LEGACY_PACING_MS 10
+#endif
+
+/** @brief Default fast advertising interval after boot or disconnect */
+#ifndef BLE_ADV_FAST_INTERVAL_MS
+#define BLE_ADV_FAST_INTERVAL_MS 30
+#endif
+
+/** @brief Default time spent fast advertising before backing off */
+#ifndef BLE_ADV_FAST_DURATION_S
+#define BLE_ADV_FAST_DURATION_S 30
+#endif
+
+/** @brief Quiet time after which the automatic policy drops to low power */
+#ifndef BLE_PROFILE_IDLE_TIMEOUT_MS
+#define BLE_PROFILE_IDLE_TIMEOUT_MS 5000
+#endif
+
+/**
+ * @brief Replace the IPC service with an in-memory loopback
+ *
+ * For host builds (e.g. native_sim) and benchmarks. No network core or
+ * ipc0 node is needed: every frame sent is consumed locally and answered
+ * with a TX credit, data frames are handed to the ble_loopback_set_sink()
+ * sink, and ble_loopback_inject() delivers frames as if the network core
+ * had sent them. Zero-copy TX buffers are not available.
+ */
+#ifndef BLE_IPC_LOOPBACK
+#define BLE_IPC_LOOPBACK 0
+#endif
+
+/**
+ * @brief Register the IPC endpoint from SYS_INIT instead of ble_init()
+ *
+ * The network core then binds while the rest of the application starts,
+ * and ble_init() can request advertising right away.
+ */
+#ifndef BLE_IPC_EARLY_REGISTER
+#define BLE_IPC_EARLY_REGISTER 1
+#endif
+
+/** @brief APPLICATION level SYS_INIT priority of the early registration */
+#ifndef BLE_IPC_INIT_PRIORITY
+#define BLE_IPC_INIT_PRIORITY 10
+#endif
+
 /** @brief BLE initialization status codes */
 enum ble_init_status {
     BLE_INIT_STATUS_SUCCESS = 0,
@@ -41,14 +130,35 @@ enum ble_connection_state {
     BLE_IPC_ERROR,
 };
 
+/**
+ * @brief Connection parameter profiles
+ *
+ * With the automatic policy (the default) a connection starts in
+ * BLE_PROFILE_LOW_LATENCY, stays there while data is being received and
+ * drops to BLE_PROFILE_LOW_POWER after BLE_PROFILE_IDLE_TIMEOUT_MS without
+ * any. Setting a profile with ble_set_link_profile() turns the policy off.
+ */
+enum ble_link_profile {
+    BLE_PROFILE_LOW_LATENCY = 0,    /* 7.5-15 ms interval, no latency, 2M PHY */
+    BLE_PROFILE_BALANCED,           /* 30-50 ms interval, no latency */
+    BLE_PROFILE_LOW_POWER,          /* 100-200 ms interval, peripheral latency 4 */
+    BLE_PROFILE_COUNT,
+};
+
 /** @brief BLE initialization configuration for nRF5340 app core */
 struct ble_init_config {
     /** Device name for advertising (max 29 characters) */
     const char *device_name;
     
-    /** Advertising interval in milliseconds (20-10240 ms) */
+    /** Slow advertising interval in milliseconds (20-10240 ms) */
     uint16_t adv_interval_ms;
     
+    /** Fast advertising interval after boot or disconnect, 0 for BLE_ADV_FAST_INTERVAL_MS */
+    uint16_t adv_fast_interval_ms;
+    
+    /** Time to advertise fast before backing off, 0 for BLE_ADV_FAST_DURATION_S */
+    uint16_t adv_fast_duration_s;
+    
     /** Whether to enable connectable advertising */
     bool connectable;
     
@@ -56,29 +166,70 @@ struct ble_init_config {
     bool enable_uart_service;
 };
 
+/** @brief Negotiated link parameters reported by the network core */
+struct ble_link_info {
+    uint16_t mtu;               /* ATT MTU, 0 if not reported */
+    uint16_t tx_octets;         /* LL maximum TX payload, 0 if not reported */
+    uint8_t phy;                /* TX PHY, BLE_IPC_PHY_* bit, 0 if not reported */
+    uint16_t chunk_size;        /* Payload bytes sent per IPC frame */
+};
+
+/** @brief Peer status published by the network core in shared memory */
+struct ble_peer_status {
+    enum ble_connection_state state;
+    int8_t rssi;                /* dBm, BLE_IPC_RSSI_UNKNOWN if not measured */
+    uint8_t phy;                /* TX PHY, BLE_IPC_PHY_* bit */
+    uint16_t mtu;               /* ATT MTU */
+    uint16_t tx_octets;         /* LL maximum TX payload */
+    uint32_t interval_us;       /* Connection interval */
+    uint16_t latency;           /* Peripheral latency in connection events */
+    uint16_t timeout_ms;        /* Supervision timeout */
+    uint32_t tx_notifications;  /* Notifications sent since connecting */
+    uint32_t rx_writes;         /* Writes received since connecting */
+};
+
 /** @brief BLE event callbacks */
 struct ble_event_callbacks {
     /** @brief Called when BLE IPC communication is ready */
     void (*ready)(void);
     
-    /** @brief Called when a device connects (simulated) */
-    void (*connected)(void);
+    /** @brief Called when a device connects, @p conn_id is below BLE_MAX_CONNECTIONS */
+    void (*connected)(uint8_t conn_id);
     
-    /** @brief Called when a device disconnects (simulated) */
-    void (*disconnected)(uint8_t reason);
+    /** @brief Called when a device disconnects */
+    void (*disconnected)(uint8_t conn_id, uint8_t reason);
     
     /** @brief Called when data is received via IPC from network core */
-    void (*data_received)(const uint8_t *data, uint16_t len);
+    void (*data_received)(uint8_t conn_id, const uint8_t *data, uint16_t len);
+    
+    /** @brief Called with every IPC_MSG_BULK frame, from the IPC receive callback */
+    void (*bulk_received)(uint8_t conn_id, const uint8_t *data, uint16_t len);
     
-    /** @brief Called when data transmission is complete */
+    /**
+     * @brief Called when all queued data has been handed to the network core
+     *
+     * Runs on the TX work queue, so it must not block on ble_send_data().
+     */
     void (*data_sent)(void);
 };
 
+/**
+ * @brief Start the TX pipeline and register the IPC endpoint
+ *
+ * Runs from SYS_INIT with BLE_IPC_EARLY_REGISTER, otherwise from
+ * ble_init(). Calling it again after it succeeded does nothing.
+ *
+ * @return BLE_INIT_STATUS_SUCCESS on success, negative error code otherwise
+ */
+int ble_ipc_register(void);
+
 /**
  * @brief Initialize BLE communication via IPC with network core
  *
  * This function sets up IPC communication with the network core
- * which should be running BLE stack firmware.
+ * which should be running BLE stack firmware. Advertising is requested
+ * as soon as both this has been called and the endpoint is bound,
+ * whichever happens last.
  *
  * @param config Configuration for BLE initialization
  * @param callbacks Event callbacks (can be NULL)
@@ -88,7 +239,9 @@ struct ble_event_callbacks {
 int ble_init(const struct ble_init_config *config, const struct ble_event_callbacks *callbacks);
 
 /**
- * @brief Send data to network core for BLE transmission
+ * @brief Send data to every connected peer
+ *
+ * Same as ble_send_data_to() with BLE_CONN_ID_ALL.
  *
  * @param data Data buffer to send
  * @param len Length of data
@@ -97,13 +250,249 @@ int ble_init(const struct ble_init_config *config, const struct ble_event_callba
  */
 int ble_send_data(const uint8_t *data, uint16_t len);
 
+/**
+ * @brief Send data to one connection via the network core
+ *
+ * Copies the data into the TX ring of the connection and returns once all
+ * of it is queued. Only blocks while the ring is full, up to
+ * BLE_TX_TIMEOUT_MS. Rings are drained round robin, so a busy connection
+ * does not starve the others.
+ *
+ * @param conn_id Connection, or BLE_CONN_ID_ALL for every connected peer
+ * @param data Data buffer to send
+ * @param len Length of data
+ *
+ * @return 0 on success, -ENOTCONN if @p conn_id is not connected, other
+ *         negative error code otherwise
+ */
+int ble_send_data_to(uint8_t conn_id, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Queue data for every connected peer without blocking
+ *
+ * The data is either queued in full or not at all. Completion is reported
+ * through the data_sent callback once the TX ring has drained.
+ *
+ * @param data Data buffer to send
+ * @param len Length of data
+ *
+ * @return 0 on success, -ENOMEM if the TX ring lacks space, other negative
+ *         error code otherwise
+ */
+int ble_send_data_async(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Borrow a TX buffer directly from IPC shared memory
+ *
+ * Lets callers format data in place instead of copying it through
+ * ble_send_data(). The buffer must be handed back with either
+ * ble_tx_buf_send() or ble_tx_buf_release(). Does not block; callers
+ * should fall back to ble_send_data() on failure, since not every IPC
+ * backend supports no-copy buffers and the call fails with -EBUSY while
+ * queued data for the same connection is still waiting, to keep output in
+ * order. A borrowed buffer holds one TX credit until it is sent or
+ * released, so hand it back promptly.
+ *
+ * @param conn_id Connection the buffer will be sent to, or BLE_CONN_ID_ALL
+ * @param buf Set to the start of the payload area on success
+ * @param size In: minimum payload size needed. Out: usable payload size
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int ble_tx_buf_get(uint8_t conn_id, uint8_t **buf, uint16_t *size);
+
+/**
+ * @brief Send a buffer obtained with ble_tx_buf_get()
+ *
+ * Ownership of the buffer passes to the IPC backend, also on failure.
+ *
+ * @param buf Payload pointer returned by ble_tx_buf_get()
+ * @param len Number of payload bytes written, at most the size ble_tx_buf_get() returned
+ *
+ * @return 0 on success, -EINVAL if @p len exceeds the buffer, negative error
+ *         code otherwise
+ */
+int ble_tx_buf_send(uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Return a buffer obtained with ble_tx_buf_get() without sending it
+ *
+ * @param buf Payload pointer returned by ble_tx_buf_get()
+ */
+void ble_tx_buf_release(uint8_t *buf);
+
 /**
  * @brief Get current connection state (simulated based on IPC)
  *
- * @return Current BLE connection state
+ * @return BLE_CONNECTED while at least one peer is connected, otherwise
+ *         the last state the network core reported
  */
 enum ble_connection_state ble_get_connection_state(void);
 
+/**
+ * @brief Get the number of connected peers
+ *
+ * @return Connections currently up
+ */
+uint8_t ble_get_connection_count(void);
+
+/**
+ * @brief Check if a connection is up
+ *
+ * @param conn_id Connection
+ *
+ * @return true if @p conn_id is connected
+ */
+bool ble_is_connected(uint8_t conn_id);
+
+/**
+ * @brief Get the signal raised on every connection state change
+ *
+ * The signal result is the new enum ble_connection_state. Lets threads
+ * sleep in k_poll() until the link changes instead of polling
+ * ble_get_connection_state(). Waiters should reset the signal before
+ * reading the state, since several changes may coalesce into one wakeup.
+ * Requires CONFIG_POLL.
+ *
+ * @return Connection state signal
+ */
+struct k_poll_signal *ble_get_state_signal(void);
+
+/**
+ * @brief Get the negotiated link parameters of a connection
+ *
+ * @param conn_id Connection
+ * @param info Filled with the current link parameters
+ *
+ * @return 0 on success, -EINVAL if @p conn_id is out of range
+ */
+int ble_get_link_info(uint8_t conn_id, struct ble_link_info *info);
+
+/**
+ * @brief Read a peer's status from the shared link status block
+ *
+ * A plain memory read, no IPC round trip, so cheap enough to call on
+ * every status report. Needs a network core that publishes
+ * struct ipc_link_status and the link_status_shm devicetree node.
+ *
+ * @param conn_id Connection
+ * @param status Filled with a consistent snapshot
+ *
+ * @return 0 on success, -EINVAL if @p conn_id is out of range, -ENODATA if
+ *         the block is not published (use ble_get_link_info()), -EAGAIN if
+ *         the network core kept updating it while reading
+ */
+int ble_get_peer_status(uint8_t conn_id, struct ble_peer_status *status);
+
+/**
+ * @brief Get the payload size that fills whole LL packets
+ *
+ * Writers that flush on their own, like the command parser, should cut
+ * their output at this size so every notification goes out full.
+ *
+ * @param conn_id Connection, or BLE_CONN_ID_ALL for the smallest of all
+ *                connected peers
+ *
+ * @return Bytes per IPC frame, BLE_TX_CHUNK_SIZE until the link is known
+ */
+uint16_t ble_get_tx_chunk_size(uint8_t conn_id);
+
+/**
+ * @brief Use a fixed connection parameter profile
+ *
+ * Turns the automatic policy off. Applies to all connections, right away
+ * to those already up.
+ *
+ * @param profile Profile to use
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int ble_set_link_profile(enum ble_link_profile profile);
+
+/**
+ * @brief Turn the automatic profile policy on or off
+ *
+ * @param enable true to follow link activity, false to keep the current profile
+ */
+void ble_set_link_profile_auto(bool enable);
+
+/**
+ * @brief Check if the automatic profile policy is on
+ *
+ * @return true if profiles follow link activity
+ */
+bool ble_is_link_profile_auto(void);
+
+/**
+ * @brief Get the profile currently selected
+ *
+ * @return Selected profile
+ */
+enum ble_link_profile ble_get_link_profile(void);
+
+/**
+ * @brief Get the name of a profile
+ *
+ * @param profile Profile
+ *
+ * @return "fast", "balanced", "lowpower", or "?" if out of range
+ */
+const char *ble_link_profile_name(enum ble_link_profile profile);
+
+/**
+ * @brief Tell the network core about application core sleep
+ *
+ * Sends IPC_MSG_SLEEP, see enum ble_ipc_sleep_mode in ble_ipc_proto.h.
+ *
+ * @param mode Sleep mode (enum ble_ipc_sleep_mode)
+ * @param duration_ms Expected sleep time, 0 if unknown
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int ble_request_netcore_sleep(uint8_t mode, uint32_t duration_ms);
+
+/**
+ * @brief Send a bulk transfer frame to one peer
+ *
+ * Bypasses the TX rings and does not take a TX credit, so acknowledgements
+ * are not stuck behind queued command output.
+ *
+ * @param conn_id Connection ID, below BLE_MAX_CONNECTIONS
+ * @param data Frame, see modules/bulk/bulk.h
+ * @param len Frame length, at most BLE_IPC_MAX_PAYLOAD
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int ble_send_bulk(uint8_t conn_id, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Switch the protection of a connection's NUS data
+ *
+ * Data already queued for the connection is sent under the old session,
+ * everything queued afterwards is sealed with @p session. Data received
+ * from the next frame on must be sealed by the peer. Zero-copy buffers
+ * (ble_tx_buf_get()) are refused while a connection is protected.
+ * Protection ends when the connection drops.
+ *
+ * @param conn_id Connection ID, below BLE_MAX_CONNECTIONS
+ * @param session Session from ble_prot_session_init(), copied; BLE_PROT_OFF
+ *                turns protection off
+ *
+ * @return 0 on success, -ENOTCONN if the connection is down, negative error
+ *         code otherwise
+ */
+int ble_link_protect(uint8_t conn_id, const struct ble_prot_session *session);
+
+/**
+ * @brief Get the protection mode of a connection's NUS data
+ *
+ * @param conn_id Connection ID
+ *
+ * @return enum ble_prot_mode, including a switch still waiting for queued
+ *         data, or -EINVAL if @p conn_id is out of range
+ */
+int ble_get_link_protection(uint8_t conn_id);
+
 /**
  * @brief Check if BLE IPC communication is working
  *
@@ -118,6 +507,42 @@ bool ble_is_ipc_ready(void);
  */
 int ble_test_ipc_communication(void);
 
+/**
+ * @brief Loopback receiver for data the application sends
+ *
+ * Runs on the TX work queue once per chunk, like the network core would
+ * receive it.
+ *
+ * @param conn_id Addressed connection, or BLE_CONN_ID_ALL
+ * @param data Chunk data
+ * @param len Chunk length
+ */
+typedef void (*ble_loopback_sink_t)(uint8_t conn_id, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Set the receiver of sent data, only with BLE_IPC_LOOPBACK
+ *
+ * @param sink Called for every data chunk, NULL to discard data
+ */
+void ble_loopback_set_sink(ble_loopback_sink_t sink);
+
+/**
+ * @brief Deliver a frame as if it came from the network core, only with
+ *        BLE_IPC_LOOPBACK
+ *
+ * Handled synchronously in the caller's context, e.g.
+ * IPC_MSG_CONNECTION_STATE to simulate a connection or
+ * IPC_MSG_DATA_RECEIVED for incoming data.
+ *
+ * @param conn_id Connection ID for the frame header
+ * @param type Message type (enum ipc_msg_type)
+ * @param data Payload, may be NULL if @p len is 0
+ * @param len Payload length, at most BLE_IPC_MAX_PAYLOAD
+ *
+ * @return 0 on success, -EINVAL if the payload is too long
+ */
+int ble_loopback_inject(uint8_t conn_id, uint8_t type, const uint8_t *data, uint16_t len);
+
 #ifdef __cplusplus
 }
 #endif
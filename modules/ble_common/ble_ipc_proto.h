@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BLE_IPC_PROTO_H_
+#define BLE_IPC_PROTO_H_
+
+/**
+ * @file
+ * @brief IPC wire format shared between the nRF5340 application and network cores
+ *
+ * Every IPC message is a fixed header followed by a variable-length payload.
+ * Only sizeof(struct ipc_msg_hdr) + len bytes are sent, so short status
+ * messages do not carry the full maximum payload across shared memory.
+ *
+ * Network core firmware must use the same framing. All multi-byte fields
+ * are little-endian.
+ *
+ * The header names the BLE connection a message belongs to. The network
+ * core numbers its connections 0..n-1 (bt_conn_index()), and SEND_DATA
+ * to BLE_IPC_CONN_ALL is notified to every subscribed peer. Messages not
+ * about a connection carry 0, which is also what network cores that only
+ * support one connection send and expect.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/barrier.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum payload carried by a single IPC message
+ *
+ * Large enough for a full command response in one zero-copy frame. The
+ * network core segments IPC_MSG_SEND_DATA payloads to the negotiated MTU.
+ */
+#define BLE_IPC_MAX_PAYLOAD 256
+
+/** @brief Message types for IPC communication */
+enum ipc_msg_type {
+    IPC_MSG_INIT = 1,
+    IPC_MSG_SEND_DATA = 2,
+    IPC_MSG_CONNECTION_STATE = 3,
+    IPC_MSG_DATA_RECEIVED = 4,
+    IPC_MSG_TEST = 5,
+    IPC_MSG_TX_CREDITS = 6,
+    IPC_MSG_SLEEP = 7,
+    IPC_MSG_ADV_PARAMS = 8,
+    IPC_MSG_CONN_PARAMS = 9,
+    IPC_MSG_LINK_INFO = 10,
+    IPC_MSG_BULK = 11,
+};
+
+/**
+ * @brief Sealed payload flag, OR-ed into the type of IPC_MSG_SEND_DATA
+ *
+ * The payload is a sealed frame (see ble_prot.h) that already fits the
+ * connection's chunk size. The network core must notify it in one piece
+ * and never segment it, or the peer cannot check it.
+ */
+#define IPC_MSG_FLAG_PROTECTED 0x80
+
+/**
+ * @brief TX flow control
+ *
+ * The application core may have at most BLE_IPC_TX_INITIAL_CREDITS
+ * IPC_MSG_SEND_DATA frames outstanding after the endpoint binds. The
+ * network core returns credits with IPC_MSG_TX_CREDITS (payload: one
+ * uint8_t credit count) as it finishes transmitting each frame; a network
+ * core streaming with bt_nus_send_queued() can return them from the NUS
+ * low-water callback. Network cores that never send credits are paced
+ * with a fixed per-frame delay.
+ */
+#define BLE_IPC_TX_INITIAL_CREDITS 4
+
+/**
+ * @brief Power coordination
+ *
+ * IPC_MSG_SLEEP payload: struct ipc_sleep_req. The application core sends
+ * it before it sleeps, so the network core can stretch its own activity
+ * to match, and BLE_IPC_SLEEP_WAKE once it is running again. BLE data from
+ * the network core always wakes the application core.
+ */
+enum ble_ipc_sleep_mode {
+    BLE_IPC_SLEEP_WAKE = 0,     /* Application core running again */
+    BLE_IPC_SLEEP_IDLE = 1,     /* Keep the link, use the longest intervals allowed */
+    BLE_IPC_SLEEP_OFF = 2,      /* Disconnect, stop advertising and power down */
+};
+
+/** @brief IPC_MSG_SLEEP payload */
+struct ipc_sleep_req {
+    uint8_t mode;           /* enum ble_ipc_sleep_mode */
+    uint32_t duration_ms;   /* Expected sleep time, 0 if unknown */
+} __packed;
+
+/**
+ * @brief Link profiles
+ *
+ * The application core owns the advertising and connection parameter
+ * policy and pushes it to the network core. IPC_MSG_ADV_PARAMS (payload:
+ * struct ipc_adv_params) restarts advertising with a new interval while
+ * connection slots are free. IPC_MSG_CONN_PARAMS (payload: struct
+ * ipc_conn_params) asks the network core to request new connection
+ * parameters and PHY from the central of the connection in the header;
+ * the central may reject or adjust them.
+ */
+struct ipc_adv_params {
+    uint16_t interval_ms;   /* Advertising interval */
+    uint8_t connectable;    /* Non-zero for connectable advertising */
+} __packed;
+
+/** @brief PHY preference bits in struct ipc_conn_params, as BT_GAP_LE_PHY_* */
+#define BLE_IPC_PHY_1M BIT(0)
+#define BLE_IPC_PHY_2M BIT(1)
+#define BLE_IPC_PHY_CODED BIT(2)
+
+/** @brief IPC_MSG_CONN_PARAMS payload */
+struct ipc_conn_params {
+    uint16_t interval_min;  /* Connection interval, 1.25 ms units */
+    uint16_t interval_max;  /* Connection interval, 1.25 ms units */
+    uint16_t latency;       /* Peripheral latency in connection events */
+    uint16_t timeout;       /* Supervision timeout, 10 ms units */
+    uint8_t phy;            /* Preferred PHYs, BLE_IPC_PHY_* bits */
+} __packed;
+
+/**
+ * @brief Negotiated link parameters
+ *
+ * The network core sends IPC_MSG_LINK_INFO (payload: struct ipc_link_info)
+ * for each connection after connecting and whenever its ATT MTU, LL data
+ * length or PHY changes, so the application core can size
+ * IPC_MSG_SEND_DATA payloads to fill whole LL packets. Until then, and
+ * after a disconnect, the application core uses its configured default
+ * chunk size.
+ */
+struct ipc_link_info {
+    uint16_t mtu;           /* ATT MTU */
+    uint16_t tx_octets;     /* LL maximum TX payload (data length), 27-251 */
+    uint8_t phy;            /* TX PHY, one BLE_IPC_PHY_* bit */
+} __packed;
+
+/**
+ * @brief Shared link status block
+ *
+ * The network core publishes the state of every connection in a block of
+ * shared SRAM (the link_status_shm reserved memory node, at the same
+ * address for both cores), so the application core can read RSSI, PHY,
+ * MTU and connection parameters without an IPC round trip. The index
+ * into conn[] is the connection ID used in IPC headers.
+ *
+ * The network core is the only writer. It brackets every update with
+ * ble_ipc_link_status_write_begin() and ble_ipc_link_status_write_end(),
+ * which leave seq odd while fields are changing. Readers take a copy and
+ * retry if seq was odd or changed while copying. magic is set once the
+ * block has been initialised; any other value means no network core
+ * publishes it and the application core falls back to IPC_MSG_LINK_INFO.
+ *
+ * Unlike the IPC messages the block is not packed, so seq and the
+ * counters are naturally aligned words.
+ */
+#define BLE_IPC_LINK_STATUS_MAGIC 0x314B4E4C   /* "LNK1" */
+
+/** @brief Connections in the status block */
+#define BLE_IPC_LINK_STATUS_CONNS 4
+
+/** @brief RSSI of a connection that has not been measured */
+#define BLE_IPC_RSSI_UNKNOWN 127
+
+/** @brief Status of one connection in struct ipc_link_status */
+struct ipc_link_status_conn {
+    uint8_t state;              /* Same values as IPC_MSG_CONNECTION_STATE */
+    int8_t rssi;                /* dBm, BLE_IPC_RSSI_UNKNOWN if not measured */
+    uint8_t phy;                /* TX PHY, one BLE_IPC_PHY_* bit */
+    uint8_t reserved;
+    uint16_t mtu;               /* ATT MTU */
+    uint16_t tx_octets;         /* LL maximum TX payload */
+    uint16_t interval;          /* Connection interval, 1.25 ms units */
+    uint16_t latency;           /* Peripheral latency in connection events */
+    uint16_t timeout;           /* Supervision timeout, 10 ms units */
+    uint16_t reserved2;
+    uint32_t tx_notifications;  /* Notifications sent since connecting */
+    uint32_t rx_writes;         /* Writes received since connecting */
+};
+
+/** @brief Link status block in shared memory */
+struct ipc_link_status {
+    uint32_t magic;             /* BLE_IPC_LINK_STATUS_MAGIC once initialised */
+    uint32_t seq;               /* Odd while the network core is writing */
+    uint32_t updated_ms;        /* Network core uptime of the last update */
+    struct ipc_link_status_conn conn[BLE_IPC_LINK_STATUS_CONNS];
+};
+
+BUILD_ASSERT(sizeof(struct ipc_link_status_conn) == 24, "Shared layout must not change");
+
+/** @brief Start updating the status block, network core only */
+static inline void ble_ipc_link_status_write_begin(volatile struct ipc_link_status *status)
+{
+    status->seq = status->seq + 1;
+    barrier_dmem_fence_full();
+}
+
+/** @brief Finish updating the status block, network core only */
+static inline void ble_ipc_link_status_write_end(volatile struct ipc_link_status *status)
+{
+    barrier_dmem_fence_full();
+    status->seq = status->seq + 1;
+}
+
+/** @brief L2CAP (4) and ATT notification (3) header bytes in front of NUS data */
+#define BLE_IPC_NOTIFY_OVERHEAD 7
+
+/**
+ * @brief Largest notification payload that fills whole LL packets
+ *
+ * Picks the largest length up to @p mtu - 3 and @p limit for which the
+ * notification with its L2CAP and ATT headers is an exact multiple of
+ * @p tx_octets, e.g. 244 for MTU 247 with 251 byte data length. Falls back
+ * to the plain MTU limit when not even one full LL packet fits.
+ *
+ * @param mtu ATT MTU
+ * @param tx_octets LL maximum TX payload, 0 if unknown
+ * @param limit Upper bound, e.g. the IPC payload size
+ *
+ * @return Chunk size in bytes
+ */
+static inline uint16_t ble_ipc_fill_chunk(uint16_t mtu, uint16_t tx_octets, uint16_t limit)
+{
+    uint16_t max = MIN(mtu - 3, limit);
+
+    if (tx_octets > BLE_IPC_NOTIFY_OVERHEAD && max + BLE_IPC_NOTIFY_OVERHEAD >= tx_octets) {
+        return ((max + BLE_IPC_NOTIFY_OVERHEAD) / tx_octets) * tx_octets -
+               BLE_IPC_NOTIFY_OVERHEAD;
+    }
+
+    return max;
+}
+
+/**
+ * @brief Bulk transfer channel
+ *
+ * NUS writes starting with BLE_IPC_BULK_SYNC are bulk transfer frames
+ * (see modules/bulk/bulk.h), not command input. The network core forwards
+ * them unchanged as IPC_MSG_BULK instead of IPC_MSG_DATA_RECEIVED, and
+ * notifies IPC_MSG_BULK payloads from the application core to the peer
+ * in the header like IPC_MSG_SEND_DATA, without taking a TX credit. Text
+ * commands never contain this byte and binary command frames start with
+ * CMD_BIN_SYNC.
+ */
+#define BLE_IPC_BULK_SYNC 0xB6
+
+/** @brief Connection ID addressing all connections */
+#define BLE_IPC_CONN_ALL 0xFF
+
+/** @brief IPC message header, followed by @p len payload bytes */
+struct ipc_msg_hdr {
+    uint8_t type;       /* enum ipc_msg_type */
+    uint8_t conn_id;    /* Connection index, BLE_IPC_CONN_ALL or 0 */
+    uint16_t len;       /* Payload length in bytes */
+} __packed;
+
+/** @brief Size of the largest possible IPC frame */
+#define BLE_IPC_MAX_FRAME (sizeof(struct ipc_msg_hdr) + BLE_IPC_MAX_PAYLOAD)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLE_IPC_PROTO_H_ */
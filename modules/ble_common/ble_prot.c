@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ble_prot.h"
+#include "../perf/perf.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#if BLE_PROT_CCM_ENABLE
+#include <psa/crypto.h>
+#endif
+
+LOG_MODULE_REGISTER(ble_prot, LOG_LEVEL_INF);
+
+#define NONCE_LEN (BLE_PROT_SALT_LEN + 1 + sizeof(uint32_t))
+
+#if BLE_PROT_CCM_ENABLE
+#define CCM_ALG PSA_ALG_AEAD_WITH_SHORTENED_TAG(PSA_ALG_CCM, BLE_PROT_TAG_LEN)
+
+static psa_key_id_t key_id;
+static K_MUTEX_DEFINE(key_lock);
+
+static int import_key(const uint8_t key[BLE_PROT_KEY_LEN])
+{
+    psa_key_attributes_t attr = PSA_KEY_ATTRIBUTES_INIT;
+    psa_status_t status = psa_crypto_init();
+
+    if (status != PSA_SUCCESS) {
+        LOG_ERR("PSA crypto init failed (%d)", status);
+        return -EIO;
+    }
+
+    if (key_id) {
+        psa_destroy_key(key_id);
+        key_id = 0;
+    }
+
+    psa_set_key_usage_flags(&attr, PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT);
+    psa_set_key_algorithm(&attr, CCM_ALG);
+    psa_set_key_type(&attr, PSA_KEY_TYPE_AES);
+    psa_set_key_bits(&attr, BLE_PROT_KEY_LEN * 8);
+
+    status = psa_import_key(&attr, key, BLE_PROT_KEY_LEN, &key_id);
+    if (status != PSA_SUCCESS) {
+        LOG_ERR("Failed to import protection key (%d)", status);
+        key_id = 0;
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static bool have_key(void)
+{
+#ifdef BLE_PROT_KEY
+    static const uint8_t default_key[BLE_PROT_KEY_LEN] = { BLE_PROT_KEY };
+
+    k_mutex_lock(&key_lock, K_FOREVER);
+    if (!key_id) {
+        import_key(default_key);
+    }
+    k_mutex_unlock(&key_lock);
+#endif
+
+    return key_id != 0;
+}
+
+static void make_nonce(uint8_t nonce[NONCE_LEN], const struct ble_prot_session *session,
+                       uint8_t dir, uint32_t counter)
+{
+    memcpy(nonce, session->salt, BLE_PROT_SALT_LEN);
+    nonce[BLE_PROT_SALT_LEN] = dir;
+    sys_put_le32(counter, nonce + BLE_PROT_SALT_LEN + 1);
+}
+#endif /* BLE_PROT_CCM_ENABLE */
+
+int ble_prot_set_key(const uint8_t key[BLE_PROT_KEY_LEN])
+{
+#if BLE_PROT_CCM_ENABLE
+    k_mutex_lock(&key_lock, K_FOREVER);
+    int err = import_key(key);
+    k_mutex_unlock(&key_lock);
+
+    return err;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+int ble_prot_session_init(struct ble_prot_session *session, enum ble_prot_mode mode)
+{
+    memset(session, 0, sizeof(*session));
+
+    switch (mode) {
+    case BLE_PROT_OFF:
+    case BLE_PROT_CRC:
+        break;
+
+    case BLE_PROT_CCM:
+#if BLE_PROT_CCM_ENABLE
+        if (!have_key()) {
+            return -ENOKEY;
+        }
+
+        /* Nonces must never repeat under one key, so every session gets a new salt */
+        if (psa_generate_random(session->salt, sizeof(session->salt)) != PSA_SUCCESS) {
+            return -EIO;
+        }
+        break;
+#else
+        return -ENOTSUP;
+#endif
+
+    default:
+        return -ENOTSUP;
+    }
+
+    session->mode = mode;
+    return 0;
+}
+
+static int seal_frame(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                      uint8_t *out, size_t size)
+{
+    struct ble_prot_hdr *hdr = (struct ble_prot_hdr *)out;
+    size_t total = len + BLE_PROT_OVERHEAD;
+
+    if (total > size) {
+        return -ENOSPC;
+    }
+
+    /* A wrapped counter would reuse nonces, the session must be started again */
+    if (session->counter == UINT32_MAX) {
+        return -EOVERFLOW;
+    }
+
+    session->counter++;
+    hdr->counter = sys_cpu_to_le32(session->counter);
+
+    if (session->mode == BLE_PROT_CRC) {
+        hdr->sync = BLE_PROT_SYNC_CRC;
+        memcpy(out + sizeof(*hdr), in, len);
+        sys_put_le32(crc32_ieee(out, sizeof(*hdr) + len), out + sizeof(*hdr) + len);
+    } else {
+#if BLE_PROT_CCM_ENABLE
+        uint8_t nonce[NONCE_LEN];
+        size_t out_len;
+
+        hdr->sync = BLE_PROT_SYNC_CCM;
+        make_nonce(nonce, session, BLE_PROT_DIR_TO_HOST, session->counter);
+
+        psa_status_t status = psa_aead_encrypt(key_id, CCM_ALG, nonce, sizeof(nonce),
+                                               out, sizeof(*hdr), in, len,
+                                               out + sizeof(*hdr), size - sizeof(*hdr),
+                                               &out_len);
+        if (status != PSA_SUCCESS) {
+            LOG_ERR("CCM encrypt failed (%d)", status);
+            return -EIO;
+        }
+#else
+        return -ENOTSUP;
+#endif
+    }
+
+    return total;
+}
+
+int ble_prot_seal(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                  uint8_t *out, size_t size)
+{
+    uint32_t start = perf_start();
+    int ret = seal_frame(session, in, len, out, size);
+
+    perf_stop(PERF_T_PROTECT, start);
+    if (ret >= 0) {
+        perf_inc(PERF_PROT_SEALED);
+    }
+
+    return ret;
+}
+
+static int open_frame(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                      uint8_t *out, size_t size)
+{
+    const struct ble_prot_hdr *hdr = (const struct ble_prot_hdr *)in;
+    uint8_t sync = session->mode == BLE_PROT_CCM ? BLE_PROT_SYNC_CCM : BLE_PROT_SYNC_CRC;
+
+    if (len < BLE_PROT_OVERHEAD || hdr->sync != sync) {
+        return -EBADMSG;
+    }
+
+    uint32_t counter = sys_le32_to_cpu(hdr->counter);
+    uint16_t plain_len = len - BLE_PROT_OVERHEAD;
+
+    if (counter <= session->counter) {
+        return -EALREADY;
+    }
+
+    if (plain_len > size) {
+        return -ENOSPC;
+    }
+
+    if (session->mode == BLE_PROT_CRC) {
+        if (crc32_ieee(in, len - BLE_PROT_TAG_LEN) != sys_get_le32(in + len - BLE_PROT_TAG_LEN)) {
+            return -EBADMSG;
+        }
+
+        memcpy(out, in + sizeof(*hdr), plain_len);
+    } else {
+#if BLE_PROT_CCM_ENABLE
+        uint8_t nonce[NONCE_LEN];
+        size_t out_len;
+
+        make_nonce(nonce, session, BLE_PROT_DIR_TO_DEVICE, counter);
+
+        psa_status_t status = psa_aead_decrypt(key_id, CCM_ALG, nonce, sizeof(nonce),
+                                               in, sizeof(*hdr), in + sizeof(*hdr),
+                                               len - sizeof(*hdr), out, size, &out_len);
+        if (status != PSA_SUCCESS) {
+            return -EBADMSG;
+        }
+#else
+        return -ENOTSUP;
+#endif
+    }
+
+    session->counter = counter;
+    return plain_len;
+}
+
+int ble_prot_open(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                  uint8_t *out, size_t size)
+{
+    uint32_t start = perf_start();
+    int ret = open_frame(session, in, len, out, size);
+
+    perf_stop(PERF_T_PROTECT, start);
+    if (ret == -EBADMSG || ret == -EALREADY) {
+        perf_inc(PERF_PROT_REJECTS);
+    }
+
+    return ret;
+}
+
+const char *ble_prot_mode_name(enum ble_prot_mode mode)
+{
+    switch (mode) {
+    case BLE_PROT_OFF: return "off";
+    case BLE_PROT_CRC: return "crc";
+    case BLE_PROT_CCM: return "ccm";
+    default: return "?";
+    }
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BLE_PROT_H_
+#define BLE_PROT_H_
+
+/**
+ * @file
+ * @brief Optional integrity and encryption of NUS payloads
+ *
+ * A protected connection carries sealed frames instead of plain data in
+ * both directions:
+ *
+ *   struct ble_prot_hdr | payload | tag (4 bytes)
+ *
+ * With BLE_PROT_CRC the payload is plain and the tag is the CRC-32 (IEEE)
+ * of header and payload. With BLE_PROT_CCM the payload is AES-128-CCM
+ * encrypted, the header is authenticated as associated data and the tag
+ * is the 4-byte CCM MIC. The 13-byte nonce is the 8-byte session salt,
+ * one direction byte (BLE_PROT_DIR_*) and the counter (LE). Counters
+ * start at 1 and must increase, so replayed frames are rejected.
+ *
+ * The 'secure <off|crc|ccm>' command starts a session and prints its
+ * salt. Data received after the command must be sealed; data sent is
+ * sealed from the first byte after the reply line. Sealing runs on the
+ * BLE TX work queue, one operation per IPC frame, so senders never wait
+ * for the crypto hardware.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Support BLE_PROT_CCM through PSA Crypto
+ *
+ * Needs CONFIG_NRF_SECURITY with the CryptoCell driver (or any PSA
+ * implementation) and a BLE_TX_STACK_SIZE of at least 2048.
+ */
+#ifndef BLE_PROT_CCM_ENABLE
+#define BLE_PROT_CCM_ENABLE 0
+#endif
+
+/** @brief Protection modes */
+enum ble_prot_mode {
+    BLE_PROT_OFF = 0,
+    BLE_PROT_CRC = 1,
+    BLE_PROT_CCM = 2,
+};
+
+/** @brief First byte of sealed frames, never the start of text or other framing */
+#define BLE_PROT_SYNC_CRC 0xC1
+#define BLE_PROT_SYNC_CCM 0xC2
+
+/** @brief Nonce direction bytes */
+#define BLE_PROT_DIR_TO_HOST 0x00
+#define BLE_PROT_DIR_TO_DEVICE 0x01
+
+#define BLE_PROT_SALT_LEN 8
+#define BLE_PROT_TAG_LEN 4
+
+/** @brief AES-128 key length */
+#define BLE_PROT_KEY_LEN 16
+
+/** @brief Sealed frame header, all fields little-endian */
+struct ble_prot_hdr {
+    uint8_t sync;       /* BLE_PROT_SYNC_CRC or BLE_PROT_SYNC_CCM */
+    uint32_t counter;   /* Per direction, starts at 1 */
+} __packed;
+
+/** @brief Bytes a sealed frame adds to its payload */
+#define BLE_PROT_OVERHEAD (sizeof(struct ble_prot_hdr) + BLE_PROT_TAG_LEN)
+
+/** @brief State of one direction of a protected connection */
+struct ble_prot_session {
+    uint8_t mode;                       /* enum ble_prot_mode */
+    uint8_t salt[BLE_PROT_SALT_LEN];
+    uint32_t counter;                   /* Last counter sent or accepted */
+};
+
+/**
+ * @brief Set the AES key used by BLE_PROT_CCM sessions
+ *
+ * Sessions started afterwards use the new key. Building with
+ * BLE_PROT_KEY defined as a list of 16 byte values sets a default key,
+ * which is only meant for development.
+ *
+ * @param key BLE_PROT_KEY_LEN bytes
+ *
+ * @return 0 on success, -ENOTSUP without BLE_PROT_CCM_ENABLE, -EIO if the
+ *         key could not be imported
+ */
+int ble_prot_set_key(const uint8_t key[BLE_PROT_KEY_LEN]);
+
+/**
+ * @brief Start a session with a fresh salt and counter
+ *
+ * @param session Session to initialise
+ * @param mode Protection mode
+ *
+ * @return 0 on success, -ENOTSUP if @p mode is not supported, -ENOKEY if
+ *         no key has been set for BLE_PROT_CCM
+ */
+int ble_prot_session_init(struct ble_prot_session *session, enum ble_prot_mode mode);
+
+/**
+ * @brief Seal a payload for sending to the host
+ *
+ * @param session Sending session, its counter is advanced
+ * @param in Payload
+ * @param len Payload length
+ * @param out Sealed frame, must not overlap @p in
+ * @param size Size of @p out, at least @p len + BLE_PROT_OVERHEAD
+ *
+ * @return Sealed frame length, -ENOSPC if @p out is too small, -EOVERFLOW
+ *         once the counter has reached UINT32_MAX (nonces would repeat, so
+ *         the session must be started again with ble_prot_session_init()),
+ *         other negative error code on failure
+ */
+int ble_prot_seal(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                  uint8_t *out, size_t size);
+
+/**
+ * @brief Check and open a sealed frame received from the host
+ *
+ * @param session Receiving session, its counter is advanced on success
+ * @param in Sealed frame
+ * @param len Frame length
+ * @param out Payload, must not overlap @p in
+ * @param size Size of @p out
+ *
+ * @return Payload length, -EBADMSG if the frame is malformed or fails the
+ *         check, -EALREADY if its counter was not new
+ */
+int ble_prot_open(struct ble_prot_session *session, const uint8_t *in, uint16_t len,
+                  uint8_t *out, size_t size);
+
+/**
+ * @brief Get the name of a mode, as used by the 'secure' command
+ */
+const char *ble_prot_mode_name(enum ble_prot_mode mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLE_PROT_H_ */
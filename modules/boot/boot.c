@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "boot.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_IPC_REGISTERED] = "ipc_registered",
+    [BOOT_CONFIG_LOADED] = "config_loaded",
+    [BOOT_SERVICES_READY] = "services_ready",
+    [BOOT_MAIN] = "main",
+    [BOOT_BLE_INIT] = "ble_init",
+    [BOOT_IPC_BOUND] = "ipc_bound",
+    [BOOT_ADVERTISING] = "advertising",
+    [BOOT_SENSORS_READY] = "sensors_ready",
+    [BOOT_MAIN_LOOP] = "main_loop",
+    [BOOT_FIRST_CONNECTION] = "first_connection",
+};
+
+/* 0 means not reached, so a phase reached at 0 us is stored as 1 */
+static atomic_t phase_us[BOOT_PHASE_COUNT];
+
+void boot_mark(enum boot_phase phase)
+{
+    uint32_t us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+
+    if (phase < BOOT_PHASE_COUNT) {
+        atomic_cas(&phase_us[phase], 0, MAX(us, 1));
+    }
+}
+
+uint32_t boot_phase_us(enum boot_phase phase)
+{
+    return phase < BOOT_PHASE_COUNT ? atomic_get(&phase_us[phase]) : 0;
+}
+
+const char *boot_phase_name(enum boot_phase phase)
+{
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+static int cmd_boot(struct cmd_ctx *ctx, const char *args)
+{
+    cmd_printf(ctx, "Boot phases (ms since kernel start):\n");
+
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        uint32_t us = boot_phase_us(i);
+
+        if (us) {
+            cmd_printf(ctx, "  %-16s %6u.%03u\n", phase_names[i], us / 1000, us % 1000);
+        } else {
+            cmd_printf(ctx, "  %-16s      -\n", phase_names[i]);
+        }
+    }
+
+    return 0;
+}
+
+CMD_DEFINE(boot, "Boot phase timestamps", cmd_boot);
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+/**
+ * @file
+ * @brief Boot phase timestamps
+ *
+ * Records when each init stage completed, in microseconds since the
+ * kernel started, so time-to-first-advertisement can be measured on the
+ * device. The 'boot' command prints them.
+ */
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Boot phases, roughly in the order they are reached */
+enum boot_phase {
+    BOOT_IPC_REGISTERED,        /* IPC endpoint registered */
+    BOOT_CONFIG_LOADED,         /* Persistent configuration loaded */
+    BOOT_SERVICES_READY,        /* Command parser and scheduler running */
+    BOOT_MAIN,                  /* main() entered */
+    BOOT_BLE_INIT,              /* ble_init() done */
+    BOOT_IPC_BOUND,             /* Network core endpoint bound */
+    BOOT_ADVERTISING,           /* Init message sent, advertising requested */
+    BOOT_SENSORS_READY,         /* nrf_utils_init() done */
+    BOOT_MAIN_LOOP,             /* All init done */
+    BOOT_FIRST_CONNECTION,      /* First peer connected */
+    BOOT_PHASE_COUNT,
+};
+
+/**
+ * @brief Record that a phase was reached, only the first call counts
+ *
+ * Safe from any context.
+ *
+ * @param phase Phase reached
+ */
+void boot_mark(enum boot_phase phase);
+
+/**
+ * @brief Get the time a phase was reached
+ *
+ * @param phase Phase to look up
+ *
+ * @return Microseconds since kernel start, 0 if not reached yet
+ */
+uint32_t boot_phase_us(enum boot_phase phase);
+
+/**
+ * @brief Get the name of a phase, as printed by 'boot'
+ */
+const char *boot_phase_name(enum boot_phase phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_H_ */
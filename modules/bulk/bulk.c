@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "bulk.h"
+#include "../ble_common/ble_init.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(bulk, LOG_LEVEL_INF);
+
+#if !FIXED_PARTITION_EXISTS(bulk_partition)
+#error "bulk.c needs a bulk_partition in the devicetree"
+#endif
+
+BUILD_ASSERT(BULK_WINDOW >= 1 && BULK_WINDOW <= 33, "struct bulk_ack covers at most 33 chunks");
+BUILD_ASSERT(IS_POWER_OF_TWO(BULK_RX_RING_SIZE), "BULK_RX_RING_SIZE must be a power of two");
+
+/* Queued frames are a connection ID, a length (LE) and the frame */
+#define RX_PREFIX_LEN 3
+
+RING_BUF_DECLARE(rx_ring, BULK_RX_RING_SIZE);
+static struct k_spinlock rx_lock;
+static ATOMIC_DEFINE(reset_pending, BLE_MAX_CONNECTIONS);
+
+K_THREAD_STACK_DEFINE(bulk_stack, BULK_STACK_SIZE);
+static struct k_work_q bulk_workq;
+static struct k_work rx_work;
+static struct k_work_delayable ack_work;
+static struct k_work_delayable idle_work;
+static bool initialized;
+
+static const struct flash_area *flash;
+
+/* The transfer in progress, only touched on the bulk work queue */
+static struct {
+    bool active;
+    uint8_t conn_id;
+    uint32_t size;
+    uint32_t crc32;
+    uint16_t chunk_size;
+    uint16_t chunk_count;
+    uint16_t next;              /* First missing chunk */
+    uint32_t received;          /* Bit i: chunk next + 1 + i is in */
+    uint16_t since_ack;         /* Chunks accepted since the last ACK */
+    bool ack_due;               /* Progress the host has not been told about */
+    uint32_t start_ms;
+} xfer;
+
+static struct bulk_stats stats;
+
+static int send_frame(uint8_t conn_id, uint8_t op, const void *payload, uint16_t len)
+{
+    uint8_t frame[BULK_FRAME_OVERHEAD + sizeof(struct bulk_ack)];
+    struct bulk_hdr *hdr = (struct bulk_hdr *)frame;
+
+    __ASSERT_NO_MSG(len <= sizeof(struct bulk_ack));
+
+    hdr->sync = BLE_IPC_BULK_SYNC;
+    hdr->op = op;
+    hdr->seq = 0;
+    memcpy(frame + sizeof(*hdr), payload, len);
+    sys_put_le16(crc16_ccitt(0xffff, frame, sizeof(*hdr) + len), frame + sizeof(*hdr) + len);
+
+    int err = ble_send_bulk(conn_id, frame, BULK_FRAME_OVERHEAD + len);
+    if (err) {
+        LOG_WRN("Failed to send bulk op 0x%02x (err %d)", op, err);
+    }
+
+    return err;
+}
+
+static void send_status(uint8_t conn_id, uint8_t op, int status)
+{
+    int8_t value = status;
+
+    send_frame(conn_id, op, &value, sizeof(value));
+}
+
+static void send_ack(void)
+{
+    struct bulk_ack ack = {
+        .next = sys_cpu_to_le16(xfer.next),
+        .received = sys_cpu_to_le32(xfer.received),
+    };
+
+    xfer.since_ack = 0;
+    xfer.ack_due = false;
+    k_work_cancel_delayable(&ack_work);
+    send_frame(xfer.conn_id, BULK_OP_ACK, &ack, sizeof(ack));
+}
+
+static void finish(int status)
+{
+    xfer.active = false;
+    k_work_cancel_delayable(&ack_work);
+    k_work_cancel_delayable(&idle_work);
+
+    if (status == 0) {
+        stats.completed++;
+    } else {
+        stats.failed++;
+    }
+}
+
+static int start_transfer(uint8_t conn_id, const uint8_t *payload, uint16_t len)
+{
+    const struct bulk_start *start = (const struct bulk_start *)payload;
+
+    if (len < sizeof(*start)) {
+        return -EINVAL;
+    }
+
+    if (xfer.active && xfer.conn_id != conn_id) {
+        return -EBUSY;
+    }
+
+    if (!flash) {
+        return -ENODEV;
+    }
+
+    uint32_t size = sys_le32_to_cpu(start->size);
+    uint16_t chunk_size = sys_le16_to_cpu(start->chunk_size);
+
+    if (size == 0 || chunk_size == 0 || chunk_size > BULK_MAX_CHUNK ||
+        chunk_size % BULK_WRITE_ALIGN != 0) {
+        return -EINVAL;
+    }
+
+    if (size > flash->fa_size || DIV_ROUND_UP(size, chunk_size) > UINT16_MAX) {
+        return -EFBIG;
+    }
+
+    /* A new START from the same peer replaces its unfinished transfer */
+    if (xfer.active) {
+        LOG_WRN("Restarting bulk transfer of connection %u", conn_id);
+        finish(-ECANCELED);
+    }
+
+    int err = flash_area_erase(flash, 0, ROUND_UP(size, BULK_FLASH_PAGE_SIZE));
+    if (err) {
+        LOG_ERR("Failed to erase bulk partition (err %d)", err);
+        return err;
+    }
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.active = true;
+    xfer.conn_id = conn_id;
+    xfer.size = size;
+    xfer.crc32 = sys_le32_to_cpu(start->crc32);
+    xfer.chunk_size = chunk_size;
+    xfer.chunk_count = DIV_ROUND_UP(size, chunk_size);
+    xfer.start_ms = k_uptime_get_32();
+    stats.started++;
+
+    k_work_reschedule_for_queue(&bulk_workq, &idle_work, K_MSEC(BULK_IDLE_TIMEOUT_MS));
+    LOG_INF("Bulk transfer from connection %u: %u bytes in %u chunks", conn_id, size,
+            xfer.chunk_count);
+    return 0;
+}
+
+static void handle_start(uint8_t conn_id, const uint8_t *payload, uint16_t len)
+{
+    int err = start_transfer(conn_id, payload, len);
+    struct bulk_ready ready = {
+        .status = err,
+        .window = BULK_WINDOW,
+        .chunk_size = sys_cpu_to_le16(err ? 0 : xfer.chunk_size),
+    };
+
+    if (err) {
+        LOG_WRN("Bulk transfer from connection %u refused (err %d)", conn_id, err);
+    }
+
+    send_frame(conn_id, BULK_OP_READY, &ready, sizeof(ready));
+}
+
+/* Flash takes whole write blocks, the last chunk is padded as if erased */
+static int write_chunk(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+    uint16_t aligned = ROUND_DOWN(len, BULK_WRITE_ALIGN);
+    int err = aligned ? flash_area_write(flash, offset, data, aligned) : 0;
+
+    if (err == 0 && aligned < len) {
+        uint8_t tail[BULK_WRITE_ALIGN];
+
+        memset(tail, 0xff, sizeof(tail));
+        memcpy(tail, data + aligned, len - aligned);
+        err = flash_area_write(flash, offset + aligned, tail, sizeof(tail));
+    }
+
+    return err;
+}
+
+/* CRC of what actually landed in flash, not of what was received */
+static int verify_image(void)
+{
+    uint8_t buf[64];
+    uint32_t crc = 0;
+
+    for (uint32_t offset = 0; offset < xfer.size; offset += sizeof(buf)) {
+        size_t n = MIN(sizeof(buf), xfer.size - offset);
+        int err = flash_area_read(flash, offset, buf, n);
+        if (err) {
+            return err;
+        }
+
+        crc = crc32_ieee_update(crc, buf, n);
+    }
+
+    return crc == xfer.crc32 ? 0 : -EBADMSG;
+}
+
+static void complete_transfer(void)
+{
+    uint32_t elapsed_ms = MAX(k_uptime_get_32() - xfer.start_ms, 1);
+
+    /* Tell the host every chunk is in before the slower CRC check */
+    send_ack();
+
+    int err = verify_image();
+    if (err) {
+        LOG_ERR("Bulk image check failed (err %d)", err);
+    } else {
+        LOG_INF("Bulk transfer done: %u bytes in %u ms (%u B/s)", xfer.size, elapsed_ms,
+                (uint32_t)((uint64_t)xfer.size * 1000 / elapsed_ms));
+    }
+
+    send_status(xfer.conn_id, BULK_OP_DONE, err);
+    finish(err);
+}
+
+static void handle_data(uint8_t conn_id, uint16_t seq, const uint8_t *data, uint16_t len)
+{
+    if (!xfer.active || conn_id != xfer.conn_id) {
+        return;
+    }
+
+    k_work_reschedule_for_queue(&bulk_workq, &idle_work, K_MSEC(BULK_IDLE_TIMEOUT_MS));
+
+    if (seq >= xfer.chunk_count || seq >= xfer.next + BULK_WINDOW) {
+        stats.out_of_window++;
+        return;
+    }
+
+    /* Resent because the host missed an ACK, repeat it */
+    if (seq < xfer.next || (seq > xfer.next && (xfer.received & BIT(seq - xfer.next - 1)))) {
+        stats.duplicates++;
+        send_ack();
+        return;
+    }
+
+    uint32_t offset = (uint32_t)seq * xfer.chunk_size;
+    uint16_t expected = MIN(xfer.chunk_size, xfer.size - offset);
+
+    if (len != expected) {
+        LOG_WRN("Bulk chunk %u has %u bytes, expected %u", seq, len, expected);
+        return;
+    }
+
+    int err = write_chunk(offset, data, len);
+    if (err) {
+        LOG_ERR("Failed to write bulk chunk %u (err %d)", seq, err);
+        send_status(xfer.conn_id, BULK_OP_ABORT, err);
+        finish(err);
+        return;
+    }
+
+    stats.chunks++;
+    xfer.since_ack++;
+    xfer.ack_due = true;
+
+    bool new_gap = false;
+
+    if (seq == xfer.next) {
+        /* Slide the window past this chunk and any received after it */
+        xfer.next++;
+        while (xfer.received & BIT(0)) {
+            xfer.received >>= 1;
+            xfer.next++;
+        }
+        xfer.received >>= 1;
+    } else {
+        new_gap = (xfer.received == 0);
+        xfer.received |= BIT(seq - xfer.next - 1);
+    }
+
+    if (xfer.next == xfer.chunk_count) {
+        complete_transfer();
+    } else if (new_gap || xfer.since_ack >= BULK_ACK_EVERY) {
+        send_ack();
+    } else {
+        k_work_reschedule_for_queue(&bulk_workq, &ack_work, K_MSEC(BULK_ACK_TIMEOUT_MS));
+    }
+}
+
+static void handle_frame(uint8_t conn_id, const uint8_t *frame, uint16_t len)
+{
+    const struct bulk_hdr *hdr = (const struct bulk_hdr *)frame;
+
+    if (len < BULK_FRAME_OVERHEAD || hdr->sync != BLE_IPC_BULK_SYNC) {
+        LOG_WRN("Dropping malformed bulk frame (%u bytes)", len);
+        return;
+    }
+
+    uint16_t payload_len = len - BULK_FRAME_OVERHEAD;
+    const uint8_t *payload = frame + sizeof(*hdr);
+
+    if (crc16_ccitt(0xffff, frame, len - sizeof(uint16_t)) != sys_get_le16(payload + payload_len)) {
+        stats.crc_errors++;
+        return;
+    }
+
+    switch (hdr->op) {
+    case BULK_OP_START:
+        handle_start(conn_id, payload, payload_len);
+        break;
+
+    case BULK_OP_DATA:
+        handle_data(conn_id, sys_le16_to_cpu(hdr->seq), payload, payload_len);
+        break;
+
+    case BULK_OP_POLL:
+        if (xfer.active && xfer.conn_id == conn_id) {
+            send_ack();
+        } else {
+            send_status(conn_id, BULK_OP_ABORT, -ENOENT);
+        }
+        break;
+
+    case BULK_OP_ABORT:
+        if (xfer.active && xfer.conn_id == conn_id) {
+            LOG_INF("Bulk transfer aborted by connection %u", conn_id);
+            finish(-ECANCELED);
+        }
+        break;
+
+    default:
+        LOG_WRN("Unknown bulk op 0x%02x", hdr->op);
+        break;
+    }
+}
+
+static void rx_work_handler(struct k_work *work)
+{
+    static uint8_t frame[BLE_IPC_MAX_PAYLOAD] __aligned(4);
+
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (atomic_test_and_clear_bit(reset_pending, i) && xfer.active && xfer.conn_id == i) {
+            LOG_INF("Bulk transfer of connection %u dropped", i);
+            finish(-ECONNRESET);
+        }
+    }
+
+    while (true) {
+        uint8_t prefix[RX_PREFIX_LEN];
+        uint16_t len = 0;
+        k_spinlock_key_t key = k_spin_lock(&rx_lock);
+
+        if (ring_buf_get(&rx_ring, prefix, sizeof(prefix)) == sizeof(prefix)) {
+            len = sys_get_le16(prefix + 1);
+            ring_buf_get(&rx_ring, frame, len);
+        }
+
+        k_spin_unlock(&rx_lock, key);
+
+        if (len == 0) {
+            break;
+        }
+
+        handle_frame(prefix[0], frame, len);
+    }
+}
+
+static void ack_work_handler(struct k_work *work)
+{
+    if (xfer.active && xfer.ack_due) {
+        send_ack();
+    }
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+    if (xfer.active) {
+        LOG_WRN("Bulk transfer of connection %u timed out at chunk %u", xfer.conn_id, xfer.next);
+        send_status(xfer.conn_id, BULK_OP_ABORT, -ETIMEDOUT);
+        finish(-ETIMEDOUT);
+    }
+}
+
+int bulk_init(void)
+{
+    if (initialized) {
+        return 0;
+    }
+
+    k_work_init(&rx_work, rx_work_handler);
+    k_work_init_delayable(&ack_work, ack_work_handler);
+    k_work_init_delayable(&idle_work, idle_work_handler);
+    k_work_queue_init(&bulk_workq);
+    k_work_queue_start(&bulk_workq, bulk_stack, K_THREAD_STACK_SIZEOF(bulk_stack),
+                       BULK_PRIORITY, &(struct k_work_queue_config){ .name = "bulk" });
+    initialized = true;
+
+    /* Without the partition transfers are refused with -ENODEV */
+    int err = flash_area_open(FIXED_PARTITION_ID(bulk_partition), &flash);
+    if (err) {
+        LOG_ERR("Failed to open bulk partition (err %d)", err);
+        flash = NULL;
+        return err;
+    }
+
+    LOG_INF("Bulk transfer ready (%u byte partition)", (unsigned int)flash->fa_size);
+    return 0;
+}
+
+void bulk_process(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    uint8_t prefix[RX_PREFIX_LEN] = { conn_id };
+
+    if (!initialized || len == 0 || len > BLE_IPC_MAX_PAYLOAD) {
+        return;
+    }
+
+    sys_put_le16(len, prefix + 1);
+
+    k_spinlock_key_t key = k_spin_lock(&rx_lock);
+
+    /* Whole frames only, a dropped chunk is reported missing in the next ACK */
+    if (ring_buf_space_get(&rx_ring) < sizeof(prefix) + len) {
+        stats.ring_drops++;
+        k_spin_unlock(&rx_lock, key);
+        return;
+    }
+
+    ring_buf_put(&rx_ring, prefix, sizeof(prefix));
+    ring_buf_put(&rx_ring, data, len);
+    k_spin_unlock(&rx_lock, key);
+
+    k_work_submit_to_queue(&bulk_workq, &rx_work);
+}
+
+void bulk_reset(uint8_t conn_id)
+{
+    if (!initialized || conn_id >= BLE_MAX_CONNECTIONS) {
+        return;
+    }
+
+    atomic_set_bit(reset_pending, conn_id);
+    k_work_submit_to_queue(&bulk_workq, &rx_work);
+}
+
+void bulk_get_stats(struct bulk_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&rx_lock);
+
+    *out = stats;
+
+    k_spin_unlock(&rx_lock, key);
+}
+
+static int cmd_bulk(struct cmd_ctx *ctx, const char *args)
+{
+    struct bulk_stats s;
+
+    if (args && strcmp(args, "abort") == 0) {
+        for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+            bulk_reset(i);
+        }
+        cmd_printf(ctx, "Bulk transfer aborted\n");
+        return 0;
+    }
+
+    bulk_get_stats(&s);
+
+    if (xfer.active) {
+        cmd_printf(ctx, "Bulk: receiving from connection %u, chunk %u of %u (%u bytes)\n",
+                   xfer.conn_id, xfer.next, xfer.chunk_count, xfer.size);
+    } else {
+        cmd_printf(ctx, "Bulk: idle\n");
+    }
+
+    cmd_printf(ctx, "  Partition: %u bytes, window %u, max chunk %u\n",
+               flash ? (unsigned int)flash->fa_size : 0, BULK_WINDOW,
+               (unsigned int)BULK_MAX_CHUNK);
+    cmd_printf(ctx, "  Transfers: %u started, %u done, %u failed\n", s.started, s.completed,
+               s.failed);
+    cmd_printf(ctx, "  Chunks: %u written, %u duplicate, %u out of window\n", s.chunks,
+               s.duplicates, s.out_of_window);
+    cmd_printf(ctx, "  Dropped: %u bad CRC, %u writer busy\n", s.crc_errors, s.ring_drops);
+    return 0;
+}
+
+CMD_DEFINE(bulk, "Bulk transfer status (abort)", cmd_bulk);
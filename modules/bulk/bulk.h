@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BULK_H_
+#define BULK_H_
+
+/**
+ * @file
+ * @brief Bulk binary transfer into flash
+ *
+ * Calibration blobs, configuration images and firmware are sent as
+ * binary chunks over their own channel (IPC_MSG_BULK) instead of through
+ * the line-based command parser, and written straight to the
+ * bulk_partition flash partition.
+ *
+ * Every frame, in both directions, is
+ *
+ *   struct bulk_hdr | payload | crc16 (LE)
+ *
+ * with the same CRC-16/CCITT (seed 0xffff) over header and payload as
+ * binary commands. Frames with a bad CRC are dropped.
+ *
+ * A transfer:
+ *  1. The host sends BULK_OP_START with struct bulk_start. The device
+ *     erases enough of the partition and answers BULK_OP_READY.
+ *  2. The host sends BULK_OP_DATA frames, seq being the chunk index. Each
+ *     chunk is chunk_size bytes except the last one. At most BULK_WINDOW
+ *     chunks starting at the first missing one are accepted, the rest
+ *     are dropped.
+ *  3. The device answers with BULK_OP_ACK (struct bulk_ack) every
+ *     BULK_ACK_EVERY chunks, right away when a chunk is out of order or
+ *     a duplicate, and BULK_ACK_TIMEOUT_MS after the last chunk if there
+ *     is anything to report. The host resends only the chunks the ACK
+ *     reports missing. BULK_OP_POLL asks for an ACK at any time.
+ *  4. Once all chunks are in, the device checks the CRC-32 of the image
+ *     as read back from flash and answers BULK_OP_DONE.
+ *
+ * Either side can end a transfer with BULK_OP_ABORT. One transfer runs at
+ * a time, a START from another connection is answered with -EBUSY. All
+ * multi-byte fields are little-endian.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include "../ble_common/ble_ipc_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Chunks in flight, at most 33 so struct bulk_ack can describe them */
+#ifndef BULK_WINDOW
+#define BULK_WINDOW 32
+#endif
+
+/** @brief Accepted chunks between two ACKs */
+#ifndef BULK_ACK_EVERY
+#define BULK_ACK_EVERY 8
+#endif
+
+/** @brief Time after the last chunk until an ACK is sent anyway */
+#ifndef BULK_ACK_TIMEOUT_MS
+#define BULK_ACK_TIMEOUT_MS 200
+#endif
+
+/** @brief Transfer given up after this long without a frame */
+#ifndef BULK_IDLE_TIMEOUT_MS
+#define BULK_IDLE_TIMEOUT_MS 30000
+#endif
+
+/** @brief Frames waiting for the flash writer, in bytes (power of two) */
+#ifndef BULK_RX_RING_SIZE
+#define BULK_RX_RING_SIZE 4096
+#endif
+
+/** @brief Stack size of the bulk work queue thread */
+#ifndef BULK_STACK_SIZE
+#define BULK_STACK_SIZE 1536
+#endif
+
+/** @brief Priority of the bulk work queue thread, below command handling */
+#ifndef BULK_PRIORITY
+#define BULK_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+/** @brief Erase page size of the bulk partition */
+#ifndef BULK_FLASH_PAGE_SIZE
+#define BULK_FLASH_PAGE_SIZE 4096
+#endif
+
+/** @brief Flash write block size, chunk sizes must be a multiple of it */
+#ifndef BULK_WRITE_ALIGN
+#define BULK_WRITE_ALIGN 4
+#endif
+
+/** @brief Bulk frame header */
+struct bulk_hdr {
+    uint8_t sync;       /* BLE_IPC_BULK_SYNC */
+    uint8_t op;         /* enum bulk_op */
+    uint16_t seq;       /* Chunk index in BULK_OP_DATA, 0 otherwise */
+} __packed;
+
+/** @brief Header and CRC bytes around every payload */
+#define BULK_FRAME_OVERHEAD (sizeof(struct bulk_hdr) + sizeof(uint16_t))
+
+/** @brief Largest chunk, one chunk per IPC message */
+#define BULK_MAX_CHUNK ROUND_DOWN(BLE_IPC_MAX_PAYLOAD - BULK_FRAME_OVERHEAD, BULK_WRITE_ALIGN)
+
+/** @brief Bulk operations */
+enum bulk_op {
+    /* Host to device */
+    BULK_OP_START = 0x01,       /* struct bulk_start */
+    BULK_OP_DATA = 0x02,        /* Chunk data */
+    BULK_OP_POLL = 0x03,        /* No payload, asks for a BULK_OP_ACK */
+    BULK_OP_ABORT = 0x04,       /* No payload from the host, int8_t status from the device */
+
+    /* Device to host */
+    BULK_OP_READY = 0x81,       /* struct bulk_ready */
+    BULK_OP_ACK = 0x82,         /* struct bulk_ack */
+    BULK_OP_DONE = 0x83,        /* int8_t status, 0 or -EBADMSG on a CRC mismatch */
+};
+
+/** @brief BULK_OP_START payload */
+struct bulk_start {
+    uint32_t size;          /* Image size in bytes */
+    uint32_t crc32;         /* CRC-32 (IEEE) of the whole image */
+    uint16_t chunk_size;    /* Bytes per chunk, multiple of BULK_WRITE_ALIGN */
+} __packed;
+
+/** @brief BULK_OP_READY payload */
+struct bulk_ready {
+    int8_t status;          /* 0, or negative errno if the transfer was refused */
+    uint8_t window;         /* BULK_WINDOW */
+    uint16_t chunk_size;    /* Accepted chunk size */
+} __packed;
+
+/** @brief BULK_OP_ACK payload */
+struct bulk_ack {
+    uint16_t next;          /* First missing chunk, all chunks before it are in */
+    uint32_t received;      /* Bit i set if chunk next + 1 + i is in */
+} __packed;
+
+/** @brief Transfer statistics */
+struct bulk_stats {
+    uint32_t started;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t chunks;            /* Chunks written */
+    uint32_t duplicates;        /* Chunks received again */
+    uint32_t out_of_window;     /* Chunks past the window */
+    uint32_t crc_errors;        /* Frames with a bad CRC */
+    uint32_t ring_drops;        /* Frames dropped because the writer fell behind */
+};
+
+/**
+ * @brief Start the bulk work queue and open the flash partition
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int bulk_init(void);
+
+/**
+ * @brief Queue a received bulk frame
+ *
+ * Cheap enough for the IPC receive callback: the frame is copied and
+ * checked and written to flash on the bulk work queue.
+ *
+ * @param conn_id Connection the frame came from
+ * @param data Frame
+ * @param len Frame length
+ */
+void bulk_process(uint8_t conn_id, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Abort the transfer of a connection, e.g. when it disconnects
+ *
+ * @param conn_id Connection ID
+ */
+void bulk_reset(uint8_t conn_id);
+
+/**
+ * @brief Get the transfer statistics
+ *
+ * @param stats Filled with the counters since boot
+ */
+void bulk_get_stats(struct bulk_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BULK_H_ */
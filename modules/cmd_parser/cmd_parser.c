@@ -6,85 +6,372 @@
 
 #include "cmd_parser.h"
 #include "../ble_common/ble_init.h"
+#include "../ble_common/ble_ipc_proto.h"
+#include "../ble_common/ble_prot.h"
 #include "../nrf_utils/nrf_utils.h"
+#include "../perf/perf.h"
+#include "../supervisor/supervisor.h"
+#include "../trace/trace.h"
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/crc.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
-LOG_MODULE_REGISTER(cmd_parser, LOG_LEVEL_DBG);
+LOG_MODULE_REGISTER(cmd_parser, LOG_LEVEL_INF);
 
-/* Command buffer */
-static char cmd_buffer[CMD_MAX_LEN];
-static size_t cmd_buffer_pos = 0;
+BUILD_ASSERT(IS_POWER_OF_TWO(CMD_RX_RING_SIZE), "CMD_RX_RING_SIZE must be a power of two");
 
-/* Forward declarations */
-static int cmd_help(const char *args, char *response, size_t response_size);
-static int cmd_status(const char *args, char *response, size_t response_size);
-static int cmd_battery(const char *args, char *response, size_t response_size);
-static int cmd_temp(const char *args, char *response, size_t response_size);
-static int cmd_info(const char *args, char *response, size_t response_size);
-static int cmd_uptime(const char *args, char *response, size_t response_size);
-static int cmd_reset(const char *args, char *response, size_t response_size);
-static int cmd_led(const char *args, char *response, size_t response_size);
-static int cmd_echo(const char *args, char *response, size_t response_size);
-static int cmd_ipc_test(const char *args, char *response, size_t response_size);
-
-/* Command table */
-static const struct cmd_entry commands[] = {
-    {"help", "Show available commands", cmd_help},
-    {"status", "Show system status", cmd_status},
-    {"battery", "Show battery status", cmd_battery},
-    {"temp", "Show temperature", cmd_temp},
-    {"info", "Show system information", cmd_info},
-    {"uptime", "Show system uptime", cmd_uptime},
-    {"reset", "Reset the system", cmd_reset},
-    {"led", "Control LED (on|off|toggle)", cmd_led},
-    {"echo", "Echo back the arguments", cmd_echo},
-    {"ipc", "Test IPC communication with network core", cmd_ipc_test},
+/* Command work queue */
+K_THREAD_STACK_DEFINE(cmd_workq_stack, CMD_WORKQ_STACK_SIZE);
+static struct k_work_q cmd_workq;
+
+/*
+ * Streaming response writer. Output is formatted into one chunk at a time,
+ * preferably a TX buffer borrowed from IPC shared memory, and handed to the
+ * BLE TX pipeline whenever the chunk fills up.
+ */
+struct cmd_ctx {
+    char *buf;          /* Current chunk, NULL until first write */
+    size_t size;
+    size_t len;
+    uint8_t *tx_buf;    /* Borrowed IPC buffer backing buf, if any */
+    bool framed;        /* Binary response, sent as a single frame */
+    bool overflow;      /* Binary response did not fit its frame */
+    uint8_t conn_id;    /* Connection the response goes to */
+    char local[CMD_RESPONSE_MAX_LEN];
+};
+
+/*
+ * Per-connection session, indexed by connection ID. Everything but the RX
+ * ring head and reset_head is only touched on the command work queue.
+ */
+struct cmd_session {
+    /* Command buffer, also holds binary request frames */
+    char line[CMD_MAX_LEN];
+    size_t line_pos;
+    
+    /* Set by the 'binary' command */
+    bool binary_mode;
+    
+    /*
+     * Lock-free single-producer/single-consumer RX ring. The producer is
+     * the IPC receive callback, the consumer is the command work queue.
+     * Each index is only written by its own side; atomic_set() publishes it.
+     */
+    struct {
+        uint8_t data[CMD_RX_RING_SIZE];
+        atomic_t head;  /* Written by producer */
+        atomic_t tail;  /* Written by consumer */
+        atomic_t reset_head;    /* Head when the peer went away, written by producer */
+    } rx;
+    
+    struct k_work rx_work;
+    struct k_work reset_work;
+    struct cmd_ctx ctx;
 };
 
-#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+static struct cmd_session sessions[CMD_MAX_SESSIONS];
+
+/* Forward declarations */
+static int cmd_help(struct cmd_ctx *ctx, const char *args);
+static int cmd_status(struct cmd_ctx *ctx, const char *args);
+static int cmd_battery(struct cmd_ctx *ctx, const char *args);
+static int cmd_temp(struct cmd_ctx *ctx, const char *args);
+static int cmd_info(struct cmd_ctx *ctx, const char *args);
+static int cmd_uptime(struct cmd_ctx *ctx, const char *args);
+static int cmd_reset(struct cmd_ctx *ctx, const char *args);
+static int cmd_led(struct cmd_ctx *ctx, const char *args);
+static int cmd_echo(struct cmd_ctx *ctx, const char *args);
+static int cmd_ipc_test(struct cmd_ctx *ctx, const char *args);
+static int cmd_binary(struct cmd_ctx *ctx, const char *args);
+static int cmd_sleep(struct cmd_ctx *ctx, const char *args);
+static int cmd_profile(struct cmd_ctx *ctx, const char *args);
+static int cmd_secure(struct cmd_ctx *ctx, const char *args);
+static int bin_status(struct cmd_ctx *ctx, const uint8_t *payload, size_t len);
+static int bin_battery(struct cmd_ctx *ctx, const uint8_t *payload, size_t len);
+static int bin_temp(struct cmd_ctx *ctx, const uint8_t *payload, size_t len);
+
+/* Built-in commands, other modules register theirs the same way */
+CMD_DEFINE(help, "Show available commands", cmd_help);
+CMD_DEFINE_BIN(status, "Show system status", cmd_status, CMD_OP_STATUS, bin_status);
+CMD_DEFINE_BIN(battery, "Show battery status [stats]", cmd_battery, CMD_OP_BATTERY, bin_battery);
+CMD_DEFINE_BIN(temp, "Show temperature", cmd_temp, CMD_OP_TEMP, bin_temp);
+CMD_DEFINE(info, "Show system information", cmd_info);
+CMD_DEFINE(uptime, "Show system uptime", cmd_uptime);
+CMD_DEFINE(reset, "Reset the system", cmd_reset);
+CMD_DEFINE(led, "Control LED (on|off|toggle)", cmd_led);
+CMD_DEFINE(echo, "Echo back the arguments", cmd_echo);
+CMD_DEFINE(ipc, "Test IPC communication with network core", cmd_ipc_test);
+CMD_DEFINE(binary, "Switch to binary framing", cmd_binary);
+CMD_DEFINE(sleep, "Sleep stats, or sleep (<ms>|off)", cmd_sleep);
+CMD_DEFINE(profile, "Link profile (auto|fast|balanced|lowpower)", cmd_profile);
+CMD_DEFINE(secure, "Payload protection (off|crc|ccm)", cmd_secure);
+
+/* Set at init, binary search relies on the linker having sorted the section */
+static bool table_sorted = false;
 
 /* External LED reference */
 extern const struct gpio_dt_spec led;
 
+static void rx_work_handler(struct k_work *work);
+static void reset_work_handler(struct k_work *work);
+
 int cmd_parser_init(void)
 {
-    LOG_INF("Command parser initialized");
+    const struct cmd_entry *prev = NULL;
+    size_t count = 0;
+    
+    /* Verify the build-time ordering once instead of on every lookup */
+    table_sorted = true;
+    STRUCT_SECTION_FOREACH(cmd_entry, entry) {
+        if (prev && strcmp(prev->name, entry->name) >= 0) {
+            LOG_ERR("Command table not sorted at '%s', using linear lookup", entry->name);
+            table_sorted = false;
+        }
+        prev = entry;
+        count++;
+    }
+    
+    for (uint8_t i = 0; i < CMD_MAX_SESSIONS; i++) {
+        k_work_init(&sessions[i].rx_work, rx_work_handler);
+        k_work_init(&sessions[i].reset_work, reset_work_handler);
+        sessions[i].ctx.conn_id = i;
+    }
+    
+    k_work_queue_init(&cmd_workq);
+    k_work_queue_start(&cmd_workq, cmd_workq_stack, K_THREAD_STACK_SIZEOF(cmd_workq_stack),
+                       CMD_WORKQ_PRIORITY, &(struct k_work_queue_config){ .name = "cmd_parser" });
+    
+    LOG_INF("Command parser initialized (%u commands)", (unsigned int)count);
     return 0;
 }
 
-static int cmd_help(const char *args, char *response, size_t response_size)
+static void ctx_open_chunk(struct cmd_ctx *ctx)
+{
+    uint16_t tx_size = CMD_RESPONSE_MAX_LEN;
+    
+    ctx->len = 0;
+    
+    /* Format straight into IPC shared memory when the backend allows it */
+    if (ble_tx_buf_get(ctx->conn_id, &ctx->tx_buf, &tx_size) == 0) {
+        ctx->buf = (char *)ctx->tx_buf;
+        ctx->size = tx_size;
+    } else {
+        ctx->tx_buf = NULL;
+        ctx->buf = ctx->local;
+        ctx->size = sizeof(ctx->local);
+    }
+    
+    /* Leave room for the frame header in front and the CRC behind */
+    if (ctx->framed) {
+        ctx->len = sizeof(struct cmd_bin_hdr);
+        ctx->size -= sizeof(uint16_t);
+    } else {
+        /* Text can be cut anywhere, so fill whole LL packets */
+        ctx->size = MIN(ctx->size, ble_get_tx_chunk_size(ctx->conn_id));
+    }
+}
+
+static int ctx_send(struct cmd_ctx *ctx)
 {
-    int pos = 0;
+    int ret = 0;
     
-    pos += snprintf(response + pos, response_size - pos, "Available commands:\n");
+    if (!ctx->buf) {
+        return 0;
+    }
+    
+    /* A blocked send would hang the whole command queue */
+    uint32_t start = perf_start();
+    supervisor_begin(SUPERVISOR_CMD_FLUSH, ctx->conn_id, SUPERVISOR_FLUSH_DEADLINE_MS);
     
-    for (size_t i = 0; i < NUM_COMMANDS && pos < response_size - 50; i++) {
-        pos += snprintf(response + pos, response_size - pos, "  %s - %s\n",
-                       commands[i].name, commands[i].help);
+    if (ctx->tx_buf) {
+        if (ctx->len > 0) {
+            ret = ble_tx_buf_send(ctx->tx_buf, ctx->len);
+        } else {
+            ble_tx_buf_release(ctx->tx_buf);
+        }
+    } else if (ctx->len > 0) {
+        ret = ble_send_data_to(ctx->conn_id, (const uint8_t *)ctx->buf, ctx->len);
     }
     
-    pos += snprintf(response + pos, response_size - pos, "\nType 'command help' for usage\n");
+    supervisor_end(SUPERVISOR_CMD_FLUSH);
+    perf_stop(PERF_T_CMD_FLUSH, start);
+    
+    /* Output is moving, so a long dump is not a stuck handler */
+    if (ret == 0) {
+        supervisor_progress(SUPERVISOR_CMD);
+    }
+    
+    ctx->buf = NULL;
+    ctx->tx_buf = NULL;
+    ctx->len = 0;
+    return ret;
+}
+
+int cmd_flush(struct cmd_ctx *ctx)
+{
+    /* A binary response only goes out once complete */
+    if (ctx->framed) {
+        return 0;
+    }
+    
+    return ctx_send(ctx);
+}
+
+static int ctx_send_frame(struct cmd_ctx *ctx, uint8_t opcode, uint8_t seq, int status)
+{
+    if (!ctx->buf) {
+        ctx_open_chunk(ctx);
+    }
+    
+    struct cmd_bin_hdr *hdr = (struct cmd_bin_hdr *)ctx->buf;
+    uint16_t payload_len = ctx->len - sizeof(*hdr);
+    
+    hdr->sync = CMD_BIN_SYNC;
+    hdr->opcode = opcode | CMD_BIN_RESP_FLAG;
+    hdr->seq = seq;
+    hdr->status = CLAMP(status, INT8_MIN, INT8_MAX);
+    hdr->len = sys_cpu_to_le16(payload_len);
+    
+    sys_put_le16(crc16_ccitt(0xffff, (const uint8_t *)ctx->buf, ctx->len),
+                 (uint8_t *)ctx->buf + ctx->len);
+    ctx->len += sizeof(uint16_t);
+    
+    return ctx_send(ctx);
+}
+
+int cmd_printf(struct cmd_ctx *ctx, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+    
+    if (!ctx->buf) {
+        ctx_open_chunk(ctx);
+    }
+    
+    va_start(ap, fmt);
+    n = vsnprintf(ctx->buf + ctx->len, ctx->size - ctx->len, fmt, ap);
+    va_end(ap);
+    
+    if (n < 0) {
+        return n;
+    }
+    
+    if ((size_t)n >= ctx->size - ctx->len && ctx->framed) {
+        ctx->overflow = true;
+        return -ENOSPC;
+    }
+    
+    if ((size_t)n >= ctx->size - ctx->len && ctx->len > 0) {
+        /* Did not fit, send what we have and format again into a fresh chunk */
+        cmd_flush(ctx);
+        ctx_open_chunk(ctx);
+        
+        va_start(ap, fmt);
+        n = vsnprintf(ctx->buf, ctx->size, fmt, ap);
+        va_end(ap);
+        
+        if (n < 0) {
+            return n;
+        }
+    }
+    
+    /* Output longer than a whole chunk is truncated */
+    ctx->len += MIN((size_t)n, ctx->size - 1 - ctx->len);
+    return n;
+}
+
+int cmd_write(struct cmd_ctx *ctx, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    size_t remaining = len;
+    
+    if (ctx->framed) {
+        if (!ctx->buf) {
+            ctx_open_chunk(ctx);
+        }
+        
+        if (len > ctx->size - ctx->len) {
+            ctx->overflow = true;
+            return -ENOSPC;
+        }
+    }
+    
+    while (remaining > 0) {
+        if (!ctx->buf) {
+            ctx_open_chunk(ctx);
+        }
+        
+        size_t n = MIN(remaining, ctx->size - ctx->len);
+        memcpy(ctx->buf + ctx->len, src, n);
+        ctx->len += n;
+        src += n;
+        remaining -= n;
+        
+        if (ctx->len == ctx->size) {
+            int ret = cmd_flush(ctx);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+    
+    return len;
+}
+
+uint8_t cmd_ctx_conn_id(const struct cmd_ctx *ctx)
+{
+    return ctx->conn_id;
+}
+
+int cmd_tlv_put(struct cmd_ctx *ctx, uint8_t type, const void *value, uint8_t len)
+{
+    uint8_t tl[2] = { type, len };
+    
+    if (!ctx->buf) {
+        ctx_open_chunk(ctx);
+    }
+    
+    /* Records are never split */
+    if (sizeof(tl) + len > ctx->size - ctx->len) {
+        ctx->overflow = true;
+        return -ENOSPC;
+    }
+    
+    cmd_write(ctx, tl, sizeof(tl));
+    cmd_write(ctx, value, len);
+    return 0;
+}
+
+static int cmd_help(struct cmd_ctx *ctx, const char *args)
+{
+    cmd_printf(ctx, "Available commands:\n");
+    
+    /* Streamed in chunks, so the list is never truncated */
+    STRUCT_SECTION_FOREACH(cmd_entry, entry) {
+        cmd_printf(ctx, "  %s - %s\n", entry->name, entry->help);
+    }
+    
+    cmd_printf(ctx, "\nType 'command help' for usage\n");
     
     return 0;
 }
 
-static int cmd_status(const char *args, char *response, size_t response_size)
+static int cmd_status(struct cmd_ctx *ctx, const char *args)
 {
     struct nrf_battery_status battery;
     int temp = nrf_get_temperature_celsius();
     uint32_t uptime = nrf_get_uptime_ms();
     enum ble_connection_state ble_state = ble_get_connection_state();
     
-    int pos = 0;
-    pos += snprintf(response + pos, response_size - pos, "=== System Status ===\n");
-    pos += snprintf(response + pos, response_size - pos, "Uptime: %u.%03u seconds\n", 
-                   uptime / 1000, uptime % 1000);
+    cmd_printf(ctx, "=== System Status ===\n");
+    cmd_printf(ctx, "Uptime: %u.%03u seconds\n", 
+               uptime / 1000, uptime % 1000);
     
     /* BLE status for nRF5340 */
     const char *ble_state_str;
@@ -96,240 +383,750 @@ static int cmd_status(const char *args, char *response, size_t response_size)
     default: ble_state_str = "Unknown"; break;
     }
     
-    pos += snprintf(response + pos, response_size - pos, "BLE state: %s\n", ble_state_str);
-    pos += snprintf(response + pos, response_size - pos, "IPC ready: %s\n", 
-                   ble_is_ipc_ready() ? "Yes" : "No");
+    cmd_printf(ctx, "BLE state: %s (%u connected)\n", ble_state_str, ble_get_connection_count());
+    cmd_printf(ctx, "IPC ready: %s\n", 
+               ble_is_ipc_ready() ? "Yes" : "No");
+    
+    /* Read from the network core's shared status block, no IPC round trip */
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        struct ble_peer_status peer;
+        
+        if (!ble_is_connected(i) || ble_get_peer_status(i, &peer) != 0) {
+            continue;
+        }
+        
+        cmd_printf(ctx, "  Conn %u: RSSI %d dBm, interval %u.%02u ms, latency %u, "
+                   "MTU %u, PHY 0x%02x\n", i, peer.rssi, peer.interval_us / 1000,
+                   (peer.interval_us % 1000) / 10, peer.latency, peer.mtu, peer.phy);
+    }
     
     if (nrf_get_battery_status(&battery) == 0) {
-        pos += snprintf(response + pos, response_size - pos, "Battery: %u%% (%u mV)\n",
-                       battery.percentage, battery.voltage_mv);
+        cmd_printf(ctx, "Battery: %u%% (%u mV)\n",
+                   battery.percentage, battery.voltage_mv);
     }
     
     if (temp >= 0) {
-        pos += snprintf(response + pos, response_size - pos, "Temperature: %d°C\n", temp);
+        cmd_printf(ctx, "Temperature: %d°C\n", temp);
     }
     
     return 0;
 }
 
-static int cmd_battery(const char *args, char *response, size_t response_size)
+static int cmd_battery(struct cmd_ctx *ctx, const char *args)
 {
     struct nrf_battery_status battery;
-    int ret = nrf_get_battery_status(&battery);
+    int ret;
     
+    if (args && strncmp(args, "stats", 5) == 0) {
+        struct nrf_battery_stats stats;
+        
+        ret = nrf_get_battery_stats(&stats, NRF_BATTERY_BURST_MAX);
+        if (ret < 0) {
+            cmd_printf(ctx, "Battery stats unavailable (err %d)\n", ret);
+            return ret;
+        }
+        
+        cmd_printf(ctx, "Battery Stats (%u samples):\n"
+                   "  Mean: %u mV\n"
+                   "  Min/Max: %u/%u mV\n"
+                   "  Std dev: %u mV\n",
+                   stats.samples, stats.mean_mv, stats.min_mv, stats.max_mv, stats.stddev_mv);
+        return 0;
+    }
+    
+    ret = nrf_get_battery_status(&battery);
     if (ret < 0) {
-        snprintf(response, response_size, "Battery status unavailable (err %d)\n", ret);
+        cmd_printf(ctx, "Battery status unavailable (err %d)\n", ret);
         return ret;
     }
     
-    snprintf(response, response_size, "Battery Status:\n"
-             "  Voltage: %u mV\n"
-             "  Percentage: %u%%\n"
-             "  Present: %s\n"
-             "  Charging: %s\n",
-             battery.voltage_mv,
-             battery.percentage,
-             battery.is_present ? "Yes" : "No",
-             battery.is_charging ? "Yes" : "No");
+    cmd_printf(ctx, "Battery Status:\n"
+               "  Voltage: %u mV\n"
+               "  Percentage: %u%%\n"
+               "  Present: %s\n"
+               "  Charging: %s\n",
+               battery.voltage_mv,
+               battery.percentage,
+               battery.is_present ? "Yes" : "No",
+               battery.is_charging ? "Yes" : "No");
     
     return 0;
 }
 
-static int cmd_temp(const char *args, char *response, size_t response_size)
+static int cmd_temp(struct cmd_ctx *ctx, const char *args)
 {
-    int temp = nrf_get_temperature_celsius();
+    int32_t mdeg;
+    int ret = nrf_get_temperature_mdeg(&mdeg);
     
-    if (temp < -100) {
-        snprintf(response, response_size, "Temperature unavailable (err %d)\n", temp);
-        return temp;
+    if (ret < 0) {
+        cmd_printf(ctx, "Temperature unavailable (err %d)\n", ret);
+        return ret;
     }
     
-    snprintf(response, response_size, "Temperature: %d°C\n", temp);
+    uint32_t abs_mdeg = (mdeg < 0) ? -mdeg : mdeg;
+    
+    cmd_printf(ctx, "Temperature: %s%u.%02u°C\n", (mdeg < 0) ? "-" : "",
+               abs_mdeg / 1000, (abs_mdeg % 1000) / 10);
     return 0;
 }
 
-static int cmd_info(const char *args, char *response, size_t response_size)
+static int cmd_info(struct cmd_ctx *ctx, const char *args)
 {
     struct nrf_system_info info;
     int ret = nrf_get_system_info(&info);
     
     if (ret < 0) {
-        snprintf(response, response_size, "System info unavailable (err %d)\n", ret);
+        cmd_printf(ctx, "System info unavailable (err %d)\n", ret);
         return ret;
     }
     
-    snprintf(response, response_size, "System Information:\n"
-             "  Board: %s\n"
-             "  SoC: %s\n"
-             "  Uptime: %u ms\n"
-             "  Free Heap: %u bytes\n",
-             info.board_name,
-             info.soc_name,
-             info.uptime_ms,
-             info.free_heap_bytes);
+    cmd_printf(ctx, "System Information:\n"
+               "  Board: %s\n"
+               "  SoC: %s\n"
+               "  Uptime: %u ms\n"
+               "  Free Heap: %u bytes\n"
+               "  Reset Cause: 0x%08x\n",
+               info.board_name,
+               info.soc_name,
+               info.uptime_ms,
+               info.free_heap_bytes,
+               info.reset_reason);
+    
+    if (info.reset_hint) {
+        cmd_printf(ctx, "  Reset Hint: 0x%08x (0x%08x)\n", info.reset_hint, info.reset_hint_arg);
+    }
     
     return 0;
 }
 
-static int cmd_uptime(const char *args, char *response, size_t response_size)
+static int cmd_uptime(struct cmd_ctx *ctx, const char *args)
 {
     uint32_t uptime = nrf_get_uptime_ms();
     uint32_t seconds = uptime / 1000;
     uint32_t minutes = seconds / 60;
     uint32_t hours = minutes / 60;
     
-    snprintf(response, response_size, "Uptime: %u hours, %u minutes, %u seconds\n",
-             hours, minutes % 60, seconds % 60);
+    cmd_printf(ctx, "Uptime: %u hours, %u minutes, %u seconds\n",
+               hours, minutes % 60, seconds % 60);
     
     return 0;
 }
 
-static int cmd_reset(const char *args, char *response, size_t response_size)
+static int cmd_reset(struct cmd_ctx *ctx, const char *args)
 {
-    snprintf(response, response_size, "Resetting system in 2 seconds...\n");
+    cmd_printf(ctx, "Resetting system in 2 seconds...\n");
     
     /* Send response first, then reset */
+    cmd_flush(ctx);
     k_sleep(K_MSEC(100)); /* Give time for BLE transmission */
     nrf_system_reset();
     
     return 0;
 }
 
-static int cmd_led(const char *args, char *response, size_t response_size)
+static int cmd_led(struct cmd_ctx *ctx, const char *args)
 {
     if (!args || strlen(args) == 0) {
-        snprintf(response, response_size, "Usage: led <on|off|toggle>\n");
+        cmd_printf(ctx, "Usage: led <on|off|toggle>\n");
         return -EINVAL;
     }
     
     if (strncmp(args, "on", 2) == 0) {
         gpio_pin_set_dt(&led, 1);
-        snprintf(response, response_size, "LED turned on\n");
+        cmd_printf(ctx, "LED turned on\n");
     } else if (strncmp(args, "off", 3) == 0) {
         gpio_pin_set_dt(&led, 0);
-        snprintf(response, response_size, "LED turned off\n");
+        cmd_printf(ctx, "LED turned off\n");
     } else if (strncmp(args, "toggle", 6) == 0) {
         gpio_pin_toggle_dt(&led);
-        snprintf(response, response_size, "LED toggled\n");
+        cmd_printf(ctx, "LED toggled\n");
     } else {
-        snprintf(response, response_size, "Invalid LED command. Use: on, off, or toggle\n");
+        cmd_printf(ctx, "Invalid LED command. Use: on, off, or toggle\n");
         return -EINVAL;
     }
     
     return 0;
 }
 
-static int cmd_echo(const char *args, char *response, size_t response_size)
+static int cmd_echo(struct cmd_ctx *ctx, const char *args)
 {
     if (!args || strlen(args) == 0) {
-        snprintf(response, response_size, "Echo: (no arguments)\n");
+        cmd_printf(ctx, "Echo: (no arguments)\n");
     } else {
-        snprintf(response, response_size, "Echo: %s\n", args);
+        cmd_printf(ctx, "Echo: %s\n", args);
     }
     
     return 0;
 }
 
-static int cmd_ipc_test(const char *args, char *response, size_t response_size)
+static int cmd_ipc_test(struct cmd_ctx *ctx, const char *args)
 {
     if (!ble_is_ipc_ready()) {
-        snprintf(response, response_size, "IPC not ready - network core communication failed\n");
+        cmd_printf(ctx, "IPC not ready - network core communication failed\n");
         return -ENOTCONN;
     }
     
     int ret = ble_test_ipc_communication();
     if (ret == 0) {
-        snprintf(response, response_size, "IPC test message sent to network core\n");
+        cmd_printf(ctx, "IPC test message sent to network core\n");
     } else {
-        snprintf(response, response_size, "IPC test failed (err %d)\n", ret);
+        cmd_printf(ctx, "IPC test failed (err %d)\n", ret);
     }
     
     return ret;
 }
 
-static int execute_command(const char *cmd_line, char *response, size_t response_size)
+static int cmd_binary(struct cmd_ctx *ctx, const char *args)
+{
+    cmd_printf(ctx, "Binary mode on, opcode 0x%02x returns to text\n", CMD_OP_TEXT_MODE);
+    
+    /* Takes effect with the next received byte, this reply is still text */
+    CONTAINER_OF(ctx, struct cmd_session, ctx)->binary_mode = true;
+    return 0;
+}
+
+static int cmd_sleep(struct cmd_ctx *ctx, const char *args)
+{
+    if (!args || strlen(args) == 0) {
+        struct nrf_sleep_stats stats;
+        
+        nrf_get_sleep_stats(&stats);
+        cmd_printf(ctx, "Sleeps: %u, %u ms of %u ms uptime\n",
+                   stats.sleep_count, stats.sleep_ms, stats.uptime_ms);
+        cmd_printf(ctx, "Idle: %u%%, est. %u uA (sleep %u uA, active %u uA)\n",
+                   stats.idle_percent, stats.avg_current_ua,
+                   NRF_CURRENT_SLEEP_UA, NRF_CURRENT_ACTIVE_UA);
+        return 0;
+    }
+    
+    if (strcmp(args, "off") == 0) {
+        cmd_printf(ctx, "Entering System OFF\n");
+        cmd_flush(ctx);
+        k_sleep(K_MSEC(100)); /* Give time for BLE transmission */
+        nrf_deep_sleep(0);
+        return 0;
+    }
+    
+    char *end;
+    unsigned long duration = strtoul(args, &end, 10);
+    if (end == args || duration == 0) {
+        cmd_printf(ctx, "Usage: sleep [<ms>|off]\n");
+        return -EINVAL;
+    }
+    
+    cmd_printf(ctx, "Sleeping for %lu ms\n", duration);
+    cmd_flush(ctx);
+    supervisor_extend(SUPERVISOR_CMD, duration);
+    nrf_deep_sleep(duration);
+    cmd_printf(ctx, "Awake\n");
+    return 0;
+}
+
+static int cmd_secure(struct cmd_ctx *ctx, const char *args)
 {
-    char *cmd_name;
-    char *args;
-    char *cmd_copy;
+    uint8_t conn_id = cmd_ctx_conn_id(ctx);
+    
+    if (!args || strlen(args) == 0) {
+        int mode = ble_get_link_protection(conn_id);
+        
+        cmd_printf(ctx, "Protection: %s\n", mode < 0 ? "n/a" : ble_prot_mode_name(mode));
+        return 0;
+    }
     
-    /* Make a copy for parsing */
-    cmd_copy = k_malloc(strlen(cmd_line) + 1);
-    if (!cmd_copy) {
-        snprintf(response, response_size, "Out of memory\n");
-        return -ENOMEM;
+    int mode = -1;
+    
+    for (int i = BLE_PROT_OFF; i <= BLE_PROT_CCM; i++) {
+        if (strcmp(args, ble_prot_mode_name(i)) == 0) {
+            mode = i;
+        }
     }
     
-    strcpy(cmd_copy, cmd_line);
+    if (mode < 0) {
+        cmd_printf(ctx, "Usage: secure [off|crc|ccm]\n");
+        return -EINVAL;
+    }
+    
+    struct ble_prot_session session;
+    int ret = ble_prot_session_init(&session, mode);
+    
+    if (ret < 0) {
+        cmd_printf(ctx, "Protection %s not available (err %d)\n", args, ret);
+        return ret;
+    }
+    
+    cmd_printf(ctx, "Protection: %s", ble_prot_mode_name(mode));
+    if (mode == BLE_PROT_CCM) {
+        cmd_printf(ctx, ", salt ");
+        for (int i = 0; i < BLE_PROT_SALT_LEN; i++) {
+            cmd_printf(ctx, "%02x", session.salt[i]);
+        }
+    }
+    cmd_printf(ctx, "\n");
+    
+    /* This reply still goes out under the old session, everything after it is sealed */
+    cmd_flush(ctx);
+    return ble_link_protect(conn_id, &session);
+}
+
+static int cmd_profile(struct cmd_ctx *ctx, const char *args)
+{
+    if (args && strlen(args) > 0) {
+        if (strcmp(args, "auto") == 0) {
+            ble_set_link_profile_auto(true);
+        } else {
+            enum ble_link_profile profile = BLE_PROFILE_COUNT;
+            
+            for (int i = 0; i < BLE_PROFILE_COUNT; i++) {
+                if (strcmp(args, ble_link_profile_name(i)) == 0) {
+                    profile = i;
+                }
+            }
+            
+            if (profile == BLE_PROFILE_COUNT) {
+                cmd_printf(ctx, "Usage: profile [auto|fast|balanced|lowpower]\n");
+                return -EINVAL;
+            }
+            
+            ble_set_link_profile(profile);
+        }
+    }
+    
+    struct ble_link_info link;
+    
+    ble_get_link_info(cmd_ctx_conn_id(ctx), &link);
+    cmd_printf(ctx, "Link profile: %s (%s)\n", ble_link_profile_name(ble_get_link_profile()),
+               ble_is_link_profile_auto() ? "auto" : "fixed");
+    cmd_printf(ctx, "MTU %u, data length %u, PHY 0x%02x, chunk %u\n",
+               link.mtu, link.tx_octets, link.phy, link.chunk_size);
+    return 0;
+}
+
+static int bin_status(struct cmd_ctx *ctx, const uint8_t *payload, size_t len)
+{
+    struct nrf_battery_status battery;
+    int temp = nrf_get_temperature_celsius();
     
-    /* Parse command name and arguments */
-    cmd_name = strtok(cmd_copy, " \t");
-    args = strtok(NULL, "");
+    cmd_tlv_put_u32(ctx, CMD_TLV_UPTIME_MS, nrf_get_uptime_ms());
+    cmd_tlv_put_u8(ctx, CMD_TLV_BLE_STATE, ble_get_connection_state());
+    cmd_tlv_put_u8(ctx, CMD_TLV_IPC_READY, ble_is_ipc_ready());
     
-    if (!cmd_name) {
-        k_free(cmd_copy);
+    struct ble_peer_status peer;
+    
+    if (ble_get_peer_status(cmd_ctx_conn_id(ctx), &peer) == 0 &&
+        peer.rssi != BLE_IPC_RSSI_UNKNOWN) {
+        cmd_tlv_put_u8(ctx, CMD_TLV_RSSI_DBM, (uint8_t)peer.rssi);
+    }
+    
+    if (nrf_get_battery_status(&battery) == 0) {
+        cmd_tlv_put_u16(ctx, CMD_TLV_BATTERY_MV, battery.voltage_mv);
+        cmd_tlv_put_u8(ctx, CMD_TLV_BATTERY_PCT, battery.percentage);
+    }
+    
+    if (temp >= -100) {
+        cmd_tlv_put_u16(ctx, CMD_TLV_TEMP_C, (uint16_t)(int16_t)temp);
+    }
+    
+    return 0;
+}
+
+static int bin_battery(struct cmd_ctx *ctx, const uint8_t *payload, size_t len)
+{
+    struct nrf_battery_status battery;
+    int ret = nrf_get_battery_status(&battery);
+    
+    if (ret < 0) {
+        return ret;
+    }
+    
+    cmd_tlv_put_u16(ctx, CMD_TLV_BATTERY_MV, battery.voltage_mv);
+    cmd_tlv_put_u8(ctx, CMD_TLV_BATTERY_PCT, battery.percentage);
+    cmd_tlv_put_u8(ctx, CMD_TLV_BATTERY_FLAGS,
+                   (battery.is_present ? BIT(0) : 0) | (battery.is_charging ? BIT(1) : 0));
+    
+    return 0;
+}
+
+static int bin_temp(struct cmd_ctx *ctx, const uint8_t *payload, size_t len)
+{
+    int32_t mdeg;
+    int ret = nrf_get_temperature_mdeg(&mdeg);
+    
+    if (ret < 0) {
+        return ret;
+    }
+    
+    cmd_tlv_put_u16(ctx, CMD_TLV_TEMP_C, (uint16_t)(int16_t)(mdeg / 1000));
+    return cmd_tlv_put_u32(ctx, CMD_TLV_TEMP_MDEG, (uint32_t)mdeg);
+}
+
+/*
+ * Split a line in place into at most max_args whitespace separated slices,
+ * argc/argv style. The last slice keeps the rest of the line unsplit, so
+ * handlers still see free-form arguments. Reentrant and allocation-free.
+ */
+static size_t tokenize(char *line, char *argv[], size_t max_args)
+{
+    size_t argc = 0;
+    char *p = line;
+    
+    while (argc < max_args) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        
+        if (*p == '\0') {
+            break;
+        }
+        
+        argv[argc++] = p;
+        if (argc == max_args) {
+            break;
+        }
+        
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        
+        if (*p == '\0') {
+            break;
+        }
+        
+        *p++ = '\0';
+    }
+    
+    return argc;
+}
+
+static const struct cmd_entry *find_command(const char *name)
+{
+    const struct cmd_entry *entry;
+    size_t count;
+    
+    STRUCT_SECTION_COUNT(cmd_entry, &count);
+    
+    if (!table_sorted) {
+        for (size_t i = 0; i < count; i++) {
+            STRUCT_SECTION_GET(cmd_entry, i, &entry);
+            if (strcmp(name, entry->name) == 0) {
+                return entry;
+            }
+        }
+        return NULL;
+    }
+    
+    /* Binary search over the name-sorted ROM section */
+    size_t lo = 0;
+    size_t hi = count;
+    
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        
+        STRUCT_SECTION_GET(cmd_entry, mid, &entry);
+        int cmp = strcmp(name, entry->name);
+        if (cmp == 0) {
+            return entry;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    
+    return NULL;
+}
+
+static const struct cmd_entry *find_opcode(uint8_t opcode)
+{
+    /* Few commands have opcodes, a linear scan is cheaper than a second table */
+    STRUCT_SECTION_FOREACH(cmd_entry, entry) {
+        if (entry->bin_handler && entry->opcode == opcode) {
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
+
+static uint32_t cmd_deadline(const struct cmd_entry *entry)
+{
+    return entry->deadline_ms ? entry->deadline_ms : SUPERVISOR_CMD_DEADLINE_MS;
+}
+
+static int dispatch_command(struct cmd_ctx *ctx, size_t argc, char *argv[])
+{
+    if (argc == 0) {
         return 0; /* Empty command */
     }
     
+    const char *cmd_name = argv[0];
+    const char *args = (argc > 1) ? argv[1] : NULL;
+    
     /* Find and execute command */
-    for (size_t i = 0; i < NUM_COMMANDS; i++) {
-        if (strcmp(cmd_name, commands[i].name) == 0) {
-            int ret = commands[i].handler(args, response, response_size);
-            k_free(cmd_copy);
-            return ret;
-        }
+    const struct cmd_entry *entry = find_command(cmd_name);
+    if (entry) {
+        supervisor_begin(SUPERVISOR_CMD, trace_pack_text(entry->name), cmd_deadline(entry));
+        int ret = entry->handler(ctx, args);
+        
+        supervisor_end(SUPERVISOR_CMD);
+        return ret;
     }
     
     /* Command not found */
-    snprintf(response, response_size, "Unknown command: %s\nType 'help' for available commands\n", cmd_name);
-    k_free(cmd_copy);
+    cmd_printf(ctx, "Unknown command: %s\nType 'help' for available commands\n", cmd_name);
     return -ENOENT;
 }
 
-static int cmd_parser_process(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+static int execute_command(struct cmd_ctx *ctx, char *cmd_line)
+{
+    char *argv[2];
+    const char *tag = NULL;
+    
+    /* Parse command name and arguments in place, cmd_line is ours to modify */
+    size_t argc = tokenize(cmd_line, argv, ARRAY_SIZE(argv));
+    
+    /* Optional "@<id>" prefix, echoed after the output so clients can pipeline */
+    if (argc > 0 && argv[0][0] == '@') {
+        tag = argv[0] + 1;
+        argc = (argc > 1) ? tokenize(argv[1], argv, ARRAY_SIZE(argv)) : 0;
+    }
+    
+    uint32_t start = perf_start();
+    int ret = dispatch_command(ctx, argc, argv);
+    
+    perf_stop(PERF_T_CMD_EXEC, start);
+    perf_inc(PERF_CMD_COUNT);
+    if (ret < 0) {
+        perf_inc(PERF_CMD_ERRORS);
+        trace_event(TRACE_MOD_CMD, TRACE_EV_CMD_ERR, ctx->conn_id, ret);
+    }
+    
+    if (tag) {
+        cmd_printf(ctx, "@%s %d\n", tag, ret);
+    }
+    
+    return ret;
+}
+
+static bool rx_ring_pending(struct cmd_session *s)
+{
+    return atomic_get(&s->rx.tail) != atomic_get(&s->rx.head);
+}
+
+static void send_command_response(struct cmd_session *s, char *cmd_line)
+{
+    struct cmd_ctx *ctx = &s->ctx;
+    
+    execute_command(ctx, cmd_line);
+
+#if CMD_BATCH_RESPONSES
+    /* More input already queued, let the next responses share this chunk */
+    if (rx_ring_pending(s)) {
+        return;
+    }
+#endif
+    
+    /* Send whatever is left of the response via BLE IPC */
+    cmd_flush(ctx);
+}
+
+static void execute_bin_command(struct cmd_session *s, const struct cmd_bin_hdr *hdr,
+                                const uint8_t *payload, size_t len)
 {
-    char response[CMD_RESPONSE_MAX_LEN];
+    struct cmd_ctx *ctx = &s->ctx;
+    int ret;
+    
+    /* Send batched text output first, a frame always starts its own chunk */
+    ctx_send(ctx);
+    ctx->framed = true;
+    ctx->overflow = false;
     
-    /* Add received data to buffer */
-    for (uint16_t i = 0; i < len; i++) {
-        char c = data[i];
+    if (hdr->opcode == CMD_OP_TEXT_MODE) {
+        LOG_INF("Binary mode off");
+        s->binary_mode = false;
+        ret = 0;
+    } else {
+        const struct cmd_entry *entry = find_opcode(hdr->opcode);
+        uint32_t start = perf_start();
         
-        if (c == '\n' || c == '\r') {
-            /* End of command */
-            if (cmd_buffer_pos > 0) {
-                cmd_buffer[cmd_buffer_pos] = '\0';
-                
-                LOG_INF("Processing command: %s", cmd_buffer);
-                
-                /* Execute command */
-                int ret = execute_command(cmd_buffer, response, sizeof(response));
-                
-                /* Send response via BLE IPC */
-                if (strlen(response) > 0) {
-                    ble_send_data((uint8_t *)response, strlen(response));
-                }
-                
-                /* Reset buffer */
-                cmd_buffer_pos = 0;
-            }
-        } else if (c >= 32 && c <= 126) { /* Printable characters */
-            if (cmd_buffer_pos < CMD_MAX_LEN - 1) {
-                cmd_buffer[cmd_buffer_pos++] = c;
-            }
-        } else if (c == '\b' || c == 127) { /* Backspace */
-            if (cmd_buffer_pos > 0) {
-                cmd_buffer_pos--;
-            }
+        trace_event(TRACE_MOD_CMD, TRACE_EV_CMD, ctx->conn_id,
+                    entry ? trace_pack_text(entry->name) : 0);
+        if (entry) {
+            supervisor_begin(SUPERVISOR_CMD, trace_pack_text(entry->name), cmd_deadline(entry));
+            ret = entry->bin_handler(ctx, payload, len);
+            supervisor_end(SUPERVISOR_CMD);
+        } else {
+            ret = -ENOENT;
+        }
+        
+        perf_stop(PERF_T_CMD_EXEC, start);
+        perf_inc(PERF_CMD_COUNT);
+        if (ret < 0) {
+            perf_inc(PERF_CMD_ERRORS);
+            trace_event(TRACE_MOD_CMD, TRACE_EV_CMD_ERR, ctx->conn_id, ret);
         }
     }
     
-    return 0;
+    if (ret == 0 && ctx->overflow) {
+        ret = -ENOSPC;
+    }
+    
+    ctx_send_frame(ctx, hdr->opcode, hdr->seq, ret);
+    ctx->framed = false;
+}
+
+static uint32_t rx_ring_put(struct cmd_session *s, const uint8_t *data, uint32_t len)
+{
+    uint32_t head = atomic_get(&s->rx.head);
+    uint32_t tail = atomic_get(&s->rx.tail);
+    uint32_t space = CMD_RX_RING_SIZE - (head - tail);
+    
+    len = MIN(len, space);
+    for (uint32_t i = 0; i < len; i++) {
+        s->rx.data[(head + i) & (CMD_RX_RING_SIZE - 1)] = data[i];
+    }
+    
+    atomic_set(&s->rx.head, head + len);
+    return len;
+}
+
+static void process_bin_byte(struct cmd_session *s, uint8_t b)
+{
+    uint8_t *frame = (uint8_t *)s->line;
+    const struct cmd_bin_hdr *hdr = (const struct cmd_bin_hdr *)frame;
+    
+    /* Hunt for the start of a frame */
+    if (s->line_pos == 0 && b != CMD_BIN_SYNC) {
+        return;
+    }
+    
+    frame[s->line_pos++] = b;
+    if (s->line_pos < sizeof(*hdr)) {
+        return;
+    }
+    
+    uint16_t payload_len = sys_le16_to_cpu(hdr->len);
+    if (payload_len > CMD_BIN_MAX_REQ_PAYLOAD) {
+        LOG_WRN("Binary request too long (%u bytes), dropped", payload_len);
+        s->line_pos = 0;
+        return;
+    }
+    
+    size_t frame_len = sizeof(*hdr) + payload_len;
+    if (s->line_pos < frame_len + sizeof(uint16_t)) {
+        return;
+    }
+    
+    s->line_pos = 0;
+    
+    if (crc16_ccitt(0xffff, frame, frame_len) != sys_get_le16(frame + frame_len)) {
+        LOG_WRN("Binary frame CRC mismatch, dropped");
+        return;
+    }
+    
+    execute_bin_command(s, hdr, frame + sizeof(*hdr), payload_len);
+}
+
+static void process_rx_byte(struct cmd_session *s, char c)
+{
+    if (s->binary_mode) {
+        process_bin_byte(s, c);
+        return;
+    }
+    
+    
+    if (c == '\n' || c == '\r') {
+        /* End of command */
+        if (s->line_pos > 0) {
+            s->line[s->line_pos] = '\0';
+            
+            trace_event(TRACE_MOD_CMD, TRACE_EV_CMD, s->ctx.conn_id, trace_pack_text(s->line));
+            
+            /* Execute command and send its response */
+            send_command_response(s, s->line);
+            
+            /* Reset buffer */
+            s->line_pos = 0;
+        }
+    } else if (c >= 32 && c <= 126) { /* Printable characters */
+        if (s->line_pos < CMD_MAX_LEN - 1) {
+            s->line[s->line_pos++] = c;
+        }
+    } else if (c == '\b' || c == 127) { /* Backspace */
+        if (s->line_pos > 0) {
+            s->line_pos--;
+        }
+    }
+}
+
+static void rx_work_handler(struct k_work *work)
+{
+    struct cmd_session *s = CONTAINER_OF(work, struct cmd_session, rx_work);
+    uint32_t tail = atomic_get(&s->rx.tail);
+    
+    /* Release each byte before handling it so the producer regains space early */
+    while (tail != (uint32_t)atomic_get(&s->rx.head)) {
+        char c = s->rx.data[tail & (CMD_RX_RING_SIZE - 1)];
+        
+        atomic_set(&s->rx.tail, ++tail);
+        process_rx_byte(s, c);
+    }
+    
+    /* Ring drained, send any batched responses */
+    cmd_flush(&s->ctx);
 }
 
-int cmd_parser_process(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+static void reset_work_handler(struct k_work *work)
 {
-    /* For nRF5340 app core, conn parameter is not used since BLE is on network core */
-    ARG_UNUSED(conn);
+    struct cmd_session *s = CONTAINER_OF(work, struct cmd_session, reset_work);
+    struct cmd_ctx *ctx = &s->ctx;
+    uint32_t tail = atomic_get(&s->rx.tail);
+    uint32_t end = atomic_get(&s->rx.reset_head);
     
-    return cmd_parser_process(NULL, data, len);
+    /* Input from the old peer is dropped, whatever arrived since is the new one's */
+    if ((int32_t)(end - tail) > 0) {
+        atomic_set(&s->rx.tail, end);
+    }
+    
+    /* So are batched responses still waiting to be flushed */
+    if (ctx->tx_buf) {
+        ble_tx_buf_release(ctx->tx_buf);
+    }
+    ctx->buf = NULL;
+    ctx->tx_buf = NULL;
+    ctx->len = 0;
+    
+    s->line_pos = 0;
+    
+    if (s->binary_mode) {
+        LOG_INF("Binary mode off (conn %u)", s->ctx.conn_id);
+        s->binary_mode = false;
+    }
+}
+
+int cmd_parser_process(uint8_t conn_id, const uint8_t *data, uint16_t len)
+{
+    if (conn_id >= CMD_MAX_SESSIONS) {
+        LOG_WRN("No command session for connection %u", conn_id);
+        return -EINVAL;
+    }
+    
+    struct cmd_session *s = &sessions[conn_id];
+    uint32_t queued = rx_ring_put(s, data, len);
+    
+    k_work_submit_to_queue(&cmd_workq, &s->rx_work);
+    
+    if (queued < len) {
+        LOG_WRN("Command RX ring full, dropped %u bytes", len - queued);
+        return -ENOBUFS;
+    }
+    
+    return 0;
+}
+
+void cmd_parser_reset(uint8_t conn_id)
+{
+    if (conn_id < CMD_MAX_SESSIONS) {
+        atomic_set(&sessions[conn_id].rx.reset_head, atomic_get(&sessions[conn_id].rx.head));
+        k_work_submit_to_queue(&cmd_workq, &sessions[conn_id].reset_work);
+    }
 }
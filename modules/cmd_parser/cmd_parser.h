@@ -13,7 +13,9 @@
  */
 
 #include <zephyr/types.h>
-#include <zephyr/bluetooth/conn.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/byteorder.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,19 +24,268 @@ extern "C" {
 /** @brief Maximum command length */
 #define CMD_MAX_LEN 128
 
-/** @brief Maximum response length */
+/** @brief Response chunk size, longer output is streamed in several chunks */
 #define CMD_RESPONSE_MAX_LEN 256
 
+/**
+ * @brief Number of command sessions, one per BLE connection ID
+ *
+ * Each session has its own line buffer, text/binary mode, RX ring and
+ * response writer, so several centrals can use the parser at once. Should
+ * match BLE_MAX_CONNECTIONS; data for higher connection IDs is dropped.
+ */
+#ifndef CMD_MAX_SESSIONS
+#define CMD_MAX_SESSIONS 2
+#endif
+
+/** @brief Size of each session's RX ring between the IPC callback and the command work queue (power of two) */
+#ifndef CMD_RX_RING_SIZE
+#define CMD_RX_RING_SIZE 512
+#endif
+
+/** @brief Stack size of the command work queue thread */
+#ifndef CMD_WORKQ_STACK_SIZE
+#define CMD_WORKQ_STACK_SIZE 2048
+#endif
+
+/** @brief Priority of the command work queue thread */
+#ifndef CMD_WORKQ_PRIORITY
+#define CMD_WORKQ_PRIORITY K_PRIO_PREEMPT(7)
+#endif
+
+/**
+ * @brief Coalesce responses of commands received back to back
+ *
+ * When set, output of a command is held back while more input is already
+ * waiting in the RX ring, so e.g. "status\nbattery\ntemp\n" in one BLE
+ * write is answered with as few IPC frames as possible. Output is always
+ * sent once the ring has drained.
+ */
+#ifndef CMD_BATCH_RESPONSES
+#define CMD_BATCH_RESPONSES 1
+#endif
+
+/**
+ * @brief Binary protocol
+ *
+ * The text command 'binary' switches the parser to binary framing until
+ * CMD_OP_TEXT_MODE is received or the link is reset. Requests and
+ * responses share one frame layout:
+ *
+ *   struct cmd_bin_hdr | payload[len] | crc16 (LE)
+ *
+ * The CRC is CRC-16/CCITT (seed 0xffff) over header and payload. Responses
+ * echo the request seq, set CMD_BIN_RESP_FLAG in the opcode, carry the
+ * handler return value in status and a payload of TLV records:
+ * type (1 byte), length (1 byte), little-endian value. Frames with a bad
+ * CRC are dropped silently.
+ */
+#define CMD_BIN_SYNC 0xA5
+
+/** @brief Set in the opcode of every binary response */
+#define CMD_BIN_RESP_FLAG 0x80
+
+/** @brief Binary frame header, all fields little-endian */
+struct cmd_bin_hdr {
+    uint8_t sync;       /* CMD_BIN_SYNC */
+    uint8_t opcode;     /* enum cmd_bin_opcode, | CMD_BIN_RESP_FLAG in responses */
+    uint8_t seq;        /* Chosen by the host, echoed in the response */
+    int8_t status;      /* Zero in requests, negative errno in responses */
+    uint16_t len;       /* Payload length in bytes */
+} __packed;
+
+/** @brief Largest binary request payload, a whole request must fit the command buffer */
+#define CMD_BIN_MAX_REQ_PAYLOAD (CMD_MAX_LEN - sizeof(struct cmd_bin_hdr) - sizeof(uint16_t))
+
+/** @brief Binary protocol opcodes */
+enum cmd_bin_opcode {
+    CMD_OP_TEXT_MODE = 0x00,
+    CMD_OP_STATUS = 0x01,
+    CMD_OP_BATTERY = 0x02,
+    CMD_OP_TEMP = 0x03,
+};
+
+/** @brief TLV record types used in binary responses */
+enum cmd_tlv_type {
+    CMD_TLV_UPTIME_MS = 0x01,       /* uint32_t */
+    CMD_TLV_BLE_STATE = 0x02,       /* uint8_t, enum ble_connection_state */
+    CMD_TLV_IPC_READY = 0x03,       /* uint8_t, 0 or 1 */
+    CMD_TLV_BATTERY_MV = 0x04,      /* uint16_t */
+    CMD_TLV_BATTERY_PCT = 0x05,     /* uint8_t */
+    CMD_TLV_BATTERY_FLAGS = 0x06,   /* uint8_t, bit 0 present, bit 1 charging */
+    CMD_TLV_TEMP_C = 0x07,          /* int16_t */
+    CMD_TLV_TEMP_MDEG = 0x08,       /* int32_t, 1/1000 °C */
+    CMD_TLV_RSSI_DBM = 0x09,        /* int8_t, requesting connection, from the link status block */
+};
+
+/** @brief Streaming response writer passed to command handlers */
+struct cmd_ctx;
+
 /** @brief Command handler function type */
-typedef int (*cmd_handler_t)(const char *args, char *response, size_t response_size);
+typedef int (*cmd_handler_t)(struct cmd_ctx *ctx, const char *args);
+
+/**
+ * @brief Binary command handler function type
+ *
+ * Writes TLV records with cmd_tlv_put(). The whole response must fit in one
+ * frame of CMD_RESPONSE_MAX_LEN bytes; writes beyond that fail with -ENOSPC.
+ */
+typedef int (*cmd_bin_handler_t)(struct cmd_ctx *ctx, const uint8_t *payload, size_t len);
 
 /** @brief Command structure */
 struct cmd_entry {
     const char *name;
     const char *help;
     cmd_handler_t handler;
+    /** Binary opcode, only valid when bin_handler is set */
+    uint8_t opcode;
+    cmd_bin_handler_t bin_handler;
+    /** Supervisor deadline without output, 0 for SUPERVISOR_CMD_DEADLINE_MS */
+    uint16_t deadline_ms;
 };
 
+/**
+ * @brief Register a command from any module
+ *
+ * Entries live in an iterable ROM section that the linker sorts by entry
+ * name, so lookup is a binary search no matter how many modules add
+ * commands. The section is declared in cmd_parser.ld, which the
+ * application must add with zephyr_linker_sources(ROM_SECTIONS ...).
+ *
+ * @param _name Command name, must be a valid C identifier and unique
+ * @param _help One line help text
+ * @param _handler Handler function (@ref cmd_handler_t)
+ */
+#define CMD_DEFINE(_name, _help, _handler)                          \
+    const STRUCT_SECTION_ITERABLE(cmd_entry, cmd_entry_##_name) = {      \
+        .name = #_name,                                            \
+        .help = _help,                                             \
+        .handler = _handler,                                       \
+    }
+
+/**
+ * @brief Register a command whose handler may go longer than usual without output
+ *
+ * Handlers that stream output do not need this, every flush restarts the
+ * deadline (see supervisor.h).
+ *
+ * @param _name Command name, must be a valid C identifier and unique
+ * @param _help One line help text
+ * @param _handler Handler function (@ref cmd_handler_t)
+ * @param _deadline_ms Supervisor deadline without output, see supervisor.h
+ */
+#define CMD_DEFINE_DEADLINE(_name, _help, _handler, _deadline_ms)   \
+    const STRUCT_SECTION_ITERABLE(cmd_entry, cmd_entry_##_name) = {      \
+        .name = #_name,                                            \
+        .help = _help,                                             \
+        .handler = _handler,                                       \
+        .deadline_ms = _deadline_ms,                               \
+    }
+
+/**
+ * @brief Register a command that is also reachable in binary mode
+ *
+ * @param _name Command name, must be a valid C identifier and unique
+ * @param _help One line help text
+ * @param _handler Text handler function (@ref cmd_handler_t)
+ * @param _opcode Binary opcode, unique among binary commands
+ * @param _bin_handler Binary handler function (@ref cmd_bin_handler_t)
+ */
+#define CMD_DEFINE_BIN(_name, _help, _handler, _opcode, _bin_handler)    \
+    const STRUCT_SECTION_ITERABLE(cmd_entry, cmd_entry_##_name) = {      \
+        .name = #_name,                                            \
+        .help = _help,                                             \
+        .handler = _handler,                                       \
+        .opcode = _opcode,                                         \
+        .bin_handler = _bin_handler,                               \
+    }
+
+/**
+ * @brief Append formatted text to a command response
+ *
+ * Output is sent over BLE whenever the current chunk fills up, so total
+ * response size is unbounded while memory use stays constant. A single call
+ * can produce at most CMD_RESPONSE_MAX_LEN - 1 bytes; longer output is
+ * truncated.
+ *
+ * @param ctx Response context passed to the handler
+ * @param fmt printf-style format string
+ *
+ * @return Number of characters formatted, or negative error code
+ */
+int cmd_printf(struct cmd_ctx *ctx, const char *fmt, ...) __printf_like(2, 3);
+
+/**
+ * @brief Append raw bytes to a command response
+ *
+ * @param ctx Response context passed to the handler
+ * @param data Bytes to send
+ * @param len Number of bytes
+ *
+ * @return Number of bytes queued, or negative error code
+ */
+int cmd_write(struct cmd_ctx *ctx, const void *data, size_t len);
+
+/**
+ * @brief Send any buffered response data now
+ *
+ * Handlers only need this to lower latency in the middle of long output;
+ * the parser flushes after every command.
+ *
+ * @param ctx Response context passed to the handler
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int cmd_flush(struct cmd_ctx *ctx);
+
+/**
+ * @brief Get the connection a command came from
+ *
+ * Responses written through @p ctx already go to this connection only;
+ * handlers only need it to address other output to the same peer.
+ *
+ * @param ctx Response context passed to the handler
+ *
+ * @return Connection ID of the session
+ */
+uint8_t cmd_ctx_conn_id(const struct cmd_ctx *ctx);
+
+/**
+ * @brief Append one TLV record to a binary response
+ *
+ * @param ctx Response context passed to the handler
+ * @param type Record type (enum cmd_tlv_type)
+ * @param value Little-endian value bytes
+ * @param len Value length
+ *
+ * @return 0 on success, -ENOSPC if the record does not fit the frame
+ */
+int cmd_tlv_put(struct cmd_ctx *ctx, uint8_t type, const void *value, uint8_t len);
+
+/** @brief Append a uint8_t TLV record */
+static inline int cmd_tlv_put_u8(struct cmd_ctx *ctx, uint8_t type, uint8_t value)
+{
+    return cmd_tlv_put(ctx, type, &value, sizeof(value));
+}
+
+/** @brief Append a uint16_t TLV record */
+static inline int cmd_tlv_put_u16(struct cmd_ctx *ctx, uint8_t type, uint16_t value)
+{
+    uint8_t le[sizeof(value)];
+    
+    sys_put_le16(value, le);
+    return cmd_tlv_put(ctx, type, le, sizeof(le));
+}
+
+/** @brief Append a uint32_t TLV record */
+static inline int cmd_tlv_put_u32(struct cmd_ctx *ctx, uint8_t type, uint32_t value)
+{
+    uint8_t le[sizeof(value)];
+    
+    sys_put_le32(value, le);
+    return cmd_tlv_put(ctx, type, le, sizeof(le));
+}
+
 /**
  * @brief Initialize command parser
  *
@@ -45,13 +296,36 @@ int cmd_parser_init(void);
 /**
  * @brief Process received data as commands
  *
- * @param conn BLE connection (for sending responses)
+ * A line may start with "@<id> ", for example "@7 battery". The id is
+ * echoed after the command output as "@<id> <return code>", so clients can
+ * send several commands without waiting and match up the results.
+ *
+ * Only copies the data into the RX ring of the connection's session;
+ * parsing and command execution happen on the command work queue, so this
+ * is safe to call from the IPC receive callback. Must always be called
+ * from the same context. Responses are sent to @p conn_id only.
+ *
+ * @param conn_id BLE connection the data came from, below CMD_MAX_SESSIONS
  * @param data Received data
  * @param len Data length
  *
- * @return 0 on success, negative error code otherwise
+ * @return 0 on success, -ENOBUFS if the RX ring overflowed and data was
+ *         dropped, -EINVAL if @p conn_id has no session
+ */
+int cmd_parser_process(uint8_t conn_id, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Discard any partial command and return to text mode
+ *
+ * Call when a BLE connection drops so the next client using the same
+ * connection ID starts from a clean state. Input received up to this call
+ * and responses not yet flushed are dropped. Call from the same context
+ * as cmd_parser_process(); the reset itself runs asynchronously on the
+ * command work queue.
+ *
+ * @param conn_id Connection whose session to reset
  */
-int cmd_parser_process(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+void cmd_parser_reset(uint8_t conn_id);
 
 #ifdef __cplusplus
 }
@@ -10,10 +10,16 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/adc.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/poweroff.h>
 #include <zephyr/sys/reboot.h>
 #include <zephyr/pm/pm.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/sys/barrier.h>
 
 #ifdef CONFIG_HEAP_MEM_POOL_SIZE
 #include <zephyr/sys/heap_listener.h>
@@ -44,13 +50,155 @@ static struct adc_channel_cfg adc_cfg = {
 
 /* Temperature sensor */
 #if DT_NODE_EXISTS(DT_NODELABEL(temp))
+#define HAS_TEMP_SENSOR 1
 static const struct device *temp_dev = DEVICE_DT_GET(DT_NODELABEL(temp));
 #elif DT_NODE_EXISTS(DT_INST(0, nordic_nrf_temp))
+#define HAS_TEMP_SENSOR 1
 static const struct device *temp_dev = DEVICE_DT_GET(DT_INST(0, nordic_nrf_temp));
 #endif
 
+/* System OFF wake source */
+#if DT_NODE_EXISTS(DT_ALIAS(sw0))
+#define HAS_WAKE_BUTTON 1
+static const struct gpio_dt_spec wake_button = GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios);
+#endif
+
 static bool utils_initialized = false;
 
+/* Reset cause, read once at boot because the hardware accumulates it over resets */
+#define RESET_INFO_INIT_PRIORITY 0
+#define RESET_HINT_MAGIC 0x52535448
+
+static __noinit struct {
+    uint32_t magic;
+    uint32_t hint;
+    uint32_t arg;
+} reset_note;
+
+static uint32_t reset_cause;
+static uint32_t reset_hint;
+static uint32_t reset_hint_arg;
+
+/* Sleep state */
+static K_SEM_DEFINE(sleep_wake_sem, 0, 1);
+static const struct nrf_sleep_hooks *sleep_hooks;
+static uint32_t sleep_count;
+static uint32_t sleep_total_ms;
+static atomic_t sleeping;       /* Sensors suspended, samplers must not touch them */
+
+static int read_battery_mv(int32_t *voltage_mv);
+static int read_temperature_mdeg(int32_t *mdeg);
+
+/*
+ * Background sampler. Each one has a single writer, its work item on the
+ * system work queue, and publishes through a sequence lock: seq is odd
+ * while an update is in progress, so readers never block and simply retry
+ * if they raced with the writer.
+ */
+struct nrf_sample {
+    int32_t value;      /* Last reading, fixed point (mV, m°C) */
+    int err;            /* Result of the last reading */
+    uint32_t at;        /* Uptime of the reading in ms */
+    bool valid;
+};
+
+struct sampler {
+    struct k_work_delayable work;
+    int (*read)(int32_t *value);
+    atomic_t period_ms;
+    atomic_t seq;
+    struct nrf_sample sample;
+};
+
+static struct sampler samplers[NRF_SAMPLE_COUNT] = {
+    [NRF_SAMPLE_BATTERY] = {
+        .read = read_battery_mv,
+        .period_ms = ATOMIC_INIT(NRF_SAMPLE_BATTERY_PERIOD_MS),
+    },
+    [NRF_SAMPLE_TEMPERATURE] = {
+        .read = read_temperature_mdeg,
+        .period_ms = ATOMIC_INIT(NRF_SAMPLE_TEMP_PERIOD_MS),
+    },
+};
+
+static void sampler_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct sampler *s = CONTAINER_OF(dwork, struct sampler, work);
+    int32_t value = 0;
+    int err = s->read(&value);
+
+    atomic_inc(&s->seq);
+    barrier_dmem_fence_full();
+    s->sample.value = value;
+    s->sample.err = err;
+    s->sample.at = k_uptime_get_32();
+    s->sample.valid = true;
+    barrier_dmem_fence_full();
+    atomic_inc(&s->seq);
+
+    /* No point polling hardware that is not there */
+    uint32_t period = atomic_get(&s->period_ms);
+    if (period > 0 && err != -ENOTSUP) {
+        k_work_schedule(dwork, K_MSEC(period));
+    }
+}
+
+static int sample_get(enum nrf_sample_source source, int32_t *value)
+{
+    struct sampler *s = &samplers[source];
+    struct nrf_sample copy;
+    atomic_val_t seq;
+
+    do {
+        seq = atomic_get(&s->seq);
+        barrier_dmem_fence_full();
+        copy = s->sample;
+        barrier_dmem_fence_full();
+    } while ((seq & 1) || seq != atomic_get(&s->seq));
+
+    uint32_t max_age = 2 * (uint32_t)atomic_get(&s->period_ms);
+    if (copy.valid && (copy.err == -ENOTSUP || k_uptime_get_32() - copy.at <= max_age)) {
+        *value = copy.value;
+        return copy.err;
+    }
+
+    /* The sensors are suspended, the last reading is the best there is */
+    if (atomic_get(&sleeping)) {
+        if (!copy.valid) {
+            return -EAGAIN;
+        }
+        *value = copy.value;
+        return copy.err;
+    }
+
+    /* Not sampled yet, sampling stopped or running late */
+    return s->read(value);
+}
+
+int nrf_sampling_set_period(enum nrf_sample_source source, uint32_t period_ms)
+{
+    if (source >= NRF_SAMPLE_COUNT) {
+        return -EINVAL;
+    }
+
+    struct sampler *s = &samplers[source];
+
+    atomic_set(&s->period_ms, period_ms);
+
+    if (!utils_initialized) {
+        return 0;
+    }
+
+    if (period_ms > 0) {
+        k_work_reschedule(&s->work, K_NO_WAIT);
+    } else {
+        k_work_cancel_delayable(&s->work);
+    }
+
+    return 0;
+}
+
 int nrf_utils_init(void)
 {
     int err;
@@ -75,19 +223,149 @@ int nrf_utils_init(void)
     }
 #endif
 
-#if defined(temp_dev)
+#if defined(HAS_TEMP_SENSOR)
     /* Initialize temperature sensor */
     if (temp_dev && !device_is_ready(temp_dev)) {
         LOG_WRN("Temperature sensor not ready");
     }
 #endif
 
+    /* Start background sampling, first readings right away */
+    for (int i = 0; i < NRF_SAMPLE_COUNT; i++) {
+        k_work_init_delayable(&samplers[i].work, sampler_work_handler);
+        if (atomic_get(&samplers[i].period_ms) > 0) {
+            k_work_schedule(&samplers[i].work, K_NO_WAIT);
+        }
+    }
+
     utils_initialized = true;
     LOG_INF("nRF utilities initialized successfully");
     return 0;
 }
 
-int nrf_get_battery_voltage_mv(void)
+#if DT_NODE_EXISTS(ADC_NODE)
+/* Convert ADC value to millivolts */
+static int32_t adc_raw_to_mv(int16_t raw)
+{
+    /* For nRF52/nRF53: VDD measurement with 1/6 gain and internal reference (0.6V) */
+    /* ADC_value = VDD * (1/6) / 0.6V * 4095 */
+    /* VDD = ADC_value * 0.6V * 6 / 4095 */
+    return ((int32_t)raw * 600 * 6) / 4095;
+}
+
+/* Running totals of a burst, updated from the SAADC sampling callback */
+struct adc_burst {
+    uint32_t sum;
+    uint64_t sum_sq;
+    int32_t min;
+    int32_t max;
+    uint16_t count;
+};
+
+static enum adc_action adc_burst_callback(const struct device *dev,
+                                          const struct adc_sequence *sequence,
+                                          uint16_t sampling_index)
+{
+    struct adc_burst *burst = sequence->options->user_data;
+    const int16_t *samples = sequence->buffer;
+    int32_t mv = MAX(adc_raw_to_mv(samples[sampling_index]), 0);
+
+    burst->sum += mv;
+    burst->sum_sq += (uint64_t)mv * mv;
+    burst->min = MIN(burst->min, mv);
+    burst->max = MAX(burst->max, mv);
+    burst->count++;
+
+    /* Advance to the next buffer slot */
+    return ADC_ACTION_CONTINUE;
+}
+#endif
+
+static uint32_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+int nrf_get_battery_stats(struct nrf_battery_stats *stats, uint16_t samples)
+{
+    if (!stats || samples == 0 || samples > NRF_BATTERY_BURST_MAX) {
+        return -EINVAL;
+    }
+
+#if DT_NODE_EXISTS(ADC_NODE)
+    int16_t sample_buffer[NRF_BATTERY_BURST_MAX];
+    struct adc_burst burst = {
+        .min = INT32_MAX,
+        .max = 0,
+    };
+    int err;
+
+    const struct adc_sequence_options options = {
+        .interval_us = 0,
+        .callback = adc_burst_callback,
+        .user_data = &burst,
+        .extra_samplings = samples - 1,
+    };
+
+    struct adc_sequence sequence = {
+        .options = &options,
+        .channels = BIT(adc_cfg.channel_id),
+        .buffer = sample_buffer,
+        .buffer_size = samples * sizeof(sample_buffer[0]),
+        .resolution = 12,
+        .oversampling = NRF_BATTERY_OVERSAMPLING,
+    };
+
+    if (!device_is_ready(adc_dev)) {
+        return -ENODEV;
+    }
+
+    err = adc_read(adc_dev, &sequence);
+    if (err < 0) {
+        LOG_ERR("ADC burst read failed (err %d)", err);
+        return err;
+    }
+
+    if (burst.count == 0) {
+        return -EIO;
+    }
+
+    uint32_t mean = burst.sum / burst.count;
+    uint64_t mean_sq = burst.sum_sq / burst.count;
+
+    stats->mean_mv = mean;
+    stats->min_mv = burst.min;
+    stats->max_mv = burst.max;
+    stats->stddev_mv = isqrt(mean_sq > (uint64_t)mean * mean ? mean_sq - (uint64_t)mean * mean : 0);
+    stats->samples = burst.count;
+
+    LOG_DBG("Battery burst: %u mV mean, %u-%u mV, sd %u mV (%u samples)",
+            stats->mean_mv, stats->min_mv, stats->max_mv, stats->stddev_mv, stats->samples);
+    return 0;
+#else
+    LOG_WRN("Battery voltage monitoring not available");
+    return -ENOTSUP;
+#endif
+}
+
+static int read_battery_mv(int32_t *voltage_mv)
 {
 #if DT_NODE_EXISTS(ADC_NODE)
     int16_t sample_buffer;
@@ -98,6 +376,7 @@ int nrf_get_battery_voltage_mv(void)
         .buffer = &sample_buffer,
         .buffer_size = sizeof(sample_buffer),
         .resolution = 12,
+        .oversampling = NRF_BATTERY_OVERSAMPLING,
     };
 
     if (!device_is_ready(adc_dev)) {
@@ -110,20 +389,123 @@ int nrf_get_battery_voltage_mv(void)
         return err;
     }
 
-    /* Convert ADC value to millivolts */
-    /* For nRF52/nRF53: VDD measurement with 1/6 gain and internal reference (0.6V) */
-    /* ADC_value = VDD * (1/6) / 0.6V * 4095 */
-    /* VDD = ADC_value * 0.6V * 6 / 4095 */
-    int32_t voltage_mv = ((int32_t)sample_buffer * 600 * 6) / 4095;
+    *voltage_mv = adc_raw_to_mv(sample_buffer);
 
-    LOG_DBG("Battery voltage: %d mV (ADC: %d)", voltage_mv, sample_buffer);
-    return voltage_mv;
+    LOG_DBG("Battery voltage: %d mV (ADC: %d)", *voltage_mv, sample_buffer);
+    return 0;
 #else
     LOG_WRN("Battery voltage monitoring not available");
     return -ENOTSUP;
 #endif
 }
 
+static int read_temperature_mdeg(int32_t *mdeg)
+{
+#if defined(HAS_TEMP_SENSOR)
+    struct sensor_value temp_val;
+    int err;
+
+    if (!temp_dev || !device_is_ready(temp_dev)) {
+        return -ENODEV;
+    }
+
+    err = sensor_sample_fetch(temp_dev);
+    if (err < 0) {
+        LOG_ERR("Failed to fetch temperature sample (err %d)", err);
+        return err;
+    }
+
+    err = sensor_channel_get(temp_dev, SENSOR_CHAN_DIE_TEMP, &temp_val);
+    if (err < 0) {
+        LOG_ERR("Failed to get temperature value (err %d)", err);
+        return err;
+    }
+
+    /* val2 is in millionths, both parts carry the sign */
+    *mdeg = temp_val.val1 * 1000 + temp_val.val2 / 1000;
+    LOG_DBG("Temperature: %d m°C", *mdeg);
+    return 0;
+#else
+    LOG_WRN("Temperature sensor not available");
+    return -ENOTSUP;
+#endif
+}
+
+/* Discharge curve point, tables are sorted by ascending voltage */
+struct soc_point {
+    uint16_t mv;
+    uint8_t percent;
+};
+
+#if NRF_BATTERY_CHEMISTRY == NRF_BATTERY_CHEM_LIION
+static const struct soc_point soc_curve[] = {
+    { 3270, 0 }, { 3610, 5 }, { 3690, 10 }, { 3710, 15 }, { 3730, 20 },
+    { 3770, 30 }, { 3790, 35 }, { 3800, 40 }, { 3820, 45 }, { 3840, 50 },
+    { 3870, 60 }, { 3910, 65 }, { 3950, 70 }, { 3980, 75 }, { 4020, 80 },
+    { 4080, 85 }, { 4110, 90 }, { 4150, 95 }, { 4200, 100 },
+};
+#elif NRF_BATTERY_CHEMISTRY == NRF_BATTERY_CHEM_LIFEPO4
+static const struct soc_point soc_curve[] = {
+    { 2800, 0 }, { 3000, 9 }, { 3200, 14 }, { 3250, 20 }, { 3300, 40 },
+    { 3320, 70 }, { 3340, 90 }, { 3400, 99 }, { 3600, 100 },
+};
+#elif NRF_BATTERY_CHEMISTRY == NRF_BATTERY_CHEM_ALKALINE_2
+static const struct soc_point soc_curve[] = {
+    { 2000, 0 }, { 2200, 5 }, { 2400, 15 }, { 2600, 35 }, { 2800, 65 },
+    { 3000, 90 }, { 3200, 100 },
+};
+#else
+#error "Unknown NRF_BATTERY_CHEMISTRY"
+#endif
+
+static int battery_mv_to_percentage(int voltage_mv)
+{
+#if NRF_BATTERY_TEMP_COMP_MV_PER_C != 0
+    int32_t mdeg;
+
+    /* Cached reading, so compensation costs nothing on the sampling path */
+    if (nrf_get_temperature_mdeg(&mdeg) == 0 && mdeg < 25000) {
+        voltage_mv += ((25000 - mdeg) * NRF_BATTERY_TEMP_COMP_MV_PER_C) / 1000;
+    }
+#endif
+
+    if (voltage_mv <= soc_curve[0].mv) {
+        return soc_curve[0].percent;
+    }
+
+    if (voltage_mv >= soc_curve[ARRAY_SIZE(soc_curve) - 1].mv) {
+        return soc_curve[ARRAY_SIZE(soc_curve) - 1].percent;
+    }
+
+    /* Binary search for the first point above the voltage */
+    size_t lo = 1;
+    size_t hi = ARRAY_SIZE(soc_curve) - 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (soc_curve[mid].mv <= voltage_mv) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Linear interpolation between the neighbouring points */
+    const struct soc_point *a = &soc_curve[lo - 1];
+    const struct soc_point *b = &soc_curve[lo];
+
+    return a->percent + ((voltage_mv - a->mv) * (b->percent - a->percent)) / (b->mv - a->mv);
+}
+
+int nrf_get_battery_voltage_mv(void)
+{
+    int32_t voltage_mv;
+    int err = sample_get(NRF_SAMPLE_BATTERY, &voltage_mv);
+
+    return err < 0 ? err : voltage_mv;
+}
+
 int nrf_get_battery_percentage(void)
 {
     int voltage_mv = nrf_get_battery_voltage_mv();
@@ -131,15 +513,7 @@ int nrf_get_battery_percentage(void)
         return voltage_mv;
     }
 
-    /* Simple linear approximation for Li-ion battery */
-    /* 3000mV = 0%, 4200mV = 100% */
-    if (voltage_mv <= 3000) {
-        return 0;
-    } else if (voltage_mv >= 4200) {
-        return 100;
-    } else {
-        return ((voltage_mv - 3000) * 100) / (4200 - 3000);
-    }
+    return battery_mv_to_percentage(voltage_mv);
 }
 
 int nrf_get_battery_status(struct nrf_battery_status *status)
@@ -154,43 +528,28 @@ int nrf_get_battery_status(struct nrf_battery_status *status)
     }
 
     status->voltage_mv = voltage;
-    status->percentage = nrf_get_battery_percentage();
+    status->percentage = battery_mv_to_percentage(voltage);
     status->is_present = (voltage > 1000); /* Assume battery present if >1V */
     status->is_charging = false; /* Would need charge detection circuit */
 
     return 0;
 }
 
-int nrf_get_temperature_celsius(void)
+int nrf_get_temperature_mdeg(int32_t *mdeg)
 {
-#if defined(temp_dev)
-    struct sensor_value temp_val;
-    int err;
-
-    if (!temp_dev || !device_is_ready(temp_dev)) {
-        return -ENODEV;
+    if (!mdeg) {
+        return -EINVAL;
     }
 
-    err = sensor_sample_fetch(temp_dev);
-    if (err < 0) {
-        LOG_ERR("Failed to fetch temperature sample (err %d)", err);
-        return err;
-    }
+    return sample_get(NRF_SAMPLE_TEMPERATURE, mdeg);
+}
 
-    err = sensor_channel_get(temp_dev, SENSOR_CHAN_DIE_TEMP, &temp_val);
-    if (err < 0) {
-        LOG_ERR("Failed to get temperature value (err %d)", err);
-        return err;
-    }
+int nrf_get_temperature_celsius(void)
+{
+    int32_t mdeg;
+    int err = sample_get(NRF_SAMPLE_TEMPERATURE, &mdeg);
 
-    /* Convert to integer Celsius */
-    int temp_celsius = sensor_value_to_double(&temp_val);
-    LOG_DBG("Temperature: %d°C", temp_celsius);
-    return temp_celsius;
-#else
-    LOG_WRN("Temperature sensor not available");
-    return -ENOTSUP;
-#endif
+    return err < 0 ? err : mdeg / 1000;
 }
 
 uint32_t nrf_get_uptime_ms(void)
@@ -210,6 +569,24 @@ uint32_t nrf_get_free_heap_bytes(void)
 #endif
 }
 
+uint32_t nrf_get_heap_max_used_bytes(void)
+{
+#ifdef CONFIG_HEAP_MEM_POOL_SIZE
+    struct sys_memory_stats stats;
+    sys_heap_runtime_stats_get(&_system_heap, &stats);
+    return stats.max_allocated_bytes;
+#else
+    return 0;
+#endif
+}
+
+void nrf_reset_heap_max_used(void)
+{
+#ifdef CONFIG_HEAP_MEM_POOL_SIZE
+    sys_heap_runtime_stats_reset_max(&_system_heap);
+#endif
+}
+
 int nrf_get_system_info(struct nrf_system_info *info)
 {
     if (!info) {
@@ -220,7 +597,9 @@ int nrf_get_system_info(struct nrf_system_info *info)
     info->soc_name = CONFIG_SOC;
     info->uptime_ms = nrf_get_uptime_ms();
     info->free_heap_bytes = nrf_get_free_heap_bytes();
-    info->reset_reason = 0; /* Would need reset reason detection */
+    info->reset_reason = reset_cause;
+    info->reset_hint = reset_hint;
+    info->reset_hint_arg = reset_hint_arg;
 
     return 0;
 }
@@ -231,14 +610,160 @@ void nrf_system_reset(void)
     sys_reboot(SYS_REBOOT_COLD);
 }
 
+void nrf_set_reset_hint(uint32_t hint, uint32_t arg)
+{
+    reset_note.hint = hint;
+    reset_note.arg = arg;
+    reset_note.magic = RESET_HINT_MAGIC;
+}
+
+static int reset_info_init(void)
+{
+    if (hwinfo_get_reset_cause(&reset_cause) == 0) {
+        hwinfo_clear_reset_cause();
+    } else {
+        reset_cause = 0;
+    }
+
+    /* Anything but the magic is power-on garbage */
+    if (reset_note.magic == RESET_HINT_MAGIC) {
+        reset_hint = reset_note.hint;
+        reset_hint_arg = reset_note.arg;
+    }
+    reset_note.magic = 0;
+
+    return 0;
+}
+
+SYS_INIT(reset_info_init, APPLICATION, RESET_INFO_INIT_PRIORITY);
+
+static void sleep_suspend_peripherals(bool suspend)
+{
+    struct k_work_sync sync;
+
+    if (suspend) {
+        atomic_set(&sleeping, 1);
+
+        for (int i = 0; i < NRF_SAMPLE_COUNT; i++) {
+            /* Waits for a conversion in progress before the ADC goes down */
+            k_work_cancel_delayable_sync(&samplers[i].work, &sync);
+        }
+    }
+
+#ifdef CONFIG_PM_DEVICE
+    enum pm_device_action action = suspend ? PM_DEVICE_ACTION_SUSPEND : PM_DEVICE_ACTION_RESUME;
+
+#if DT_NODE_EXISTS(ADC_NODE)
+    pm_device_action_run(adc_dev, action);
+#endif
+#if defined(HAS_TEMP_SENSOR)
+    if (temp_dev) {
+        pm_device_action_run(temp_dev, action);
+    }
+#endif
+#endif
+
+    if (!suspend) {
+        atomic_set(&sleeping, 0);
+
+        for (int i = 0; i < NRF_SAMPLE_COUNT; i++) {
+            if (atomic_get(&samplers[i].period_ms) > 0) {
+                k_work_schedule(&samplers[i].work, K_NO_WAIT);
+            }
+        }
+    }
+}
+
+static int sleep_prepare(enum nrf_sleep_mode mode, uint32_t duration_ms)
+{
+    if (!sleep_hooks || !sleep_hooks->prepare) {
+        return 0;
+    }
+
+    int err = sleep_hooks->prepare(mode, duration_ms);
+    if (err < 0) {
+        LOG_WRN("Sleep prepare hook failed (err %d), sleeping anyway", err);
+    }
+
+    return err;
+}
+
 void nrf_deep_sleep(uint32_t duration_ms)
 {
+#if defined(HAS_WAKE_BUTTON)
+    if (duration_ms == 0) {
+        LOG_INF("Entering System OFF, wake with button");
+
+        if (!gpio_is_ready_dt(&wake_button) ||
+            gpio_pin_configure_dt(&wake_button, GPIO_INPUT) < 0 ||
+            gpio_pin_interrupt_configure_dt(&wake_button, GPIO_INT_LEVEL_ACTIVE) < 0) {
+            LOG_ERR("Failed to configure wake button, staying in System ON");
+        } else {
+            sleep_prepare(NRF_SLEEP_OFF, 0);
+            sleep_suspend_peripherals(true);
+            sys_poweroff();
+        }
+    }
+#endif
+
     LOG_INF("Entering deep sleep for %u ms", duration_ms);
-    
-    if (duration_ms > 0) {
-        k_sleep(K_MSEC(duration_ms));
+
+    sleep_prepare(NRF_SLEEP_IDLE, duration_ms);
+    sleep_suspend_peripherals(true);
+
+    uint32_t start = k_uptime_get_32();
+
+    /* Other threads keep running, an IPC message or other event can end it early */
+    k_sem_reset(&sleep_wake_sem);
+    k_sem_take(&sleep_wake_sem, duration_ms > 0 ? K_MSEC(duration_ms) : K_FOREVER);
+
+    uint32_t slept = k_uptime_get_32() - start;
+
+    sleep_suspend_peripherals(false);
+    if (sleep_hooks && sleep_hooks->resume) {
+        sleep_hooks->resume();
+    }
+
+    sleep_count++;
+    sleep_total_ms += slept;
+    LOG_INF("Woke up after %u ms", slept);
+}
+
+void nrf_sleep_wake(void)
+{
+    k_sem_give(&sleep_wake_sem);
+}
+
+void nrf_sleep_set_hooks(const struct nrf_sleep_hooks *hooks)
+{
+    sleep_hooks = hooks;
+}
+
+int nrf_get_sleep_stats(struct nrf_sleep_stats *stats)
+{
+    if (!stats) {
+        return -EINVAL;
+    }
+
+    stats->sleep_count = sleep_count;
+    stats->sleep_ms = sleep_total_ms;
+    stats->uptime_ms = k_uptime_get_32();
+
+#ifdef CONFIG_SCHED_THREAD_USAGE_ALL
+    k_thread_runtime_stats_t rt;
+
+    if (k_thread_runtime_stats_all_get(&rt) == 0 && rt.execution_cycles > 0) {
+        stats->idle_percent = (rt.idle_cycles * 100) / rt.execution_cycles;
     } else {
-        /* Enter indefinite sleep - would need wake sources configured */
-        k_sleep(K_FOREVER);
+        stats->idle_percent = 0;
     }
+#else
+    stats->idle_percent = stats->uptime_ms ?
+                          ((uint64_t)sleep_total_ms * 100) / stats->uptime_ms : 0;
+#endif
+
+    stats->avg_current_ua = (NRF_CURRENT_SLEEP_UA * stats->idle_percent +
+                             NRF_CURRENT_ACTIVE_UA * (100 - stats->idle_percent)) / 100;
+
+    return 0;
 }
@@ -16,6 +16,12 @@
  * - System information
  * - Temperature reading
  * - Reset and power management
+ *
+ * Battery and temperature are sampled in the background on the system work
+ * queue. The getters return the latest cached sample, so they are cheap
+ * and do not wake the SAADC or TEMP peripheral; the hardware is only read
+ * directly when the cached value is older than twice its refresh period.
+ * Getters must not be called from ISRs.
  */
 
 #include <zephyr/types.h>
@@ -24,13 +30,84 @@
 extern "C" {
 #endif
 
+/** @brief Default battery refresh period of the sampling service */
+#ifndef NRF_SAMPLE_BATTERY_PERIOD_MS
+#define NRF_SAMPLE_BATTERY_PERIOD_MS 30000
+#endif
+
+/** @brief Default temperature refresh period of the sampling service */
+#ifndef NRF_SAMPLE_TEMP_PERIOD_MS
+#define NRF_SAMPLE_TEMP_PERIOD_MS 10000
+#endif
+
+/**
+ * @brief SAADC hardware oversampling for battery readings
+ *
+ * Every conversion averages 2^N samples in hardware before the result is
+ * written, at no CPU cost. 0 disables oversampling.
+ */
+#ifndef NRF_BATTERY_OVERSAMPLING
+#define NRF_BATTERY_OVERSAMPLING 4
+#endif
+
+/** @brief Maximum number of conversions nrf_get_battery_stats() takes in one burst */
+#ifndef NRF_BATTERY_BURST_MAX
+#define NRF_BATTERY_BURST_MAX 32
+#endif
+
+/** @brief Battery chemistries with a built-in discharge curve */
+#define NRF_BATTERY_CHEM_LIION      0   /* Single cell Li-ion / LiPo, 4.2 V full */
+#define NRF_BATTERY_CHEM_LIFEPO4    1   /* Single cell LiFePO4, 3.6 V full */
+#define NRF_BATTERY_CHEM_ALKALINE_2 2   /* Two alkaline cells in series */
+
+/** @brief Discharge curve used for the battery percentage */
+#ifndef NRF_BATTERY_CHEMISTRY
+#define NRF_BATTERY_CHEMISTRY NRF_BATTERY_CHEM_LIION
+#endif
+
+/**
+ * @brief Temperature compensation of the state of charge, in mV per °C
+ *
+ * Cells sag under load when cold, so below 25 °C the measured voltage is
+ * raised by this much per degree before the curve lookup. Uses the cached
+ * die temperature as an estimate of the cell temperature. 0 disables.
+ */
+#ifndef NRF_BATTERY_TEMP_COMP_MV_PER_C
+#define NRF_BATTERY_TEMP_COMP_MV_PER_C 0
+#endif
+
+/**
+ * @brief Estimated application core current while asleep, in µA
+ *
+ * Used only for the current budget in nrf_get_sleep_stats(). The default
+ * is the nRF5340 System ON idle figure with RTC running; real numbers
+ * depend on the board and must be measured with a power analyzer.
+ */
+#ifndef NRF_CURRENT_SLEEP_UA
+#define NRF_CURRENT_SLEEP_UA 2
+#endif
+
+/** @brief Estimated application core current while running, in µA */
+#ifndef NRF_CURRENT_ACTIVE_UA
+#define NRF_CURRENT_ACTIVE_UA 3000
+#endif
+
+/** @brief Values refreshed by the sampling service */
+enum nrf_sample_source {
+    NRF_SAMPLE_BATTERY = 0,
+    NRF_SAMPLE_TEMPERATURE,
+    NRF_SAMPLE_COUNT,
+};
+
 /** @brief System information structure */
 struct nrf_system_info {
     const char *board_name;
     const char *soc_name;
     uint32_t uptime_ms;
     uint32_t free_heap_bytes;
-    uint8_t reset_reason;
+    uint32_t reset_reason;      /* RESET_* flags (drivers/hwinfo.h) of the last reset, 0 if unknown */
+    uint32_t reset_hint;        /* From nrf_set_reset_hint() before the last reset, 0 if none */
+    uint32_t reset_hint_arg;
 };
 
 /** @brief Battery status structure */
@@ -41,6 +118,39 @@ struct nrf_battery_status {
     bool is_present;            /* True if battery is present */
 };
 
+/** @brief Summary of a burst of battery voltage conversions */
+struct nrf_battery_stats {
+    uint16_t mean_mv;
+    uint16_t min_mv;
+    uint16_t max_mv;
+    uint16_t stddev_mv;
+    uint16_t samples;           /* Number of conversions summarized */
+};
+
+/** @brief Sleep depth passed to the sleep hooks */
+enum nrf_sleep_mode {
+    NRF_SLEEP_IDLE = 0,         /* System ON, timed or until nrf_sleep_wake() */
+    NRF_SLEEP_OFF,              /* System OFF, only a wake pin or reset restarts */
+};
+
+/** @brief Hooks run around nrf_deep_sleep(), e.g. to put the network core to sleep */
+struct nrf_sleep_hooks {
+    /** Called before sleeping; an error is logged but does not stop the sleep */
+    int (*prepare)(enum nrf_sleep_mode mode, uint32_t duration_ms);
+
+    /** Called after waking from NRF_SLEEP_IDLE */
+    void (*resume)(void);
+};
+
+/** @brief Sleep statistics and current budget estimate */
+struct nrf_sleep_stats {
+    uint32_t sleep_count;       /* Completed nrf_deep_sleep() calls */
+    uint32_t sleep_ms;          /* Total time spent in nrf_deep_sleep() */
+    uint32_t uptime_ms;
+    uint8_t idle_percent;       /* CPU idle share since boot */
+    uint32_t avg_current_ua;    /* Estimated average application core current */
+};
+
 /**
  * @brief Initialize nRF utilities
  *
@@ -63,9 +173,25 @@ int nrf_get_battery_status(struct nrf_battery_status *status);
  */
 int nrf_get_battery_voltage_mv(void);
 
+/**
+ * @brief Measure battery voltage with a burst of conversions
+ *
+ * Runs @p samples oversampled conversions back to back into one DMA buffer
+ * within a single adc_read(), then reports mean, spread and extremes.
+ * Always reads the hardware, bypassing the sampling service cache.
+ *
+ * @param stats Filled with the summary
+ * @param samples Number of conversions, 1 to NRF_BATTERY_BURST_MAX
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nrf_get_battery_stats(struct nrf_battery_stats *stats, uint16_t samples);
+
 /**
  * @brief Get battery percentage (0-100)
  *
+ * Interpolated from the discharge curve selected by NRF_BATTERY_CHEMISTRY.
+ *
  * @return Battery percentage, or negative error code
  */
 int nrf_get_battery_percentage(void);
@@ -73,10 +199,37 @@ int nrf_get_battery_percentage(void);
 /**
  * @brief Get system temperature in Celsius
  *
+ * Truncated toward zero. Errors and sub-zero temperatures share the
+ * return range, so new code should prefer nrf_get_temperature_mdeg().
+ *
  * @return Temperature in degrees Celsius, or negative error code
  */
 int nrf_get_temperature_celsius(void);
 
+/**
+ * @brief Get system temperature in milli-degrees Celsius
+ *
+ * Integer only, no floating point support needed.
+ *
+ * @param mdeg Set to the temperature in 1/1000 °C on success
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nrf_get_temperature_mdeg(int32_t *mdeg);
+
+/**
+ * @brief Change the refresh period of a sampled value
+ *
+ * Takes effect immediately with a fresh sample.
+ *
+ * @param source Value to configure
+ * @param period_ms New period, 0 stops background sampling (getters then
+ *        read the hardware on every call)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nrf_sampling_set_period(enum nrf_sample_source source, uint32_t period_ms);
+
 /**
  * @brief Get system information
  *
@@ -99,18 +252,83 @@ uint32_t nrf_get_uptime_ms(void);
  */
 uint32_t nrf_get_free_heap_bytes(void);
 
+/**
+ * @brief Get the most heap memory in use at once
+ *
+ * Tracked by the heap itself, so short-lived allocations between two
+ * calls are not missed.
+ *
+ * @return Peak allocated bytes since boot or nrf_reset_heap_max_used(),
+ *         or 0 if heap tracking disabled
+ */
+uint32_t nrf_get_heap_max_used_bytes(void);
+
+/**
+ * @brief Restart peak heap tracking from the current usage
+ */
+void nrf_reset_heap_max_used(void);
+
 /**
  * @brief Reset the system
  */
 void nrf_system_reset(void);
 
+/**
+ * @brief Leave a note about why the system is about to reset
+ *
+ * Kept in uninitialised RAM, so it survives a watchdog or software reset
+ * but not a power cycle, and reported once by nrf_get_system_info() after
+ * the next boot. The last call before the reset wins.
+ *
+ * @param hint Owner-defined reason, not 0
+ * @param arg Owner-defined detail
+ */
+void nrf_set_reset_hint(uint32_t hint, uint32_t arg);
+
 /**
  * @brief Enter deep sleep mode
  *
+ * With a duration the core stays in System ON with the ADC and temperature
+ * sensor suspended and background sampling paused; only the calling thread
+ * blocks, other threads such as the supervisor keep running and readings
+ * return the last sample (-EAGAIN if there is none) until the sleep ends.
+ * nrf_sleep_wake() ends the sleep early. A duration of 0 enters
+ * System OFF through sys_poweroff() with the sw0 button as wake source
+ * (waking resets the chip). Boards without sw0 sleep in System ON until
+ * nrf_sleep_wake() instead.
+ *
  * @param duration_ms Sleep duration in milliseconds (0 = indefinite)
  */
 void nrf_deep_sleep(uint32_t duration_ms);
 
+/**
+ * @brief End a timed or indefinite System ON sleep early
+ *
+ * Safe to call from ISRs and IPC callbacks.
+ */
+void nrf_sleep_wake(void);
+
+/**
+ * @brief Install hooks run around nrf_deep_sleep()
+ *
+ * @param hooks Hooks to use, NULL removes them
+ */
+void nrf_sleep_set_hooks(const struct nrf_sleep_hooks *hooks);
+
+/**
+ * @brief Get sleep statistics with an estimated current budget
+ *
+ * The idle share comes from kernel thread usage accounting when
+ * CONFIG_SCHED_THREAD_USAGE_ALL is enabled, otherwise only time spent in
+ * nrf_deep_sleep() counts as idle. The current is computed from
+ * NRF_CURRENT_SLEEP_UA and NRF_CURRENT_ACTIVE_UA and is an estimate only.
+ *
+ * @param stats Filled with the statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nrf_get_sleep_stats(struct nrf_sleep_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
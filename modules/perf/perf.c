@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "perf.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+
+#if defined(CONFIG_BT_NUS)
+#include <bluetooth/services/nus.h>
+#endif
+
+static const char *const counter_names[PERF_COUNTER_COUNT] = {
+    [PERF_IPC_TX_FRAMES] = "ipc_tx",
+    [PERF_IPC_TX_BYTES] = "ipc_tx_b",
+    [PERF_IPC_TX_ERRORS] = "ipc_tx_err",
+    [PERF_IPC_RX_FRAMES] = "ipc_rx",
+    [PERF_IPC_RX_BYTES] = "ipc_rx_b",
+    [PERF_IPC_RX_DROPS] = "ipc_rx_drop",
+    [PERF_TX_CHUNKS] = "tx_chunks",
+    [PERF_TX_QUEUE_FULL] = "tx_full",
+    [PERF_TX_QUEUE_PEAK] = "tx_peak_b",
+    [PERF_CMD_COUNT] = "cmd",
+    [PERF_CMD_ERRORS] = "cmd_err",
+    [PERF_PROT_SEALED] = "prot_sealed",
+    [PERF_PROT_REJECTS] = "prot_reject",
+    [PERF_PROT_DROPPED] = "prot_drop",
+    [PERF_SUP_LATE] = "sup_late",
+    [PERF_SUP_STALLS] = "sup_stall",
+};
+
+static const char *const timer_names[PERF_TIMER_COUNT] = {
+    [PERF_T_IPC_SEND] = "ipc_send",
+    [PERF_T_IPC_RX] = "ipc_rx",
+    [PERF_T_CMD_EXEC] = "cmd_exec",
+    [PERF_T_PROTECT] = "protect",
+    [PERF_T_CMD_FLUSH] = "cmd_flush",
+};
+
+static atomic_t counters[PERF_COUNTER_COUNT];
+
+static struct perf_timer_state {
+    atomic_t count;
+    atomic_t total_us;
+    atomic_t max_us;
+    atomic_t hist[PERF_HIST_BUCKETS];
+} timers[PERF_TIMER_COUNT];
+
+static atomic_t window_start_ms;
+
+#if PERF_ENABLE
+
+static void raise_to(atomic_t *target, uint32_t value)
+{
+    atomic_val_t old = atomic_get(target);
+
+    while ((uint32_t)old < value && !atomic_cas(target, old, value)) {
+        old = atomic_get(target);
+    }
+}
+
+void perf_stop(enum perf_timer timer, uint32_t start)
+{
+    struct perf_timer_state *t = &timers[timer];
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    uint32_t bucket = (us == 0) ? 0 : 32 - __builtin_clz(us);
+
+    atomic_inc(&t->count);
+    atomic_add(&t->total_us, us);
+    atomic_inc(&t->hist[MIN(bucket, PERF_HIST_BUCKETS - 1)]);
+    raise_to(&t->max_us, us);
+}
+
+void perf_add(enum perf_counter counter, uint32_t n)
+{
+    atomic_add(&counters[counter], n);
+}
+
+void perf_peak(enum perf_counter counter, uint32_t value)
+{
+    raise_to(&counters[counter], value);
+}
+
+#endif /* PERF_ENABLE */
+
+uint32_t perf_get_counter(enum perf_counter counter)
+{
+    return atomic_get(&counters[counter]);
+}
+
+void perf_get_timer(enum perf_timer timer, struct perf_timer_stats *stats)
+{
+    struct perf_timer_state *t = &timers[timer];
+
+    stats->count = atomic_get(&t->count);
+    stats->total_us = atomic_get(&t->total_us);
+    stats->max_us = atomic_get(&t->max_us);
+
+    for (int i = 0; i < PERF_HIST_BUCKETS; i++) {
+        stats->hist[i] = atomic_get(&t->hist[i]);
+    }
+}
+
+const char *perf_counter_name(enum perf_counter counter)
+{
+    return counter < PERF_COUNTER_COUNT ? counter_names[counter] : "?";
+}
+
+const char *perf_timer_name(enum perf_timer timer)
+{
+    return timer < PERF_TIMER_COUNT ? timer_names[timer] : "?";
+}
+
+void perf_reset(void)
+{
+    /* Atomic per word, an update racing the reset only skews one sample */
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        atomic_clear(&counters[i]);
+    }
+
+    for (int i = 0; i < PERF_TIMER_COUNT; i++) {
+        struct perf_timer_state *t = &timers[i];
+
+        atomic_clear(&t->count);
+        atomic_clear(&t->total_us);
+        atomic_clear(&t->max_us);
+
+        for (int b = 0; b < PERF_HIST_BUCKETS; b++) {
+            atomic_clear(&t->hist[b]);
+        }
+    }
+
+#if defined(CONFIG_BT_NUS)
+    bt_nus_get_stats(NULL, true);
+#endif
+
+    atomic_set(&window_start_ms, k_uptime_get_32());
+}
+
+uint32_t perf_window_ms(void)
+{
+    return k_uptime_get_32() - (uint32_t)atomic_get(&window_start_ms);
+}
+
+static int cmd_perf(struct cmd_ctx *ctx, const char *args)
+{
+    bool reset = args && strcmp(args, "reset") == 0;
+
+    if (args && strlen(args) > 0 && !reset) {
+        cmd_printf(ctx, "Usage: perf [reset]\n");
+        return -EINVAL;
+    }
+
+    cmd_printf(ctx, "perf %u ms\n", perf_window_ms());
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        cmd_printf(ctx, "%s %u\n", counter_names[i], perf_get_counter(i));
+    }
+
+    /* name count avg max (us), then the histogram up to the last used bucket */
+    for (int i = 0; i < PERF_TIMER_COUNT; i++) {
+        struct perf_timer_stats stats;
+        int last = -1;
+
+        perf_get_timer(i, &stats);
+
+        cmd_printf(ctx, "%s %u %u %u |", timer_names[i], stats.count,
+                   stats.count ? stats.total_us / stats.count : 0, stats.max_us);
+
+        for (int b = 0; b < PERF_HIST_BUCKETS; b++) {
+            if (stats.hist[b]) {
+                last = b;
+            }
+        }
+
+        for (int b = 0; b <= last; b++) {
+            cmd_printf(ctx, " %u", stats.hist[b]);
+        }
+
+        cmd_printf(ctx, "\n");
+    }
+
+#if defined(CONFIG_BT_NUS)
+    struct bt_nus_stats nus;
+
+    bt_nus_get_stats(&nus, false);
+    cmd_printf(ctx, "nus %u %uB err %u max %u us peak %u\n", nus.notifications, nus.bytes,
+               nus.errors, nus.send_max_us, nus.in_flight_peak);
+#endif
+
+    if (reset) {
+        perf_reset();
+    }
+
+    return 0;
+}
+
+CMD_DEFINE(perf, "Show performance counters ([reset] clears them after)", cmd_perf);
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+/**
+ * @file
+ * @brief Runtime performance counters
+ *
+ * Event counters and latency histograms for the IPC, BLE TX and command
+ * pipeline. Updates are a cycle counter read and a few atomic increments,
+ * cheap enough to leave enabled in the field. The 'perf' command dumps
+ * and resets them.
+ */
+
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Compile the counters in, 0 turns all calls into no-ops */
+#ifndef PERF_ENABLE
+#define PERF_ENABLE 1
+#endif
+
+/**
+ * @brief Number of latency histogram buckets
+ *
+ * Bucket 0 counts durations below 1 us, bucket n durations of
+ * 2^(n-1) to 2^n - 1 us, the last bucket everything longer.
+ */
+#ifndef PERF_HIST_BUCKETS
+#define PERF_HIST_BUCKETS 16
+#endif
+
+/** @brief Event counters */
+enum perf_counter {
+    PERF_IPC_TX_FRAMES,         /* Frames handed to the IPC service */
+    PERF_IPC_TX_BYTES,          /* Payload bytes of those frames */
+    PERF_IPC_TX_ERRORS,         /* ipc_service_send() failures */
+    PERF_IPC_RX_FRAMES,         /* Frames received from the network core */
+    PERF_IPC_RX_BYTES,
+    PERF_IPC_RX_DROPS,          /* Runt or truncated frames */
+    PERF_TX_CHUNKS,             /* Chunks drained from the TX rings */
+    PERF_TX_QUEUE_FULL,         /* Writes that did not fit a TX ring */
+    PERF_TX_QUEUE_PEAK,         /* Highest TX ring fill in bytes, see perf_peak() */
+    PERF_CMD_COUNT,             /* Commands executed, text and binary */
+    PERF_CMD_ERRORS,            /* Commands that returned an error */
+    PERF_PROT_SEALED,           /* Frames sealed for protected connections */
+    PERF_PROT_REJECTS,          /* Received frames failing the integrity check */
+    PERF_PROT_DROPPED,          /* Frames dropped because they could not be sealed */
+    PERF_SUP_LATE,              /* Supervised runs that finished over their deadline */
+    PERF_SUP_STALLS,            /* Supervised runs still going past their deadline */
+    PERF_COUNTER_COUNT,
+};
+
+/** @brief Latency timers */
+enum perf_timer {
+    PERF_T_IPC_SEND,            /* ipc_service_send() call */
+    PERF_T_IPC_RX,              /* Handling of a received IPC frame */
+    PERF_T_CMD_EXEC,            /* Command handler including its output */
+    PERF_T_PROTECT,             /* Sealing or opening one protected frame */
+    PERF_T_CMD_FLUSH,           /* Handing command output to the BLE TX path */
+    PERF_TIMER_COUNT,
+};
+
+/** @brief Snapshot of a latency timer */
+struct perf_timer_stats {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+    uint32_t hist[PERF_HIST_BUCKETS];
+};
+
+#if PERF_ENABLE
+
+/**
+ * @brief Take a start timestamp for perf_stop()
+ *
+ * @return Hardware cycle count
+ */
+static inline uint32_t perf_start(void)
+{
+    return k_cycle_get_32();
+}
+
+/**
+ * @brief Record the time elapsed since perf_start()
+ *
+ * @param timer Timer to update
+ * @param start Value returned by perf_start()
+ */
+void perf_stop(enum perf_timer timer, uint32_t start);
+
+/**
+ * @brief Add to an event counter
+ *
+ * @param counter Counter to update
+ * @param n Amount to add
+ */
+void perf_add(enum perf_counter counter, uint32_t n);
+
+/**
+ * @brief Raise a peak counter to @p value if it is higher
+ *
+ * @param counter Counter to update
+ * @param value Current value
+ */
+void perf_peak(enum perf_counter counter, uint32_t value);
+
+#else
+
+static inline uint32_t perf_start(void)
+{
+    return 0;
+}
+
+static inline void perf_stop(enum perf_timer timer, uint32_t start)
+{
+}
+
+static inline void perf_add(enum perf_counter counter, uint32_t n)
+{
+}
+
+static inline void perf_peak(enum perf_counter counter, uint32_t value)
+{
+}
+
+#endif /* PERF_ENABLE */
+
+/**
+ * @brief Increment an event counter
+ *
+ * @param counter Counter to update
+ */
+static inline void perf_inc(enum perf_counter counter)
+{
+    perf_add(counter, 1);
+}
+
+/**
+ * @brief Read an event counter
+ *
+ * @param counter Counter to read
+ *
+ * @return Value since boot or the last perf_reset()
+ */
+uint32_t perf_get_counter(enum perf_counter counter);
+
+/**
+ * @brief Read a latency timer
+ *
+ * Fields are read one at a time, a snapshot taken while the timer is
+ * updated may be off by one sample.
+ *
+ * @param timer Timer to read
+ * @param stats Filled with the current values
+ */
+void perf_get_timer(enum perf_timer timer, struct perf_timer_stats *stats);
+
+/**
+ * @brief Get the short name of a counter, as printed by 'perf'
+ */
+const char *perf_counter_name(enum perf_counter counter);
+
+/**
+ * @brief Get the short name of a timer, as printed by 'perf'
+ */
+const char *perf_timer_name(enum perf_timer timer);
+
+/**
+ * @brief Clear all counters and timers and restart the measuring window
+ */
+void perf_reset(void);
+
+/**
+ * @brief Get the length of the current measuring window
+ *
+ * @return Milliseconds since boot or the last perf_reset()
+ */
+uint32_t perf_window_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_H_ */
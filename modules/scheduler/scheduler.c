@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "scheduler.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(scheduler, LOG_LEVEL_INF);
+
+K_THREAD_STACK_DEFINE(sched_stack, SCHED_STACK_SIZE);
+static struct k_work_q sched_workq;
+
+/* Registered tasks, only added to, never removed */
+static struct sched_task *task_list;
+static K_MUTEX_DEFINE(task_list_lock);
+
+static void task_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct sched_task *task = CONTAINER_OF(dwork, struct sched_task, work);
+
+    task->run();
+
+    uint32_t period = atomic_get(&task->period_ms);
+    if (atomic_get(&task->running) && period > 0) {
+        k_work_schedule_for_queue(&sched_workq, dwork, K_MSEC(period));
+    }
+}
+
+int sched_init(void)
+{
+    k_work_queue_init(&sched_workq);
+    k_work_queue_start(&sched_workq, sched_stack, K_THREAD_STACK_SIZEOF(sched_stack),
+                       SCHED_PRIORITY, &(struct k_work_queue_config){ .name = "sched" });
+
+    LOG_INF("Scheduler initialized");
+    return 0;
+}
+
+int sched_task_register(struct sched_task *task)
+{
+    k_mutex_lock(&task_list_lock, K_FOREVER);
+
+    for (struct sched_task *t = task_list; t; t = t->next) {
+        if (t == task) {
+            k_mutex_unlock(&task_list_lock);
+            return -EALREADY;
+        }
+    }
+
+    k_work_init_delayable(&task->work, task_work_handler);
+    task->next = task_list;
+    task_list = task;
+
+    k_mutex_unlock(&task_list_lock);
+
+    LOG_DBG("Registered task '%s' (%u ms)", task->name, (uint32_t)atomic_get(&task->period_ms));
+    return 0;
+}
+
+void sched_task_start(struct sched_task *task)
+{
+    uint32_t period = atomic_get(&task->period_ms);
+
+    if (atomic_set(&task->running, 1)) {
+        return; /* Already running */
+    }
+
+    if (period > 0) {
+        k_work_schedule_for_queue(&sched_workq, &task->work, K_MSEC(period));
+    }
+}
+
+void sched_task_stop(struct sched_task *task)
+{
+    atomic_set(&task->running, 0);
+    k_work_cancel_delayable(&task->work);
+}
+
+int sched_task_set_period(struct sched_task *task, uint32_t period_ms)
+{
+    if (period_ms > 0 && period_ms < task->min_ms) {
+        return -EINVAL;
+    }
+
+    atomic_set(&task->period_ms, period_ms);
+
+    if (!atomic_get(&task->running)) {
+        return 0;
+    }
+
+    if (period_ms > 0) {
+        k_work_reschedule_for_queue(&sched_workq, &task->work, K_MSEC(period_ms));
+    } else {
+        k_work_cancel_delayable(&task->work);
+    }
+
+    return 0;
+}
+
+struct sched_task *sched_task_find(const char *name)
+{
+    struct sched_task *found = NULL;
+
+    k_mutex_lock(&task_list_lock, K_FOREVER);
+
+    for (struct sched_task *t = task_list; t; t = t->next) {
+        if (strcmp(t->name, name) == 0) {
+            found = t;
+            break;
+        }
+    }
+
+    k_mutex_unlock(&task_list_lock);
+    return found;
+}
+
+static int cmd_period(struct cmd_ctx *ctx, const char *args)
+{
+    if (!args || strlen(args) == 0) {
+        k_mutex_lock(&task_list_lock, K_FOREVER);
+
+        cmd_printf(ctx, "Tasks:\n");
+        for (struct sched_task *t = task_list; t; t = t->next) {
+            cmd_printf(ctx, "  %s - %u ms, min %u ms (%s)\n", t->name,
+                       (uint32_t)atomic_get(&t->period_ms), t->min_ms,
+                       atomic_get(&t->running) ? "running" : "stopped");
+        }
+
+        k_mutex_unlock(&task_list_lock);
+        return 0;
+    }
+
+    char name[16];
+    const char *value = strchr(args, ' ');
+    size_t name_len = value ? (size_t)(value - args) : strlen(args);
+
+    if (!value || name_len >= sizeof(name)) {
+        cmd_printf(ctx, "Usage: period [<task> <ms>]\n");
+        return -EINVAL;
+    }
+
+    memcpy(name, args, name_len);
+    name[name_len] = '\0';
+
+    struct sched_task *task = sched_task_find(name);
+    if (!task) {
+        cmd_printf(ctx, "Unknown task: %s\n", name);
+        return -ENOENT;
+    }
+
+    /* unsigned long is 64 bits on native_sim, check the range before narrowing */
+    char *end;
+    unsigned long long period = strtoull(value + 1, &end, 10);
+    if (end == value + 1 || *end || period > UINT32_MAX ||
+        sched_task_set_period(task, (uint32_t)period)) {
+        cmd_printf(ctx, "Invalid period: %s (0 or %u-%u ms)\n", value + 1, task->min_ms,
+                   UINT32_MAX);
+        return -EINVAL;
+    }
+
+    cmd_printf(ctx, "%s period set to %u ms\n", task->name, (uint32_t)period);
+    return 0;
+}
+
+CMD_DEFINE(period, "Show or set task periods ([<task> <ms>])", cmd_period);
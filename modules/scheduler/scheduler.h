@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+/**
+ * @file
+ * @brief Periodic task scheduler
+ *
+ * Runs named periodic tasks from delayable work items on a dedicated work
+ * queue, so nothing wakes the CPU between task deadlines. Periods can be
+ * changed at runtime, also with the 'period' command.
+ */
+
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Stack size of the scheduler work queue thread */
+#ifndef SCHED_STACK_SIZE
+#define SCHED_STACK_SIZE 2048
+#endif
+
+/** @brief Priority of the scheduler work queue thread */
+#ifndef SCHED_PRIORITY
+#define SCHED_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+/** @brief Shortest period SCHED_TASK_DEFINE() tasks accept at runtime */
+#ifndef SCHED_MIN_PERIOD_MS
+#define SCHED_MIN_PERIOD_MS 1000
+#endif
+
+/** @brief Periodic task, define with SCHED_TASK_DEFINE() */
+struct sched_task {
+    const char *name;
+    void (*run)(void);
+    uint32_t min_ms;            /* Shortest period other than 0 */
+    atomic_t period_ms;         /* 0 pauses the task */
+    atomic_t running;
+    struct k_work_delayable work;
+    struct sched_task *next;
+};
+
+/**
+ * @brief Define a periodic task named sched_task_<_name> with a minimum period
+ *
+ * @param _name Task name, must be a valid C identifier
+ * @param _run Function called every period on the scheduler work queue
+ * @param _period_ms Initial period in milliseconds
+ * @param _min_ms Shortest period sched_task_set_period() accepts
+ */
+#define SCHED_TASK_DEFINE_MIN(_name, _run, _period_ms, _min_ms)     \
+    struct sched_task sched_task_##_name = {                       \
+        .name = #_name,                                            \
+        .run = _run,                                               \
+        .min_ms = _min_ms,                                         \
+        .period_ms = ATOMIC_INIT(_period_ms),                      \
+    }
+
+/**
+ * @brief Define a periodic task named sched_task_<_name>
+ *
+ * The shortest accepted period is SCHED_MIN_PERIOD_MS.
+ *
+ * @param _name Task name, must be a valid C identifier
+ * @param _run Function called every period on the scheduler work queue
+ * @param _period_ms Initial period in milliseconds
+ */
+#define SCHED_TASK_DEFINE(_name, _run, _period_ms)                  \
+    SCHED_TASK_DEFINE_MIN(_name, _run, _period_ms, SCHED_MIN_PERIOD_MS)
+
+/**
+ * @brief Start the scheduler work queue
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int sched_init(void);
+
+/**
+ * @brief Make a task known to the scheduler and the 'period' command
+ *
+ * @param task Task to register, must stay valid forever
+ *
+ * @return 0 on success, -EALREADY if already registered
+ */
+int sched_task_register(struct sched_task *task);
+
+/**
+ * @brief Start running a task, first run after one period
+ *
+ * @param task Registered task
+ */
+void sched_task_start(struct sched_task *task);
+
+/**
+ * @brief Stop running a task
+ *
+ * @param task Registered task
+ */
+void sched_task_stop(struct sched_task *task);
+
+/**
+ * @brief Change the period of a task, effective immediately
+ *
+ * @param task Registered task
+ * @param period_ms New period in milliseconds, 0 pauses the task
+ *
+ * @return 0 on success, -EINVAL if shorter than the task minimum
+ */
+int sched_task_set_period(struct sched_task *task, uint32_t period_ms);
+
+/**
+ * @brief Look up a registered task by name
+ *
+ * @param name Task name
+ *
+ * @return Task, or NULL if not found
+ */
+struct sched_task *sched_task_find(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCHEDULER_H_ */
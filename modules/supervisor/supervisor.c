@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "supervisor.h"
+#include "../cmd_parser/cmd_parser.h"
+#include "../nrf_utils/nrf_utils.h"
+#include "../perf/perf.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/watchdog.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/reboot.h>
+#include <stdio.h>
+
+LOG_MODULE_REGISTER(supervisor, LOG_LEVEL_INF);
+
+#define WDT_NODE DT_NODELABEL(wdt0)
+#define HAS_WDT (SUPERVISOR_WDT_ENABLE && DT_NODE_HAS_STATUS(WDT_NODE, okay))
+
+BUILD_ASSERT(SUPERVISOR_WDT_TIMEOUT_MS > 2 * SUPERVISOR_CHECK_PERIOD_MS,
+             "Watchdog would bite between two regular feeds");
+BUILD_ASSERT(SUPERVISOR_WDT_TIMEOUT_MS > SUPERVISOR_IDLE_FEED_MS,
+             "Watchdog would bite between two idle feeds");
+
+static const char *const slot_names[SUPERVISOR_SLOT_COUNT] = {
+    [SUPERVISOR_CMD] = "cmd",
+    [SUPERVISOR_CMD_FLUSH] = "cmd_flush",
+    [SUPERVISOR_IPC_TX] = "ipc_tx",
+};
+
+static struct slot {
+    atomic_t start_ms;          /* 0 while idle */
+    atomic_t armed_ms;          /* Deadline counts from here, moved by supervisor_progress() */
+    atomic_t deadline_ms;
+    atomic_t tag;
+    atomic_t stall_seen;        /* Current run already counted as a stall */
+    struct supervisor_stats stats;  /* stalls written by the supervisor thread, the rest by the owner */
+} slots[SUPERVISOR_SLOT_COUNT];
+
+K_THREAD_STACK_DEFINE(supervisor_stack, SUPERVISOR_STACK_SIZE);
+static struct k_thread supervisor_thread;
+static bool initialized;
+
+/* Set while the supervisor thread waits for a run to start */
+static atomic_t sleeping;
+static K_SEM_DEFINE(wake_sem, 0, 1);
+
+#if HAS_WDT
+static const struct device *const wdt = DEVICE_DT_GET(WDT_NODE);
+static int wdt_channel = -1;
+#endif
+
+/* Command names are packed with trace_pack_text(), others are numbers */
+static const char *tag_str(enum supervisor_slot slot, uint32_t tag, char *buf, size_t size)
+{
+    if (slot == SUPERVISOR_CMD) {
+        for (int i = 0; i < 4 && i < size - 1; i++) {
+            buf[i] = (char)(tag >> (8 * i));
+        }
+        buf[MIN(4, size - 1)] = '\0';
+    } else {
+        snprintf(buf, size, "%u", tag);
+    }
+
+    return buf;
+}
+
+void supervisor_begin(enum supervisor_slot slot, uint32_t tag, uint32_t deadline_ms)
+{
+    struct slot *s = &slots[slot];
+
+    atomic_set(&s->tag, tag);
+    atomic_set(&s->deadline_ms, deadline_ms);
+    atomic_set(&s->stall_seen, 0);
+
+    uint32_t now = MAX(k_uptime_get_32(), 1);
+
+    atomic_set(&s->armed_ms, now);
+
+    /* Publish last, the supervisor thread only looks at running slots */
+    atomic_set(&s->start_ms, now);
+
+    if (atomic_cas(&sleeping, 1, 0)) {
+        k_sem_give(&wake_sem);
+    }
+}
+
+void supervisor_progress(enum supervisor_slot slot)
+{
+    struct slot *s = &slots[slot];
+
+    atomic_set(&s->armed_ms, k_uptime_get_32());
+    atomic_set(&s->stall_seen, 0);
+}
+
+void supervisor_extend(enum supervisor_slot slot, uint32_t ms)
+{
+    atomic_add(&slots[slot].deadline_ms, ms);
+}
+
+uint32_t supervisor_end(enum supervisor_slot slot)
+{
+    struct slot *s = &slots[slot];
+    uint32_t start = atomic_set(&s->start_ms, 0);
+
+    if (!start) {
+        return 0;
+    }
+
+    uint32_t now = k_uptime_get_32();
+    uint32_t elapsed = now - start;
+    uint32_t deadline = atomic_get(&s->deadline_ms);
+
+    s->stats.runs++;
+    s->stats.worst_ms = MAX(s->stats.worst_ms, elapsed);
+
+    if (now - atomic_get(&s->armed_ms) > deadline) {
+        char tag[12];
+
+        s->stats.late++;
+        perf_inc(PERF_SUP_LATE);
+        LOG_WRN("%s %s took %u ms, %u ms since progress, deadline %u ms", slot_names[slot],
+                tag_str(slot, atomic_get(&s->tag), tag, sizeof(tag)), elapsed,
+                now - (uint32_t)atomic_get(&s->armed_ms), deadline);
+    }
+
+    return elapsed;
+}
+
+void supervisor_get_stats(enum supervisor_slot slot, struct supervisor_stats *stats)
+{
+    *stats = slots[slot].stats;
+}
+
+const char *supervisor_slot_name(enum supervisor_slot slot)
+{
+    return slot < SUPERVISOR_SLOT_COUNT ? slot_names[slot] : "?";
+}
+
+static bool any_running(void)
+{
+    for (int i = 0; i < SUPERVISOR_SLOT_COUNT; i++) {
+        if (atomic_get(&slots[i].start_ms)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Returns the slot with a run past its deadline, or -1 */
+static int check_slots(void)
+{
+    uint32_t now = k_uptime_get_32();
+    int stuck = -1;
+
+    for (int i = 0; i < SUPERVISOR_SLOT_COUNT; i++) {
+        struct slot *s = &slots[i];
+        uint32_t start = atomic_get(&s->start_ms);
+        uint32_t armed = atomic_get(&s->armed_ms);
+
+        if (!start || now - armed <= atomic_get(&s->deadline_ms)) {
+            continue;
+        }
+
+        /* The command is blocked in its own flush, which has a deadline of its own */
+        if (i == SUPERVISOR_CMD && atomic_get(&slots[SUPERVISOR_CMD_FLUSH].start_ms)) {
+            continue;
+        }
+
+        stuck = i;
+
+        if (atomic_cas(&s->stall_seen, 0, 1)) {
+            char tag[12];
+
+            s->stats.stalls++;
+            perf_inc(PERF_SUP_STALLS);
+            LOG_WRN("%s %s stuck for %u ms, deadline %u ms", slot_names[i],
+                    tag_str(i, atomic_get(&s->tag), tag, sizeof(tag)), now - armed,
+                    (uint32_t)atomic_get(&s->deadline_ms));
+        }
+    }
+
+    return stuck;
+}
+
+static void bite(int slot)
+{
+    uint32_t tag = atomic_get(&slots[slot].tag);
+    char buf[12];
+
+    nrf_set_reset_hint(SUPERVISOR_RESET_HINT(slot), tag);
+    LOG_ERR("%s %s did not recover, resetting", slot_names[slot],
+            tag_str(slot, tag, buf, sizeof(buf)));
+    LOG_PANIC();
+
+    /* The watchdog is paused while the CPU sleeps, so do not wait for it */
+    sys_reboot(SYS_REBOOT_COLD);
+}
+
+static void feed(void)
+{
+#if HAS_WDT
+    if (wdt_channel >= 0) {
+        wdt_feed(wdt, wdt_channel);
+    }
+#endif
+}
+
+/* Nothing to check until a run starts, only wake to keep the watchdog fed */
+static void wait_for_run(void)
+{
+    atomic_set(&sleeping, 1);
+
+    /* A run that started before the flag was set did not give the semaphore */
+    if (!any_running()) {
+        k_sem_take(&wake_sem, HAS_WDT ? K_MSEC(SUPERVISOR_IDLE_FEED_MS) : K_FOREVER);
+    }
+
+    atomic_set(&sleeping, 0);
+}
+
+static void supervisor_run(void *p1, void *p2, void *p3)
+{
+    uint8_t strikes = 0;
+    bool biting = false;
+
+    for (;;) {
+        int stuck = check_slots();
+
+        strikes = stuck >= 0 ? strikes + 1 : 0;
+
+        if (!biting && strikes >= SUPERVISOR_STALL_STRIKES) {
+            bite(stuck);
+            biting = true;
+        }
+
+        /* Should the reboot not happen, the watchdog resets the system */
+        if (!biting) {
+            feed();
+        }
+
+        if (!biting && !any_running()) {
+            wait_for_run();
+        } else {
+            k_sleep(K_MSEC(SUPERVISOR_CHECK_PERIOD_MS));
+        }
+    }
+}
+
+int supervisor_init(void)
+{
+    if (initialized) {
+        return 0;
+    }
+
+#if HAS_WDT
+    if (!device_is_ready(wdt)) {
+        LOG_ERR("Watchdog not ready");
+        return -ENODEV;
+    }
+
+    struct wdt_timeout_cfg cfg = {
+        .window = { .min = 0, .max = SUPERVISOR_WDT_TIMEOUT_MS },
+        .flags = WDT_FLAG_RESET_SOC,
+    };
+
+    wdt_channel = wdt_install_timeout(wdt, &cfg);
+    if (wdt_channel < 0) {
+        LOG_ERR("Failed to install watchdog timeout (err %d)", wdt_channel);
+        return wdt_channel;
+    }
+
+    /*
+     * Only a busy CPU can starve the supervisor thread, so the watchdog may
+     * pause in sleep; runs stuck with the CPU idle are reset by the thread
+     */
+    int err = wdt_setup(wdt, WDT_OPT_PAUSE_IN_SLEEP | WDT_OPT_PAUSE_HALTED_BY_DBG);
+    if (err) {
+        LOG_ERR("Failed to start watchdog (err %d)", err);
+        wdt_channel = -1;
+        return err;
+    }
+#endif
+
+    struct nrf_system_info info;
+
+    if (nrf_get_system_info(&info) == 0 && SUPERVISOR_IS_RESET_HINT(info.reset_hint)) {
+        char tag[12];
+        int slot = info.reset_hint & 0xffff;
+
+        LOG_WRN("Last reset by the supervisor: %s %s stuck", supervisor_slot_name(slot),
+                tag_str(slot, info.reset_hint_arg, tag, sizeof(tag)));
+    }
+
+    k_thread_create(&supervisor_thread, supervisor_stack, K_THREAD_STACK_SIZEOF(supervisor_stack),
+                    supervisor_run, NULL, NULL, NULL, SUPERVISOR_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&supervisor_thread, "supervisor");
+    initialized = true;
+
+    LOG_INF("Supervisor started, watchdog %s", HAS_WDT ? "on" : "off");
+    return 0;
+}
+
+static int cmd_supervisor(struct cmd_ctx *ctx, const char *args)
+{
+    struct nrf_system_info info;
+
+    cmd_printf(ctx, "Supervisor: %s, watchdog %s\n", initialized ? "running" : "stopped",
+               HAS_WDT ? "on" : "off");
+    cmd_printf(ctx, "  %-10s %8s %6s %6s %8s\n", "slot", "runs", "late", "stalls", "worst_ms");
+
+    for (int i = 0; i < SUPERVISOR_SLOT_COUNT; i++) {
+        struct supervisor_stats stats;
+
+        supervisor_get_stats(i, &stats);
+        cmd_printf(ctx, "  %-10s %8u %6u %6u %8u\n", slot_names[i], stats.runs, stats.late,
+                   stats.stalls, stats.worst_ms);
+    }
+
+    if (nrf_get_system_info(&info) == 0 && SUPERVISOR_IS_RESET_HINT(info.reset_hint)) {
+        int slot = info.reset_hint & 0xffff;
+        char tag[12];
+
+        cmd_printf(ctx, "Last reset: %s %s stuck\n", supervisor_slot_name(slot),
+                   tag_str(slot, info.reset_hint_arg, tag, sizeof(tag)));
+    }
+
+    return 0;
+}
+
+CMD_DEFINE(supervisor, "Handler and TX deadline statistics", cmd_supervisor);
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SUPERVISOR_H_
+#define SUPERVISOR_H_
+
+/**
+ * @file
+ * @brief Latency supervisor backed by the hardware watchdog
+ *
+ * Code paths that must not hang wrap each run in supervisor_begin() and
+ * supervisor_end() with a deadline. A run that ends late is logged and
+ * counted (PERF_SUP_LATE). While any run is in progress the supervisor
+ * thread checks every SUPERVISOR_CHECK_PERIOD_MS for runs still going
+ * past their deadline (PERF_SUP_STALLS) and feeds the watchdog as long as
+ * nothing is stuck. After SUPERVISOR_STALL_STRIKES checks in a row with a
+ * stuck run it saves the slot and tag with nrf_set_reset_hint(), stops
+ * feeding and reboots.
+ *
+ * With nothing running the thread sleeps until supervisor_begin() wakes
+ * it, and only wakes every SUPERVISOR_IDLE_FEED_MS to feed the watchdog.
+ * The watchdog pauses while the CPU sleeps, so System ON sleep is not cut
+ * short; it still resets the system if a busy CPU starves the thread.
+ *
+ * Long runs that keep producing output call supervisor_progress(), which
+ * restarts the deadline, so the deadline bounds the time without progress
+ * rather than the whole run. Command output handed to BLE counts as
+ * progress of the command; while the command is blocked in that flush,
+ * only the flush deadline applies.
+ *
+ * Each slot has a single owner thread, so runs never nest within a slot.
+ */
+
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Feed wdt0 from the supervisor thread, 0 to only log and reboot */
+#ifndef SUPERVISOR_WDT_ENABLE
+#define SUPERVISOR_WDT_ENABLE 1
+#endif
+
+/** @brief Watchdog timeout, must be well above SUPERVISOR_CHECK_PERIOD_MS */
+#ifndef SUPERVISOR_WDT_TIMEOUT_MS
+#define SUPERVISOR_WDT_TIMEOUT_MS 4000
+#endif
+
+/** @brief Interval between checks and watchdog feeds while a run is in progress */
+#ifndef SUPERVISOR_CHECK_PERIOD_MS
+#define SUPERVISOR_CHECK_PERIOD_MS 1000
+#endif
+
+/** @brief Interval between watchdog feeds while no run is in progress */
+#ifndef SUPERVISOR_IDLE_FEED_MS
+#define SUPERVISOR_IDLE_FEED_MS (SUPERVISOR_WDT_TIMEOUT_MS / 2)
+#endif
+
+/** @brief Checks in a row with a stuck run before the system is reset */
+#ifndef SUPERVISOR_STALL_STRIKES
+#define SUPERVISOR_STALL_STRIKES 3
+#endif
+
+/** @brief Time a command handler may run without output, unless it sets its own */
+#ifndef SUPERVISOR_CMD_DEADLINE_MS
+#define SUPERVISOR_CMD_DEADLINE_MS 500
+#endif
+
+/** @brief Deadline for handing command output to the TX path */
+#ifndef SUPERVISOR_FLUSH_DEADLINE_MS
+#define SUPERVISOR_FLUSH_DEADLINE_MS 1500
+#endif
+
+/** @brief Deadline for one IPC frame sent by the BLE TX work queue */
+#ifndef SUPERVISOR_IPC_TX_DEADLINE_MS
+#define SUPERVISOR_IPC_TX_DEADLINE_MS 100
+#endif
+
+/** @brief Stack size of the supervisor thread */
+#ifndef SUPERVISOR_STACK_SIZE
+#define SUPERVISOR_STACK_SIZE 1024
+#endif
+
+/** @brief Priority of the supervisor thread, above every supervised thread */
+#ifndef SUPERVISOR_PRIORITY
+#define SUPERVISOR_PRIORITY K_PRIO_PREEMPT(2)
+#endif
+
+/** @brief Supervised code paths */
+enum supervisor_slot {
+    SUPERVISOR_CMD,         /* Command handler, tag is the packed command name */
+    SUPERVISOR_CMD_FLUSH,   /* Command output to BLE, tag is the connection ID */
+    SUPERVISOR_IPC_TX,      /* ipc_service_send() on the TX work queue, tag is the connection ID */
+    SUPERVISOR_SLOT_COUNT,
+};
+
+/** @brief nrf_set_reset_hint() value for a supervisor reset, the hint argument is the tag */
+#define SUPERVISOR_RESET_HINT(slot) (0x53560000 | (slot))
+
+/** @brief Check if a reset hint came from the supervisor */
+#define SUPERVISOR_IS_RESET_HINT(hint) (((hint) & 0xffff0000) == 0x53560000)
+
+/** @brief Per-slot statistics */
+struct supervisor_stats {
+    uint32_t runs;
+    uint32_t late;          /* Runs that ended over their deadline */
+    uint32_t stalls;        /* Runs seen still going past their deadline */
+    uint32_t worst_ms;      /* Longest run since boot */
+};
+
+/**
+ * @brief Start the watchdog and the supervisor thread
+ *
+ * The watchdog cannot be stopped once started.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int supervisor_init(void);
+
+/**
+ * @brief Start a supervised run
+ *
+ * @param slot Slot, owned by the calling thread
+ * @param tag Identifies the run in logs and the reset hint
+ * @param deadline_ms Time the run may take, or go without progress
+ */
+void supervisor_begin(enum supervisor_slot slot, uint32_t tag, uint32_t deadline_ms);
+
+/**
+ * @brief Report progress of the current run, restarting its deadline
+ *
+ * @param slot Slot, owned by the calling thread
+ */
+void supervisor_progress(enum supervisor_slot slot);
+
+/**
+ * @brief Give the current run of a slot more time, e.g. before a long sleep
+ *
+ * @param slot Slot, owned by the calling thread
+ * @param ms Added to the deadline
+ */
+void supervisor_extend(enum supervisor_slot slot, uint32_t ms);
+
+/**
+ * @brief End a supervised run
+ *
+ * @param slot Slot, owned by the calling thread
+ *
+ * @return Duration of the run in milliseconds
+ */
+uint32_t supervisor_end(enum supervisor_slot slot);
+
+/**
+ * @brief Get the statistics of a slot
+ *
+ * @param slot Slot
+ * @param stats Filled with the counters since boot
+ */
+void supervisor_get_stats(enum supervisor_slot slot, struct supervisor_stats *stats);
+
+/**
+ * @brief Get the name of a slot
+ */
+const char *supervisor_slot_name(enum supervisor_slot slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUPERVISOR_H_ */
@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "telemetry.h"
+#include "../nrf_utils/nrf_utils.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if TELEMETRY_FLASH
+#include <zephyr/storage/flash_map.h>
+#endif
+
+LOG_MODULE_REGISTER(telemetry, LOG_LEVEL_INF);
+
+BUILD_ASSERT(sizeof(struct telemetry_record) == 8, "Telemetry record must stay 8 bytes");
+BUILD_ASSERT(IS_POWER_OF_TWO(TELEMETRY_RAM_RECORDS), "TELEMETRY_RAM_RECORDS must be a power of two");
+
+/*
+ * RAM ring. ram_head counts every record added since boot, so positions
+ * are absolute and a reader can tell when a record has been overwritten.
+ */
+static struct telemetry_record ram_ring[TELEMETRY_RAM_RECORDS];
+static uint32_t ram_head;
+static uint32_t ram_floor;  /* Records below this were cleared */
+static struct k_spinlock ram_lock;
+
+/* Erased flash, also sent in place of records lost during a dump */
+static const uint8_t erased_record[sizeof(struct telemetry_record)] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static void sample_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+
+#if TELEMETRY_FLASH
+#if !FIXED_PARTITION_EXISTS(telemetry_partition)
+#error "TELEMETRY_FLASH needs a telemetry_partition in the devicetree"
+#endif
+
+/*
+ * Flash log. The partition is a ring of record slots. The next page is
+ * erased before the last slot of the current one is written, so there is
+ * always an erased slot at the write position, even after a reset in the
+ * middle of an erase. After a reset the write position is the erased slot
+ * that follows a written one, and the valid records are the ones before it.
+ */
+#define RECORDS_PER_PAGE (TELEMETRY_FLASH_PAGE_SIZE / sizeof(struct telemetry_record))
+
+static const struct flash_area *flash;
+static K_MUTEX_DEFINE(flash_lock);
+static uint32_t flash_slots;
+static uint32_t flash_head;     /* Next slot to write */
+static uint32_t flash_count;    /* Valid records in flash */
+static uint32_t flash_synced;   /* RAM records below this are in flash */
+static uint32_t flash_total;    /* Records ever appended, the oldest valid one is total - count */
+
+static bool slot_read(uint32_t slot, struct telemetry_record *rec)
+{
+    if (flash_area_read(flash, slot * sizeof(*rec), rec, sizeof(*rec)) < 0) {
+        return false;
+    }
+
+    return memcmp(rec, erased_record, sizeof(*rec)) != 0;
+}
+
+static int flash_erase_page(uint32_t slot)
+{
+    return flash_area_erase(flash, slot * sizeof(struct telemetry_record),
+                            TELEMETRY_FLASH_PAGE_SIZE);
+}
+
+static int flash_scan(void)
+{
+    struct telemetry_record rec;
+    bool prev_valid = slot_read(flash_slots - 1, &rec);
+    bool found = false;
+
+    flash_head = 0;
+    flash_count = 0;
+
+    for (uint32_t slot = 0; slot < flash_slots; slot++) {
+        bool valid = slot_read(slot, &rec);
+
+        if (valid) {
+            flash_count++;
+        } else if (prev_valid && !found) {
+            flash_head = slot;
+            found = true;
+        }
+        prev_valid = valid;
+    }
+
+    flash_total = flash_count;
+
+    if (!found && flash_count > 0) {
+        /* No write position, so their order is unknown: start over rather than mix them up */
+        LOG_WRN("Telemetry log has no erased slot, erasing it");
+        flash_count = 0;
+        flash_total = 0;
+        return flash_area_erase(flash, 0, flash_slots * sizeof(rec));
+    }
+
+    return 0;
+}
+
+static int flash_append(const struct telemetry_record *rec)
+{
+    /* Erase the next page before filling this one, there must always be an erased slot */
+    if (flash_head % RECORDS_PER_PAGE == RECORDS_PER_PAGE - 1) {
+        int err = flash_erase_page((flash_head + 1) % flash_slots);
+        if (err < 0) {
+            return err;
+        }
+
+        flash_count = MIN(flash_count, flash_slots - RECORDS_PER_PAGE - 1);
+    }
+
+    int err = flash_area_write(flash, flash_head * sizeof(*rec), rec, sizeof(*rec));
+    if (err < 0) {
+        return err;
+    }
+
+    flash_count++;
+    flash_total++;
+    flash_head = (flash_head + 1) % flash_slots;
+
+    return 0;
+}
+
+static void flash_flush(void)
+{
+    struct telemetry_record rec;
+    k_spinlock_key_t key;
+    uint32_t head;
+
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    key = k_spin_lock(&ram_lock);
+    head = ram_head;
+    /* Anything overwritten in RAM before it was flushed is lost */
+    flash_synced = MAX(flash_synced, MAX(ram_floor, head - MIN(head, TELEMETRY_RAM_RECORDS)));
+    k_spin_unlock(&ram_lock, key);
+
+    while (flash_synced != head) {
+        key = k_spin_lock(&ram_lock);
+        rec = ram_ring[flash_synced & (TELEMETRY_RAM_RECORDS - 1)];
+        k_spin_unlock(&ram_lock, key);
+
+        if (flash_append(&rec) < 0) {
+            LOG_ERR("Telemetry flash write failed, will retry");
+            break;
+        }
+        flash_synced++;
+    }
+
+    k_mutex_unlock(&flash_lock);
+}
+#endif /* TELEMETRY_FLASH */
+
+void telemetry_read_current(struct telemetry_record *rec)
+{
+    int32_t mdeg;
+    int mv = nrf_get_battery_voltage_mv();
+
+    /* Both readings come from the nrf_utils sampling cache */
+    rec->uptime_s = sys_cpu_to_le32(k_uptime_get_32() / 1000);
+    rec->battery_mv = sys_cpu_to_le16(mv > 0 ? mv : 0);
+    rec->temp_cdeg = (nrf_get_temperature_mdeg(&mdeg) == 0) ?
+                     sys_cpu_to_le16(mdeg / 10) : sys_cpu_to_le16(TELEMETRY_TEMP_INVALID);
+}
+
+void telemetry_sample(void)
+{
+    struct telemetry_record rec;
+    k_spinlock_key_t key;
+
+    telemetry_read_current(&rec);
+
+    key = k_spin_lock(&ram_lock);
+    ram_ring[ram_head & (TELEMETRY_RAM_RECORDS - 1)] = rec;
+    ram_head++;
+    k_spin_unlock(&ram_lock, key);
+
+#if TELEMETRY_FLASH
+    if (flash && ram_head - flash_synced >= TELEMETRY_FLASH_BATCH) {
+        flash_flush();
+    }
+#endif
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+    telemetry_sample();
+    k_work_schedule(k_work_delayable_from_work(work), K_MSEC(TELEMETRY_PERIOD_MS));
+}
+
+void telemetry_delta_reset(struct telemetry_delta_enc *enc)
+{
+    memset(enc, 0, sizeof(*enc));
+}
+
+bool telemetry_delta_changed(const struct telemetry_delta_enc *enc,
+                             const struct telemetry_record *rec)
+{
+    int32_t mv = sys_le16_to_cpu(rec->battery_mv);
+    int32_t temp = (int16_t)sys_le16_to_cpu(rec->temp_cdeg);
+
+    if (!enc->have_prev) {
+        return true;
+    }
+
+    return abs(mv - enc->battery_mv) >= TELEMETRY_CHANGE_MV ||
+           abs(temp - enc->temp_cdeg) >= TELEMETRY_CHANGE_CDEG;
+}
+
+static size_t put_varint(uint8_t *buf, uint32_t value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        buf[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+
+    return n;
+}
+
+/* Map signed to unsigned so small negative deltas stay short: 0, -1, 1, -2, ... */
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+size_t telemetry_delta_encode(struct telemetry_delta_enc *enc,
+                              const struct telemetry_record *rec, uint8_t *buf)
+{
+    uint32_t uptime = sys_le32_to_cpu(rec->uptime_s);
+    int32_t mv = sys_le16_to_cpu(rec->battery_mv);
+    int32_t temp = (int16_t)sys_le16_to_cpu(rec->temp_cdeg);
+    bool key = !enc->have_prev || enc->since_key >= TELEMETRY_DELTA_KEY_INTERVAL;
+    size_t n = 0;
+
+    buf[n++] = TELEMETRY_DELTA_MAGIC;
+    buf[n++] = key ? TELEMETRY_DELTA_FLAG_KEY : 0;
+
+    if (key) {
+        n += put_varint(buf + n, zigzag(uptime));
+        n += put_varint(buf + n, zigzag(mv));
+        n += put_varint(buf + n, zigzag(temp));
+        enc->since_key = 0;
+    } else {
+        n += put_varint(buf + n, zigzag(uptime - enc->uptime_s));
+        n += put_varint(buf + n, zigzag(mv - enc->battery_mv));
+        n += put_varint(buf + n, zigzag(temp - enc->temp_cdeg));
+        enc->since_key++;
+    }
+
+    enc->uptime_s = uptime;
+    enc->battery_mv = mv;
+    enc->temp_cdeg = temp;
+    enc->have_prev = true;
+
+    return n;
+}
+
+/* Oldest record still in RAM, call with ram_lock held */
+static uint32_t ram_oldest(void)
+{
+    return MAX(ram_floor, ram_head - MIN(ram_head, TELEMETRY_RAM_RECORDS));
+}
+
+/* First RAM record not already covered by flash, call with ram_lock held */
+static uint32_t ram_start(void)
+{
+    uint32_t start = ram_oldest();
+
+#if TELEMETRY_FLASH
+    if (flash) {
+        start = MAX(start, flash_synced);
+    }
+#endif
+
+    return start;
+}
+
+size_t telemetry_count(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&ram_lock);
+    size_t count = ram_head - ram_start();
+
+    k_spin_unlock(&ram_lock, key);
+
+#if TELEMETRY_FLASH
+    count += flash_count;
+#endif
+
+    return count;
+}
+
+int telemetry_foreach(telemetry_cb_t cb, void *user_data)
+{
+    struct telemetry_record rec;
+    k_spinlock_key_t key;
+    int visited = 0;
+    uint32_t pos;
+    uint32_t end;
+
+    if (!cb) {
+        return -EINVAL;
+    }
+
+#if TELEMETRY_FLASH
+    uint32_t first_seq = 0;
+    uint32_t seq_end = 0;
+    uint32_t slot = 0;
+
+    /*
+     * Only the boundaries are taken under the lock, the callback may block
+     * for a long time. Records flushed meanwhile are still visited from RAM,
+     * records erased meanwhile are skipped.
+     */
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    if (flash) {
+        first_seq = flash_total - flash_count;
+        seq_end = flash_total;
+        slot = (flash_head + flash_slots - flash_count) % flash_slots;
+    }
+    key = k_spin_lock(&ram_lock);
+    pos = ram_start();
+    end = ram_head;
+    k_spin_unlock(&ram_lock, key);
+    k_mutex_unlock(&flash_lock);
+
+    for (uint32_t seq = first_seq; seq != seq_end; seq++) {
+        k_mutex_lock(&flash_lock, K_FOREVER);
+        bool valid = seq - (flash_total - flash_count) < flash_count && slot_read(slot, &rec);
+        k_mutex_unlock(&flash_lock);
+
+        slot = (slot + 1) % flash_slots;
+        if (!valid) {
+            continue;
+        }
+
+        visited++;
+        if (!cb(&rec, user_data)) {
+            return visited;
+        }
+    }
+#else
+    key = k_spin_lock(&ram_lock);
+    pos = ram_start();
+    end = ram_head;
+    k_spin_unlock(&ram_lock, key);
+#endif
+
+    /* Copy one record at a time, the callback may block */
+    while (pos < end) {
+        key = k_spin_lock(&ram_lock);
+        pos = MAX(pos, ram_oldest());
+        bool valid = pos < end;
+        if (valid) {
+            rec = ram_ring[pos & (TELEMETRY_RAM_RECORDS - 1)];
+            pos++;
+        }
+        k_spin_unlock(&ram_lock, key);
+
+        if (!valid) {
+            break;
+        }
+
+        visited++;
+        if (!cb(&rec, user_data)) {
+            break;
+        }
+    }
+
+    return visited;
+}
+
+int telemetry_clear(void)
+{
+    k_spinlock_key_t key;
+    int err = 0;
+
+#if TELEMETRY_FLASH
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    if (flash) {
+        err = flash_area_erase(flash, 0, flash_slots * sizeof(struct telemetry_record));
+        flash_head = 0;
+        flash_count = 0;
+    }
+#endif
+
+    key = k_spin_lock(&ram_lock);
+    ram_floor = ram_head;
+#if TELEMETRY_FLASH
+    flash_synced = ram_head;
+#endif
+    k_spin_unlock(&ram_lock, key);
+
+#if TELEMETRY_FLASH
+    k_mutex_unlock(&flash_lock);
+#endif
+
+    LOG_INF("Telemetry cleared");
+    return err;
+}
+
+int telemetry_init(void)
+{
+#if TELEMETRY_FLASH
+    int err = flash_area_open(FIXED_PARTITION_ID(telemetry_partition), &flash);
+    if (err < 0) {
+        LOG_ERR("Failed to open telemetry partition (err %d), RAM only", err);
+        flash = NULL;
+    } else {
+        flash_slots = (flash->fa_size / TELEMETRY_FLASH_PAGE_SIZE) * RECORDS_PER_PAGE;
+
+        err = (flash_slots >= 2 * RECORDS_PER_PAGE) ? flash_scan() : -EINVAL;
+        if (err < 0) {
+            LOG_ERR("Telemetry partition unusable (err %d), RAM only", err);
+            flash_area_close(flash);
+            flash = NULL;
+        } else {
+            LOG_INF("Telemetry flash: %u records stored", flash_count);
+        }
+    }
+#endif
+
+    k_work_schedule(&sample_work, K_NO_WAIT);
+
+    LOG_INF("Telemetry initialized (every %u s)", TELEMETRY_PERIOD_MS / 1000);
+    return 0;
+}
+
+/* Commands */
+
+struct dump_state {
+    struct cmd_ctx *ctx;
+    uint32_t remaining;
+};
+
+static bool dump_record(const struct telemetry_record *rec, void *user_data)
+{
+    struct dump_state *state = user_data;
+
+    if (state->remaining == 0) {
+        return false;
+    }
+
+    state->remaining--;
+    return cmd_write(state->ctx, rec, sizeof(*rec)) >= 0;
+}
+
+static int cmd_log(struct cmd_ctx *ctx, const char *args)
+{
+    if (args && strncmp(args, "dump", 4) == 0) {
+        struct dump_state state = {
+            .ctx = ctx,
+            .remaining = telemetry_count(),
+        };
+
+        /* Text header, then exactly that many raw records */
+        cmd_printf(ctx, "log: %u records of %u bytes\n",
+                   state.remaining, (unsigned int)sizeof(struct telemetry_record));
+
+        int ret = telemetry_foreach(dump_record, &state);
+
+        /* Records dropped while dumping are sent as erased records */
+        while (state.remaining > 0) {
+            cmd_write(ctx, erased_record, sizeof(erased_record));
+            state.remaining--;
+        }
+
+        return ret < 0 ? ret : 0;
+    }
+
+    if (args && strncmp(args, "clear", 5) == 0) {
+        int ret = telemetry_clear();
+
+        if (ret < 0) {
+            cmd_printf(ctx, "Telemetry clear failed (err %d)\n", ret);
+        } else {
+            cmd_printf(ctx, "Telemetry cleared\n");
+        }
+        return ret;
+    }
+
+    bool flash_on = false;
+
+#if TELEMETRY_FLASH
+    flash_on = (flash != NULL);
+#endif
+
+    cmd_printf(ctx, "Telemetry: %u records, every %u s, flash %s\n"
+               "Usage: log <dump|clear>\n",
+               (unsigned int)telemetry_count(), TELEMETRY_PERIOD_MS / 1000,
+               flash_on ? "on" : "off");
+    return 0;
+}
+
+CMD_DEFINE(log, "Telemetry history (dump|clear)", cmd_log);
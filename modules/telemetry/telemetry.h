@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+/**
+ * @file
+ * @brief On-device telemetry history
+ *
+ * Periodically records uptime, battery voltage and temperature into a RAM
+ * ring of fixed size records, optionally persisted to the
+ * telemetry_partition flash partition so history survives a reset. The
+ * 'log' command streams the history out in bulk.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Interval between telemetry records */
+#ifndef TELEMETRY_PERIOD_MS
+#define TELEMETRY_PERIOD_MS 60000
+#endif
+
+/** @brief Number of records kept in RAM (power of two) */
+#ifndef TELEMETRY_RAM_RECORDS
+#define TELEMETRY_RAM_RECORDS 512
+#endif
+
+/**
+ * @brief Persist records to the telemetry_partition flash partition
+ *
+ * Requires CONFIG_FLASH and CONFIG_FLASH_MAP and the partition from the
+ * example overlay.
+ */
+#ifndef TELEMETRY_FLASH
+#define TELEMETRY_FLASH 0
+#endif
+
+/** @brief Number of new records collected in RAM before a flash write */
+#ifndef TELEMETRY_FLASH_BATCH
+#define TELEMETRY_FLASH_BATCH 64
+#endif
+
+/** @brief Erase page size of the telemetry partition */
+#ifndef TELEMETRY_FLASH_PAGE_SIZE
+#define TELEMETRY_FLASH_PAGE_SIZE 4096
+#endif
+
+/** @brief Force an absolute (key) frame after this many delta frames */
+#ifndef TELEMETRY_DELTA_KEY_INTERVAL
+#define TELEMETRY_DELTA_KEY_INTERVAL 16
+#endif
+
+/** @brief Battery change in mV that counts as a change worth sending */
+#ifndef TELEMETRY_CHANGE_MV
+#define TELEMETRY_CHANGE_MV 20
+#endif
+
+/** @brief Temperature change in 1/100 °C that counts as a change worth sending */
+#ifndef TELEMETRY_CHANGE_CDEG
+#define TELEMETRY_CHANGE_CDEG 50
+#endif
+
+/** @brief Temperature value stored when no reading was available */
+#define TELEMETRY_TEMP_INVALID INT16_MIN
+
+/** @brief Telemetry record, little-endian as stored and sent */
+struct telemetry_record {
+    uint32_t uptime_s;          /* Seconds since boot */
+    uint16_t battery_mv;        /* 0 if unavailable */
+    int16_t temp_cdeg;          /* 1/100 °C, TELEMETRY_TEMP_INVALID if unavailable */
+} __packed;
+
+/**
+ * @brief Compact delta encoding
+ *
+ * Frame layout: TELEMETRY_DELTA_MAGIC, flags, then uptime_s, battery_mv
+ * and temp_cdeg as zigzag varints (LEB128, 7 bits per byte). Key frames
+ * (TELEMETRY_DELTA_FLAG_KEY) carry absolute values, all other frames the
+ * difference to the previous frame of the same encoder. A steady reading
+ * costs 5 bytes.
+ */
+#define TELEMETRY_DELTA_MAGIC 0xD7
+
+/** @brief Frame carries absolute values */
+#define TELEMETRY_DELTA_FLAG_KEY BIT(0)
+
+/** @brief Largest encoded frame */
+#define TELEMETRY_DELTA_MAX_LEN (2 + 3 * 5)
+
+/** @brief Delta encoder state, one per stream */
+struct telemetry_delta_enc {
+    uint32_t uptime_s;
+    int32_t battery_mv;
+    int32_t temp_cdeg;
+    uint8_t since_key;
+    bool have_prev;
+};
+
+/**
+ * @brief Record callback for telemetry_foreach()
+ *
+ * @return true to continue, false to stop iterating
+ */
+typedef bool (*telemetry_cb_t)(const struct telemetry_record *rec, void *user_data);
+
+/**
+ * @brief Initialize telemetry and start periodic recording
+ *
+ * Call after nrf_utils_init().
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int telemetry_init(void);
+
+/**
+ * @brief Add a record with the current readings right away
+ */
+void telemetry_sample(void);
+
+/**
+ * @brief Fill a record with the current readings without storing it
+ *
+ * @param rec Record to fill
+ */
+void telemetry_read_current(struct telemetry_record *rec);
+
+/**
+ * @brief Restart an encoder, the next frame will be a key frame
+ *
+ * @param enc Encoder state
+ */
+void telemetry_delta_reset(struct telemetry_delta_enc *enc);
+
+/**
+ * @brief Check if a record differs enough from the last encoded one
+ *
+ * @param enc Encoder state
+ * @param rec New record
+ *
+ * @return true if nothing was encoded yet or battery or temperature moved
+ *         by at least TELEMETRY_CHANGE_MV / TELEMETRY_CHANGE_CDEG
+ */
+bool telemetry_delta_changed(const struct telemetry_delta_enc *enc,
+                             const struct telemetry_record *rec);
+
+/**
+ * @brief Encode a record relative to the previous one
+ *
+ * @param enc Encoder state, updated
+ * @param rec Record to encode
+ * @param buf Output, at least TELEMETRY_DELTA_MAX_LEN bytes
+ *
+ * @return Encoded frame length
+ */
+size_t telemetry_delta_encode(struct telemetry_delta_enc *enc,
+                              const struct telemetry_record *rec, uint8_t *buf);
+
+/**
+ * @brief Get the number of records available
+ *
+ * @return Records in flash plus records only held in RAM
+ */
+size_t telemetry_count(void);
+
+/**
+ * @brief Visit all records, oldest first
+ *
+ * May block on flash access, so must not be called from ISRs.
+ *
+ * @param cb Called for every record
+ * @param user_data Passed to @p cb
+ *
+ * @return Number of records visited, or negative error code
+ */
+int telemetry_foreach(telemetry_cb_t cb, void *user_data);
+
+/**
+ * @brief Discard all records in RAM and flash
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int telemetry_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_H_ */
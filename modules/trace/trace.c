@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trace.h"
+#include "../cmd_parser/cmd_parser.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <stdlib.h>
+#include <string.h>
+
+BUILD_ASSERT(IS_POWER_OF_TWO(TRACE_RING_RECORDS), "TRACE_RING_RECORDS must be a power of two");
+
+/* Dictionary, the ring only holds the event IDs */
+static const struct {
+    const char *fmt;
+    bool text;
+} dictionary[TRACE_EVENT_COUNT] = {
+    [TRACE_EV_IPC_RX] = { "ipc rx type %u len %u" },
+    [TRACE_EV_IPC_TX] = { "ipc tx type %u len %u" },
+    [TRACE_EV_DATA_RX] = { "data rx conn %u len %u" },
+    [TRACE_EV_APP_RX] = { "app rx conn %u len %u" },
+    [TRACE_EV_CMD] = { "cmd conn %u '%s'", true },
+    [TRACE_EV_CMD_ERR] = { "cmd conn %u err %d" },
+};
+
+static const char *const module_names[TRACE_MOD_COUNT] = {
+    [TRACE_MOD_IPC] = "ipc",
+    [TRACE_MOD_CMD] = "cmd",
+    [TRACE_MOD_APP] = "app",
+};
+
+static struct trace_module_state {
+    uint32_t rate;              /* Records per second, 0 for no limit */
+    uint32_t one_in;            /* Sampling ratio, 0 is off */
+    uint32_t sample_count;
+    uint32_t tokens;
+    uint32_t refill_ms;
+    struct trace_stats stats;
+} modules[TRACE_MOD_COUNT] = {
+    [0 ... TRACE_MOD_COUNT - 1] = {
+        .rate = TRACE_RATE_PER_S,
+        .one_in = 1,
+        .tokens = TRACE_RATE_PER_S,
+    },
+};
+
+static struct trace_record ring[TRACE_RING_RECORDS];
+static uint32_t ring_head;      /* Records written since the last clear */
+static struct k_spinlock trace_lock;
+
+#if TRACE_ENABLE
+
+/* Token bucket holding at most one second's worth of records */
+static bool take_token(struct trace_module_state *m, uint32_t now_ms)
+{
+    if (m->rate == 0) {
+        return true;
+    }
+
+    uint32_t elapsed = now_ms - m->refill_ms;
+    uint32_t refill = (uint32_t)MIN((uint64_t)elapsed * m->rate / 1000U, m->rate);
+
+    if (refill > 0) {
+        m->tokens = MIN(m->tokens + refill, m->rate);
+        m->refill_ms = now_ms;
+    }
+
+    if (m->tokens == 0) {
+        return false;
+    }
+
+    m->tokens--;
+    return true;
+}
+
+void trace_event(enum trace_module module, enum trace_event event, uint16_t a, uint32_t b)
+{
+    struct trace_module_state *m = &modules[module];
+    uint32_t now_ms = k_uptime_get_32();
+    uint32_t timestamp_us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    if (m->one_in == 0 || (m->sample_count++ % m->one_in) != 0) {
+        m->stats.sampled_out++;
+    } else if (!take_token(m, now_ms)) {
+        m->stats.rate_limited++;
+    } else {
+        struct trace_record *rec = &ring[ring_head++ & (TRACE_RING_RECORDS - 1)];
+
+        rec->timestamp_us = sys_cpu_to_le32(timestamp_us);
+        rec->module = module;
+        rec->event = event;
+        rec->a = sys_cpu_to_le16(a);
+        rec->b = sys_cpu_to_le32(b);
+        m->stats.recorded++;
+    }
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+#endif /* TRACE_ENABLE */
+
+uint32_t trace_pack_text(const char *str)
+{
+    uint32_t packed = 0;
+
+    for (int i = 0; i < 4 && str[i]; i++) {
+        packed |= (uint32_t)(uint8_t)str[i] << (8 * i);
+    }
+
+    return packed;
+}
+
+void trace_set_rate(enum trace_module module, uint32_t per_s)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    modules[module].rate = per_s;
+    modules[module].tokens = per_s;
+    modules[module].refill_ms = k_uptime_get_32();
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+void trace_set_sampling(enum trace_module module, uint32_t one_in)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    modules[module].one_in = one_in;
+    modules[module].sample_count = 0;
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+void trace_get_stats(enum trace_module module, struct trace_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    *stats = modules[module].stats;
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+int trace_foreach(trace_cb_t cb, void *user_data)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    uint32_t head = ring_head;
+    uint32_t pos = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+    int visited = 0;
+
+    k_spin_unlock(&trace_lock, key);
+
+    for (; pos != head; pos++) {
+        struct trace_record rec;
+
+        key = k_spin_lock(&trace_lock);
+
+        /* Overwritten since we started, skip ahead to the oldest left */
+        if (ring_head - pos > TRACE_RING_RECORDS) {
+            k_spin_unlock(&trace_lock, key);
+            continue;
+        }
+
+        rec = ring[pos & (TRACE_RING_RECORDS - 1)];
+        k_spin_unlock(&trace_lock, key);
+
+        visited++;
+        if (!cb(&rec, user_data)) {
+            break;
+        }
+    }
+
+    return visited;
+}
+
+void trace_clear(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    ring_head = 0;
+    for (int i = 0; i < TRACE_MOD_COUNT; i++) {
+        memset(&modules[i].stats, 0, sizeof(modules[i].stats));
+    }
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+const char *trace_event_format(enum trace_event event)
+{
+    return event < TRACE_EVENT_COUNT ? dictionary[event].fmt : "?";
+}
+
+bool trace_event_is_text(enum trace_event event)
+{
+    return event < TRACE_EVENT_COUNT && dictionary[event].text;
+}
+
+static bool print_record(const struct trace_record *rec, void *user_data)
+{
+    struct cmd_ctx *ctx = user_data;
+    uint32_t b = sys_le32_to_cpu(rec->b);
+    const char *fmt = trace_event_format(rec->event);
+
+    cmd_printf(ctx, "%10u %s ", sys_le32_to_cpu(rec->timestamp_us),
+               rec->module < TRACE_MOD_COUNT ? module_names[rec->module] : "?");
+
+    if (trace_event_is_text(rec->event)) {
+        char text[5] = { b, b >> 8, b >> 16, b >> 24, '\0' };
+
+        cmd_printf(ctx, fmt, sys_le16_to_cpu(rec->a), text);
+    } else {
+        cmd_printf(ctx, fmt, sys_le16_to_cpu(rec->a), b);
+    }
+
+    return cmd_printf(ctx, "\n") >= 0;
+}
+
+struct raw_state {
+    struct cmd_ctx *ctx;
+    uint32_t remaining;
+};
+
+static bool write_record(const struct trace_record *rec, void *user_data)
+{
+    struct raw_state *state = user_data;
+
+    if (state->remaining == 0) {
+        return false;
+    }
+
+    state->remaining--;
+    return cmd_write(state->ctx, rec, sizeof(*rec)) >= 0;
+}
+
+static uint32_t ring_count(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    uint32_t count = MIN(ring_head, TRACE_RING_RECORDS);
+
+    k_spin_unlock(&trace_lock, key);
+    return count;
+}
+
+static int find_module(const char *name, size_t len)
+{
+    for (int i = 0; i < TRACE_MOD_COUNT; i++) {
+        if (strlen(module_names[i]) == len && strncmp(module_names[i], name, len) == 0) {
+            return i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/* "rate <module> <n>" and "sample <module> <n>" */
+static int cmd_trace_set(struct cmd_ctx *ctx, const char *args, bool rate)
+{
+    const char *name = strchr(args, ' ');
+    const char *value = name ? strchr(name + 1, ' ') : NULL;
+    int module = value ? find_module(name + 1, value - name - 1) : -EINVAL;
+
+    if (module < 0) {
+        cmd_printf(ctx, "Usage: trace %s <ipc|cmd|app> <n>\n", rate ? "rate" : "sample");
+        return -EINVAL;
+    }
+
+    char *end;
+    unsigned long n = strtoul(value + 1, &end, 10);
+
+    if (end == value + 1) {
+        cmd_printf(ctx, "Invalid value: %s\n", value + 1);
+        return -EINVAL;
+    }
+
+    if (rate) {
+        trace_set_rate(module, n);
+    } else {
+        trace_set_sampling(module, n);
+    }
+
+    cmd_printf(ctx, "%s %s %lu\n", module_names[module], rate ? "rate" : "sample", n);
+    return 0;
+}
+
+static int cmd_trace(struct cmd_ctx *ctx, const char *args)
+{
+    if (args && strcmp(args, "dump") == 0) {
+        trace_foreach(print_record, ctx);
+        return 0;
+    }
+
+    if (args && strcmp(args, "raw") == 0) {
+        static const struct trace_record empty;
+        struct raw_state state = {
+            .ctx = ctx,
+            .remaining = ring_count(),
+        };
+
+        /* Text header, then exactly that many raw records for host-side decoding */
+        cmd_printf(ctx, "trace: %u records of %u bytes\n", state.remaining,
+                   (unsigned int)sizeof(struct trace_record));
+        trace_foreach(write_record, &state);
+
+        /* Records overwritten while streaming are sent as all zero */
+        while (state.remaining > 0) {
+            cmd_write(ctx, &empty, sizeof(empty));
+            state.remaining--;
+        }
+        return 0;
+    }
+
+    if (args && strcmp(args, "clear") == 0) {
+        trace_clear();
+        cmd_printf(ctx, "Trace cleared\n");
+        return 0;
+    }
+
+    if (args && strncmp(args, "rate ", 5) == 0) {
+        return cmd_trace_set(ctx, args, true);
+    }
+
+    if (args && strncmp(args, "sample ", 7) == 0) {
+        return cmd_trace_set(ctx, args, false);
+    }
+
+    cmd_printf(ctx, "Trace: %u of %u records\n", ring_count(), TRACE_RING_RECORDS);
+
+    for (int i = 0; i < TRACE_MOD_COUNT; i++) {
+        struct trace_stats stats;
+
+        trace_get_stats(i, &stats);
+        cmd_printf(ctx, "  %s: rate %u/s, 1 in %u, %u recorded, %u sampled out, %u limited\n",
+                   module_names[i], modules[i].rate, modules[i].one_in, stats.recorded,
+                   stats.sampled_out, stats.rate_limited);
+    }
+
+    cmd_printf(ctx, "Usage: trace <dump|raw|clear|rate|sample>\n");
+    return 0;
+}
+
+CMD_DEFINE(trace, "Data path trace (dump|raw|clear|rate|sample)", cmd_trace);
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Personal NRF Utils
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/**
+ * @file
+ * @brief Deferred binary trace for the data path
+ *
+ * Per-packet and per-command diagnostics as fixed 12-byte records in a RAM
+ * ring instead of formatted log messages. An event is an ID from a
+ * dictionary plus two integer arguments, so recording costs a timestamp
+ * and a copy under a spinlock. Each module has a rate limit and a
+ * sampling ratio, so tracing can stay on in production. The 'trace'
+ * command decodes the ring on demand, or streams it raw for host-side
+ * decoding with the same dictionary.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Compile tracing in, 0 turns trace_event() into a no-op */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+/** @brief Records kept in RAM (power of two), the oldest are overwritten */
+#ifndef TRACE_RING_RECORDS
+#define TRACE_RING_RECORDS 256
+#endif
+
+/** @brief Default records per second per module, 0 for no limit */
+#ifndef TRACE_RATE_PER_S
+#define TRACE_RATE_PER_S 200
+#endif
+
+/** @brief Trace sources, each with its own rate limit and sampling */
+enum trace_module {
+    TRACE_MOD_IPC,              /* ble_init IPC frames */
+    TRACE_MOD_CMD,              /* cmd_parser commands */
+    TRACE_MOD_APP,              /* Application callbacks */
+    TRACE_MOD_COUNT,
+};
+
+/** @brief Trace dictionary, the arguments of each event are listed */
+enum trace_event {
+    TRACE_EV_IPC_RX,            /* a: message type, b: payload length */
+    TRACE_EV_IPC_TX,            /* a: message type, b: payload length */
+    TRACE_EV_DATA_RX,           /* a: connection, b: length */
+    TRACE_EV_APP_RX,            /* a: connection, b: length */
+    TRACE_EV_CMD,               /* a: connection, b: first 4 characters of the name */
+    TRACE_EV_CMD_ERR,           /* a: connection, b: result code */
+    TRACE_EVENT_COUNT,
+};
+
+/** @brief Trace record, little-endian as stored and sent */
+struct trace_record {
+    uint32_t timestamp_us;      /* Microseconds since boot, wraps after 71 minutes */
+    uint8_t module;             /* enum trace_module */
+    uint8_t event;              /* enum trace_event */
+    uint16_t a;
+    uint32_t b;
+} __packed;
+
+/** @brief Per-module counters */
+struct trace_stats {
+    uint32_t recorded;
+    uint32_t sampled_out;       /* Skipped by sampling */
+    uint32_t rate_limited;      /* Dropped by the rate limit */
+};
+
+/**
+ * @brief Record callback for trace_foreach()
+ *
+ * @return true to continue, false to stop iterating
+ */
+typedef bool (*trace_cb_t)(const struct trace_record *rec, void *user_data);
+
+#if TRACE_ENABLE
+
+/**
+ * @brief Record an event
+ *
+ * Safe from any context including ISRs. Subject to the module's sampling
+ * and rate limit.
+ *
+ * @param module Source module
+ * @param event Dictionary entry
+ * @param a First argument
+ * @param b Second argument
+ */
+void trace_event(enum trace_module module, enum trace_event event, uint16_t a, uint32_t b);
+
+#else
+
+static inline void trace_event(enum trace_module module, enum trace_event event, uint16_t a,
+                               uint32_t b)
+{
+}
+
+#endif /* TRACE_ENABLE */
+
+/**
+ * @brief Pack the start of a string into an event argument
+ *
+ * @param str String, shorter ones are zero padded
+ *
+ * @return Up to 4 characters, first one in the low byte
+ */
+uint32_t trace_pack_text(const char *str);
+
+/**
+ * @brief Limit how many events a module records
+ *
+ * @param module Module to configure
+ * @param per_s Records per second, bursts up to one second's worth,
+ *              0 for no limit
+ */
+void trace_set_rate(enum trace_module module, uint32_t per_s);
+
+/**
+ * @brief Record only every n-th event of a module
+ *
+ * Sampling is applied before the rate limit.
+ *
+ * @param module Module to configure
+ * @param one_in 1 records every event, 0 turns the module off
+ */
+void trace_set_sampling(enum trace_module module, uint32_t one_in);
+
+/**
+ * @brief Get a module's counters
+ *
+ * @param module Module to read
+ * @param stats Filled with the counters since boot or trace_clear()
+ */
+void trace_get_stats(enum trace_module module, struct trace_stats *stats);
+
+/**
+ * @brief Visit all records in the ring, oldest first
+ *
+ * @param cb Called for every record, outside the ring lock
+ * @param user_data Passed to @p cb
+ *
+ * @return Number of records visited
+ */
+int trace_foreach(trace_cb_t cb, void *user_data);
+
+/**
+ * @brief Discard all records and reset the counters
+ */
+void trace_clear(void);
+
+/**
+ * @brief Get the format string of a dictionary entry
+ *
+ * The format takes @p a and @p b as two unsigned arguments, except for
+ * events whose @p b is text (trace_event_is_text()), which take @p b as
+ * a string.
+ *
+ * @param event Dictionary entry
+ *
+ * @return Format string, "?" for unknown events
+ */
+const char *trace_event_format(enum trace_event event);
+
+/**
+ * @brief Check if an event packs text into @p b with trace_pack_text()
+ */
+bool trace_event_is_text(enum trace_event event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H_ */
@@ -4,9 +4,11 @@
  * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
  */
 
+#include <zephyr/kernel.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/atomic.h>
 
 #include <bluetooth/services/nus.h>
 #include <zephyr/logging/log.h>
@@ -42,7 +44,101 @@ static ssize_t on_receive(struct bt_conn *conn,
 	return len;
 }
 
-static void on_sent(struct bt_conn *conn, void *user_data)
+/* Marks the last notification of a send, the one reported as sent */
+#define SENT_LAST ((void *)1)
+
+#if defined(CONFIG_BT_MAX_CONN)
+#define NUS_MAX_CONN CONFIG_BT_MAX_CONN
+#else
+#define NUS_MAX_CONN 1
+#endif
+
+/* Flow control state of each connection, by bt_conn_index() */
+struct nus_tx_state {
+	atomic_t in_flight;
+	atomic_t stopped;
+};
+
+static struct nus_tx_state tx_state[NUS_MAX_CONN];
+
+static atomic_t stat_notifications;
+static atomic_t stat_bytes;
+static atomic_t stat_errors;
+static atomic_t stat_send_max_us;
+static atomic_t stat_in_flight_peak;
+
+static void stat_raise(atomic_t *stat, atomic_val_t value)
+{
+	atomic_val_t old = atomic_get(stat);
+
+	while (old < value && !atomic_cas(stat, old, value)) {
+		old = atomic_get(stat);
+	}
+}
+
+static void stat_send_time(uint32_t start)
+{
+	stat_raise(&stat_send_max_us,
+		   k_cyc_to_us_floor32(k_cycle_get_32() - start));
+}
+
+static struct nus_tx_state *tx_state_get(struct bt_conn *conn)
+{
+	return &tx_state[bt_conn_index(conn)];
+}
+
+/* A new link on a reused index must not inherit the old one's window */
+static void tx_state_reset(struct bt_conn *conn)
+{
+	struct nus_tx_state *tx = tx_state_get(conn);
+
+	atomic_clear(&tx->in_flight);
+	atomic_clear(&tx->stopped);
+}
+
+static void nus_connected(struct bt_conn *conn, uint8_t err)
+{
+	if (!err) {
+		tx_state_reset(conn);
+	}
+}
+
+static void nus_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	ARG_UNUSED(reason);
+
+	tx_state_reset(conn);
+}
+
+BT_CONN_CB_DEFINE(nus_conn_callbacks) = {
+	.connected = nus_connected,
+	.disconnected = nus_disconnected,
+};
+
+/* Completions of a dropped link may still arrive after the reset */
+static atomic_val_t tx_in_flight_dec(struct nus_tx_state *tx)
+{
+	atomic_val_t in_flight = atomic_get(&tx->in_flight);
+
+	while (in_flight > 0) {
+		if (atomic_cas(&tx->in_flight, in_flight, in_flight - 1)) {
+			return in_flight - 1;
+		}
+		in_flight = atomic_get(&tx->in_flight);
+	}
+
+	return 0;
+}
+
+static void tx_check_low_water(struct bt_conn *conn, struct nus_tx_state *tx)
+{
+	if (atomic_get(&tx->in_flight) <= BT_NUS_TX_LOW_WATER &&
+	    atomic_cas(&tx->stopped, 1, 0) && nus_cb.tx_low_water) {
+		nus_cb.tx_low_water(conn);
+	}
+}
+
+static void on_sent_all(struct bt_conn *conn, void *user_data)
 {
 	ARG_UNUSED(user_data);
 
@@ -53,6 +149,20 @@ static void on_sent(struct bt_conn *conn, void *user_data)
 	}
 }
 
+static void on_sent(struct bt_conn *conn, void *user_data)
+{
+	struct nus_tx_state *tx = tx_state_get(conn);
+	atomic_val_t in_flight = tx_in_flight_dec(tx);
+
+	LOG_DBG("Data send, conn %p, %ld in flight", (void *)conn, (long)in_flight);
+
+	tx_check_low_water(conn, tx);
+
+	if (user_data == SENT_LAST && nus_cb.sent) {
+		nus_cb.sent(conn);
+	}
+}
+
 /* UART Service Declaration */
 BT_GATT_SERVICE_DEFINE(nus_svc,
 BT_GATT_PRIMARY_SERVICE(BT_UUID_NUS_SERVICE),
@@ -87,6 +197,51 @@ int bt_nus_init(struct bt_nus_cb *callbacks)
 		nus_cb.received = callbacks->received;
 		nus_cb.sent = callbacks->sent;
 		nus_cb.send_enabled = callbacks->send_enabled;
+		nus_cb.tx_high_water = callbacks->tx_high_water;
+		nus_cb.tx_low_water = callbacks->tx_low_water;
+	}
+
+	return 0;
+}
+
+static int notify_chunk(struct bt_conn *conn, const uint8_t *data, uint16_t len,
+			bool last)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = &nus_svc.attrs[2],
+		.data = data,
+		.len = len,
+		.func = on_sent,
+		.user_data = last ? SENT_LAST : NULL,
+	};
+
+	struct nus_tx_state *tx = tx_state_get(conn);
+
+	/* Count before sending, the completion may run before we return */
+	atomic_val_t in_flight = atomic_inc(&tx->in_flight) + 1;
+
+	int err = bt_gatt_notify_cb(conn, &params);
+
+	if (err) {
+		tx_in_flight_dec(tx);
+		atomic_inc(&stat_errors);
+		return err;
+	}
+
+	atomic_inc(&stat_notifications);
+	atomic_add(&stat_bytes, len);
+	stat_raise(&stat_in_flight_peak, in_flight);
+
+	if (atomic_get(&tx->in_flight) >= BT_NUS_TX_MAX_IN_FLIGHT &&
+	    !atomic_set(&tx->stopped, 1)) {
+		if (nus_cb.tx_high_water) {
+			nus_cb.tx_high_water(conn);
+		}
+
+		/* Completions that ran before stopped was set did not check
+		 * for low water, so the window may already have drained.
+		 */
+		tx_check_low_water(conn, tx);
 	}
 
 	return 0;
@@ -96,18 +251,118 @@ int bt_nus_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
 {
 	struct bt_gatt_notify_params params = {0};
 	const struct bt_gatt_attr *attr = &nus_svc.attrs[2];
-
-	params.attr = attr;
-	params.data = data;
-	params.len = len;
-	params.func = on_sent;
+	uint32_t start = k_cycle_get_32();
+	int err;
 
 	if (!conn) {
+		params.attr = attr;
+		params.data = data;
+		params.len = len;
+		params.func = on_sent_all;
+
 		LOG_DBG("Notification send to all connected peers");
-		return bt_gatt_notify_cb(NULL, &params);
-	} else if (bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
-		return bt_gatt_notify_cb(conn, &params);
-	} else {
+		err = bt_gatt_notify_cb(NULL, &params);
+		if (err) {
+			atomic_inc(&stat_errors);
+		} else {
+			atomic_inc(&stat_notifications);
+			atomic_add(&stat_bytes, len);
+		}
+
+		stat_send_time(start);
+		return err;
+	} else if (!bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
 		return -EINVAL;
 	}
+
+	/* Fill whole LL packets, only report the last chunk as sent */
+	uint16_t chunk = bt_nus_get_chunk_size(conn);
+
+	while (len > chunk) {
+		err = notify_chunk(conn, data, chunk, false);
+
+		if (err) {
+			stat_send_time(start);
+			return err;
+		}
+
+		data += chunk;
+		len -= chunk;
+	}
+
+	err = notify_chunk(conn, data, len, true);
+	stat_send_time(start);
+
+	return err;
+}
+
+int bt_nus_send_queued(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	const struct bt_gatt_attr *attr = &nus_svc.attrs[2];
+	uint32_t start = k_cycle_get_32();
+	uint16_t queued = 0;
+
+	if (!conn || !bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+		return -EINVAL;
+	}
+
+	uint16_t chunk = bt_nus_get_chunk_size(conn);
+
+	struct nus_tx_state *tx = tx_state_get(conn);
+
+	while (queued < len && atomic_get(&tx->in_flight) < BT_NUS_TX_MAX_IN_FLIGHT) {
+		uint16_t n = MIN(chunk, len - queued);
+		int err = notify_chunk(conn, data + queued, n, queued + n == len);
+
+		if (err) {
+			if (queued > 0) {
+				break;
+			}
+			return err == -ENOMEM ? -EAGAIN : err;
+		}
+
+		queued += n;
+	}
+
+	stat_send_time(start);
+
+	if (queued == 0 && len > 0) {
+		return -EAGAIN;
+	}
+
+	return queued;
+}
+
+uint32_t bt_nus_get_in_flight(struct bt_conn *conn)
+{
+	uint32_t in_flight = 0;
+
+	if (conn) {
+		return atomic_get(&tx_state_get(conn)->in_flight);
+	}
+
+	for (int i = 0; i < NUS_MAX_CONN; i++) {
+		in_flight += atomic_get(&tx_state[i].in_flight);
+	}
+
+	return in_flight;
+}
+
+void bt_nus_get_stats(struct bt_nus_stats *stats, bool reset)
+{
+	if (stats) {
+		stats->notifications = atomic_get(&stat_notifications);
+		stats->bytes = atomic_get(&stat_bytes);
+		stats->errors = atomic_get(&stat_errors);
+		stats->send_max_us = atomic_get(&stat_send_max_us);
+		stats->in_flight_peak = atomic_get(&stat_in_flight_peak);
+	}
+
+	if (reset) {
+		atomic_clear(&stat_notifications);
+		atomic_clear(&stat_bytes);
+		atomic_clear(&stat_errors);
+		atomic_clear(&stat_send_max_us);
+		atomic_clear(&stat_in_flight_peak);
+	}
 }